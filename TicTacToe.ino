@@ -6,6 +6,8 @@
 #include <Wire.h>
 #include <WiFi.h>
 #include <PubSubClient.h>
+#include "ttt.h"                  // Shared bitboard game rules
+#include "tttWire.h"              // Binary game-state message
 
 #define SDA 14                    // Define SDA pins
 #define SCL 13                    // Define SCL pins
@@ -28,6 +30,34 @@ const char* topic_current_player = "TTT/player"; // Topic for current player
 const char* topic_game_status = "TTT/status";  // Topic for game status
 const char* topic_moves = "TTT/moves";         // Topic for moves
 const char* topic_score = "TTT/score";         // Topic for score
+const char* topic_state = "TTT/state";         // Retained binary game state, see tttWire.h
+
+// Also publish the old text topics (board, player, board_formatted, moves,
+// status, score) for clients that don't understand TTT/state yet
+const boolean publishTextTopics = false;
+
+// Reconnect backoff: the first retry comes after RECONNECT_MIN_MS, each
+// failure doubles the step up to RECONNECT_MAX_MS, and every wait is
+// picked between half and all of the step so boards that lost the same
+// broker don't all come back at once. loop() keeps running meanwhile.
+const unsigned long RECONNECT_MIN_MS = 10;
+const unsigned long RECONNECT_MAX_MS = 10000;
+unsigned long reconnectStep = RECONNECT_MIN_MS;
+unsigned long nextReconnectAt = 0;
+unsigned long disconnectedAt = 0;
+boolean wasConnected = false;
+
+// Text-topic messages (moves, status, score) published while the broker
+// is away, sent in order on reconnect; when full the oldest is dropped.
+// TTT/state isn't queued: publishCurrentState() runs on every reconnect.
+#define OFFLINE_QUEUE 16
+struct QueuedMessage {
+  const char* topic;
+  char payload[24];
+};
+QueuedMessage offlineQueue[OFFLINE_QUEUE];
+int offlineHead = 0;
+int offlineCount = 0;
 
 // Initialize WiFi and MQTT client - GLOBAL DECLARATIONS
 WiFiClient espClient;
@@ -39,18 +69,16 @@ LiquidCrystal_I2C lcd(0x27, 16, 2);
 // Function declaration to prevent errors
 String getBoardStateString();
 void publishGameState();
+void publishCurrentState();
 
-// Game variables
-char board[3][3] = {
-  {' ', ' ', ' '},
-  {' ', ' ', ' '},
-  {' ', ' ', ' '}
-};
-char currentPlayer = 'X';
+// Game variables: one 9-bit mask per player, see ttt.h
+TttBoard board = {0, 0, 0, TTT_PLAYING};
 unsigned short int xWins = 0;
 unsigned short int oWins = 0;
 unsigned short int winCount = 0;
 boolean gameOver = false;
+uint16_t stateSeq = 0;            // Sequence number of the last TTT/state
+int8_t lastMove = TTT_NO_MOVE;    // Cell of the last move, for TTT/state
 
 // Callback function for MQTT messages
 void callback(char* topic, byte* payload, unsigned int length) {
@@ -65,6 +93,13 @@ void callback(char* topic, byte* payload, unsigned int length) {
   }
   Serial.println(message);
 
+  // 's' asks for a snapshot: a client that just connected wants the
+  // current state, whatever it is
+  if (message.equals("s") || message.equals("S")) {
+    publishCurrentState();
+    return;
+  }
+
   // Process the message if game is not over
   if (!gameOver) {
     // Check if the message is in the format "row,col"
@@ -83,43 +118,82 @@ void callback(char* topic, byte* payload, unsigned int length) {
   }
 }
 
-// Reconnect to MQTT broker when connection is lost
+// Publish a text message now, or keep it for the next reconnect
+void publishOrQueue(const char* topic, const char* payload) {
+  if (client.connected() && client.publish(topic, payload)) {
+    return;
+  }
+
+  if (offlineCount == OFFLINE_QUEUE) {
+    offlineHead = (offlineHead + 1) % OFFLINE_QUEUE;
+    offlineCount--;
+  }
+  QueuedMessage* m = &offlineQueue[(offlineHead + offlineCount) % OFFLINE_QUEUE];
+  m->topic = topic;
+  strncpy(m->payload, payload, sizeof(m->payload) - 1);
+  m->payload[sizeof(m->payload) - 1] = '\0';
+  offlineCount++;
+}
+
+void flushOfflineQueue() {
+  while (offlineCount > 0 && client.publish(offlineQueue[offlineHead].topic, offlineQueue[offlineHead].payload)) {
+    offlineHead = (offlineHead + 1) % OFFLINE_QUEUE;
+    offlineCount--;
+  }
+}
+
+// Reconnect to MQTT broker when connection is lost: at most one attempt
+// per call, once the backoff has run out, so the game keeps running
 void reconnect() {
-  // Loop until we're reconnected
-  while (!client.connected()) {
-    Serial.print("Attempting MQTT connection...");
-
-    // Attempt to connect
-    if (mqtt_username[0] == '\0') {
-      // Connect without credentials
-      if (client.connect(clientID)) {
-        Serial.println("connected");
-
-        // Subscribe to light control topic
-        client.subscribe(topic_sub);
-        Serial.println("Subscribed to: " + String(topic_sub));
-      } else {
-        Serial.print("failed, rc=");
-        Serial.print(client.state());
-        Serial.println(" try again in 5 seconds");
-        delay(5000);
-      }
-    } else {
-      // Connect with credentials
-      if (client.connect(clientID, mqtt_username, mqtt_password)) {
-        Serial.println("connected");
-
-        // Subscribe to light control topic
-        client.subscribe(topic_sub);
-        Serial.println("Subscribed to: " + String(topic_sub));
-      } else {
-        Serial.print("failed, rc=");
-        Serial.print(client.state());
-        Serial.println(" try again in 5 seconds");
-        delay(5000);
-      }
-    }
+  unsigned long now = millis();
+
+  if (wasConnected) {
+    wasConnected = false;
+    disconnectedAt = now;
+    nextReconnectAt = now;
   }
+  if ((long)(now - nextReconnectAt) < 0) {
+    return;
+  }
+
+  Serial.print("Attempting MQTT connection...");
+
+  // Persistent session (clean session off): the broker keeps our
+  // subscription, and the commands sent at QoS 1 while we're away.
+  // controlLinux, control.c and the control scripts send moves at QoS 1;
+  // QoS 0 commands (controlLinux -b batches) are not kept.
+  boolean connected;
+  if (mqtt_username[0] == '\0') {
+    // Connect without credentials
+    connected = client.connect(clientID, NULL, NULL, NULL, 0, false, NULL, false);
+  } else {
+    // Connect with credentials
+    connected = client.connect(clientID, mqtt_username, mqtt_password, NULL, 0, false, NULL, false);
+  }
+
+  if (!connected) {
+    unsigned long wait = reconnectStep / 2 + random(reconnectStep / 2 + 1);
+    Serial.print("failed, rc=");
+    Serial.print(client.state());
+    Serial.println(" try again in " + String(wait) + " ms");
+    nextReconnectAt = now + wait;
+    reconnectStep = min(reconnectStep * 2, RECONNECT_MAX_MS);
+    return;
+  }
+
+  Serial.println("connected after " + String(millis() - disconnectedAt) + " ms");
+  wasConnected = true;
+  reconnectStep = RECONNECT_MIN_MS;
+
+  // Subscribe to the game control topic (again, in case the broker
+  // didn't keep the session)
+  client.subscribe(topic_sub, 1);
+  Serial.println("Subscribed to: " + String(topic_sub));
+
+  flushOfflineQueue();
+
+  // The broker may have lost the retained state while we were away
+  publishCurrentState();
 }
 
 void setup() {
@@ -155,14 +229,14 @@ void setup() {
   Serial.println("IP address: ");
   Serial.println(WiFi.localIP());
 
-  // Set MQTT server and callback function
+  // Set MQTT server and callback function. A short socket timeout keeps
+  // a connect attempt to a dead broker from stalling the game for long.
   client.setServer(mqtt_server, mqtt_port);
   client.setCallback(callback);
+  client.setSocketTimeout(2);
 
-  // Initial connection to MQTT
-  if (!client.connected()) {
-    reconnect();
-  }
+  // Initial connection to MQTT (retried from loop() if it fails)
+  reconnect();
 
   // Send initial game state
   publishGameState();
@@ -197,6 +271,8 @@ void loop() {
 }
 
 void makeMove(int row, int col) {
+    char currentPlayer = tttPlayerChar(&board);
+
     lcd.setCursor(10, 0);
     lcd.print("TURN:");
     lcd.print(currentPlayer);
@@ -212,23 +288,26 @@ void makeMove(int row, int col) {
     return;
   }
 
-  if (board[row][col] != ' ') {
+  if (!tttIsFree(&board, row * 3 + col)) {
     Serial.println("That position is already taken!");
     return;
   }
 
   // Make the move
-  board[row][col] = currentPlayer;
+  int result = tttPlay(&board, row * 3 + col);
+  lastMove = row * 3 + col;
 
   // Publish the move to MQTT
-  String moveMessage = String(row + 1) + "," + String(col + 1) + "," + String(currentPlayer);
-  client.publish(topic_moves, moveMessage.c_str());
+  if (publishTextTopics) {
+    String moveMessage = String(row + 1) + "," + String(col + 1) + "," + String(currentPlayer);
+    publishOrQueue(topic_moves, moveMessage.c_str());
+  }
 
   // Print the updated board
   printBoard();
 
   // Check if there's a winner
-  if (checkWin()) {
+  if (result == TTT_WON) {
     gameOver = true;
     if (currentPlayer == 'X') {
       xWins++;
@@ -249,8 +328,10 @@ void makeMove(int row, int col) {
     Serial.println("Press 'r' to reset the game.");
 
     // Publish win notification
-    String winMessage = String(currentPlayer) + " wins";
-    client.publish(topic_game_status, winMessage.c_str());
+    if (publishTextTopics) {
+      String winMessage = String(currentPlayer) + " wins";
+      publishOrQueue(topic_game_status, winMessage.c_str());
+    }
 
     // Update board state one final time
     publishGameState();
@@ -258,23 +339,24 @@ void makeMove(int row, int col) {
   }
 
   // Check for a draw
-  if (checkDraw()) {
+  if (result == TTT_DREW) {
     gameOver = true;
     Serial.println("Game is a draw!");
     Serial.println("Press 'r' to reset the game.");
 
     // Publish draw notification
-    client.publish(topic_game_status, "draw");
+    if (publishTextTopics) {
+      publishOrQueue(topic_game_status, "draw");
+    }
 
     // Update board state one final time
     publishGameState();
     return;
   }
 
-  // Switch players
-  currentPlayer = (currentPlayer == 'X') ? 'O' : 'X';
+  // tttPlay() already switched players
   Serial.print("Player ");
-  Serial.print(currentPlayer);
+  Serial.print(tttPlayerChar(&board));
   Serial.println("'s turn.");
 
   // Publish updated game state
@@ -283,12 +365,30 @@ void makeMove(int row, int col) {
 
 // New function to publish the complete game state
 void publishGameState() {
+  ++stateSeq;
+  publishCurrentState();
+}
+
+// Publish the state as it is, without a new sequence number (snapshot
+// requests and reconnects)
+void publishCurrentState() {
+  // Publish the binary state, which carries board, player, last move,
+  // status and score in one retained message
+  TttState state = {board, stateSeq, lastMove, xWins, oWins};
+  uint8_t message[TTT_WIRE_SIZE];
+  tttWireEncode(&state, message);
+  client.publish(topic_state, message, sizeof(message), true);
+
+  if (!publishTextTopics) {
+    return;
+  }
+
   // Publish board state
   String boardState = getBoardStateString();
   client.publish(topic_board_state, boardState.c_str());
 
   // Publish current player
-  String playerState = String(currentPlayer);
+  String playerState = String(tttPlayerChar(&board));
   client.publish(topic_current_player, playerState.c_str());
 
   // Publish formatted board state (more readable)
@@ -302,7 +402,7 @@ String getFormattedBoardString() {
   for (int i = 0; i < 3; ++i) {
     formatted += " ";
     for (int j = 0; j < 3; ++j) {
-      formatted += board[i][j];
+      formatted += tttCellChar(&board, i * 3 + j);
       if (j < 2) formatted += " | ";
     }
     formatted += "\n";
@@ -311,53 +411,10 @@ String getFormattedBoardString() {
   return formatted;
 }
 
-boolean checkWin() {
-  // Check rows
-  for (int i = 0; i < 3; ++i) {
-    if (board[i][0] != ' ' && board[i][0] == board[i][1] && board[i][1] == board[i][2]) {
-      return true;
-    }
-  }
-
-  // Check columns
-  for (int i = 0; i < 3; ++i) {
-    if (board[0][i] != ' ' && board[0][i] == board[1][i] && board[1][i] == board[2][i]) {
-      return true;
-    }
-  }
-
-  // Check diagonals
-  if (board[0][0] != ' ' && board[0][0] == board[1][1] && board[1][1] == board[2][2]) {
-    return true;
-  }
-
-  if (board[0][2] != ' ' && board[0][2] == board[1][1] && board[1][1] == board[2][0]) {
-    return true;
-  }
-
-  return false;
-}
-
-boolean checkDraw() {
-  for (int i = 0; i < 3; ++i) {
-    for (int j = 0; j < 3; ++j) {
-      if (board[i][j] == ' ') {
-        return false;
-      }
-    }
-  }
-  return true;
-}
-
 void resetGame() {
   // Reset the board
-  for (int i = 0; i < 3; ++i) {
-    for (int j = 0; j < 3; ++j) {
-      board[i][j] = ' ';
-    }
-  }
-
-  currentPlayer = 'X';
+  tttReset(&board);
+  lastMove = TTT_NO_MOVE;
   gameOver = false;
 
   Serial.println("New game started!");
@@ -365,7 +422,9 @@ void resetGame() {
   printBoard();
 
   // Publish reset notification and updated game state
-  client.publish(topic_game_status, "reset");
+  if (publishTextTopics) {
+    publishOrQueue(topic_game_status, "reset");
+  }
   publishGameState();
 }
 
@@ -379,16 +438,18 @@ void updateScores() {
   lcd.print("O: ");
   lcd.print(oWins);
 
-  // Also publish scores to MQTT
-  String scoreMessage = "X:" + String(xWins) + ",O:" + String(oWins);
-  client.publish(topic_score, scoreMessage.c_str());
+  // Also publish scores to MQTT (TTT/state carries them too)
+  if (publishTextTopics) {
+    String scoreMessage = "X:" + String(xWins) + ",O:" + String(oWins);
+    publishOrQueue(topic_score, scoreMessage.c_str());
+  }
 }
 
 String getBoardStateString() {
   String state = "";
   for (int i = 0; i < 3; ++i) {
     for (int j = 0; j < 3; ++j) {
-      state += board[i][j];
+      state += tttCellChar(&board, i * 3 + j);
     }
   }
   return state;
@@ -404,7 +465,7 @@ void printBoard() {
     Serial.print("|");
 
     for (int j = 0; j < 3; ++j) {
-      Serial.print(board[i][j]);
+      Serial.print(tttCellChar(&board, i * 3 + j));
       Serial.print("|");
     }
 
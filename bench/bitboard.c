@@ -0,0 +1,144 @@
+// bench/bitboard.c - Per-move cost of the ttt.h bitboard core against the
+// char board[3][3] loops from TicTacToe.ino (checkWin/checkDraw)
+//
+//   gcc -O2 bench/bitboard.c -I. -o bench_bitboard && ./bench_bitboard
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ttt.h"
+
+#define GAMES 1000000
+
+// A pre-shuffled cell order per game, so both versions play the same moves
+static unsigned char orders[GAMES][9];
+
+// ---- Old rules, as in TicTacToe.ino ----
+static char board[3][3];
+static char currentPlayer;
+
+static int checkWin() {
+    for (int i = 0; i < 3; ++i) {
+        if (board[i][0] != ' ' && board[i][0] == board[i][1] && board[i][1] == board[i][2]) {
+            return 1;
+        }
+    }
+    for (int i = 0; i < 3; ++i) {
+        if (board[0][i] != ' ' && board[0][i] == board[1][i] && board[1][i] == board[2][i]) {
+            return 1;
+        }
+    }
+    if (board[0][0] != ' ' && board[0][0] == board[1][1] && board[1][1] == board[2][2]) {
+        return 1;
+    }
+    if (board[0][2] != ' ' && board[0][2] == board[1][1] && board[1][1] == board[2][0]) {
+        return 1;
+    }
+    return 0;
+}
+
+static int checkDraw() {
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            if (board[i][j] == ' ') {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// Returns the number of moves played
+static long playLegacy(const unsigned char *order, int *result) {
+    memset(board, ' ', sizeof(board));
+    currentPlayer = 'X';
+
+    for (int m = 0; m < 9; m++) {
+        int row = order[m] / 3;
+        int col = order[m] % 3;
+
+        if (board[row][col] != ' ') {
+            continue;
+        }
+        board[row][col] = currentPlayer;
+
+        if (checkWin()) {
+            *result = currentPlayer == 'X' ? TTT_X_WINS : TTT_O_WINS;
+            return m + 1;
+        }
+        if (checkDraw()) {
+            *result = TTT_DRAW;
+            return m + 1;
+        }
+        currentPlayer = (currentPlayer == 'X') ? 'O' : 'X';
+    }
+    *result = TTT_PLAYING;
+    return 9;
+}
+
+// ---- Bitboard rules from ttt.h ----
+static long playBitboard(const unsigned char *order, int *result) {
+    TttBoard b;
+    tttReset(&b);
+
+    for (int m = 0; m < 9; m++) {
+        if (tttPlay(&b, order[m]) > TTT_MOVED) {
+            *result = b.status;
+            return m + 1;
+        }
+    }
+    *result = b.status;
+    return 9;
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef long (*PlayFn)(const unsigned char *, int *);
+
+static void run(const char *name, PlayFn play, long *checksum) {
+    long moves = 0;
+    long sum = 0;
+    double start = now();
+
+    for (int g = 0; g < GAMES; g++) {
+        int result;
+        moves += play(orders[g], &result);
+        sum += result;
+    }
+
+    double elapsed = now() - start;
+    printf("%-10s %ld moves in %.3f s: %.2f ns/move\n", name, moves, elapsed, elapsed * 1e9 / moves);
+    *checksum = sum;
+}
+
+int main() {
+    long legacySum, bitboardSum;
+
+    srand(1);
+    for (int g = 0; g < GAMES; g++) {
+        for (int i = 0; i < 9; i++) {
+            orders[g][i] = (unsigned char)i;
+        }
+        for (int i = 8; i > 0; i--) {
+            int j = rand() % (i + 1);
+            unsigned char t = orders[g][i];
+            orders[g][i] = orders[g][j];
+            orders[g][j] = t;
+        }
+    }
+
+    run("loops", playLegacy, &legacySum);
+    run("bitboard", playBitboard, &bitboardSum);
+
+    if (legacySum != bitboardSum) {
+        printf("Results differ! (%ld vs %ld)\n", legacySum, bitboardSum);
+        return 1;
+    }
+    return 0;
+}
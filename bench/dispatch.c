@@ -0,0 +1,183 @@
+// bench/dispatch.c - Messages/sec through controlLinux's topic dispatch:
+// the snprintf + strcmp/strstr chain updateBoard() used to run for every
+// message, against the tttTopics.h table lookup with in-place parsing
+//
+//   gcc -O2 bench/dispatch.c -I. -o bench_dispatch && ./bench_dispatch
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ttt.h"
+#include "tttWire.h"
+#include "tttTopics.h"
+
+#define ROUNDS 1000000
+
+typedef struct {
+    const char *topic;
+    size_t topicLen;
+    const char *payload;
+    size_t payloadLen;
+} Message;
+
+static const char gameTopic[] = "TTT/42";
+
+// What one move looks like in compatibility mode, plus traffic for
+// another game that only has to be rejected
+static Message stream[] = {
+    {"TTT/42/state", 0, NULL, TTT_WIRE_SIZE},
+    {"TTT/42/moves", 0, "2,2", 3},
+    {"TTT/42/board", 0, "X   O    ", 9},
+    {"TTT/42/player", 0, "X", 1},
+    {"TTT/42/board_formatted", 0, "X| | \n-+-+-\n |O| \n-+-+-\n | | ", 29},
+    {"TTT/42/status", 0, "X wins", 6},
+    {"TTT/42/score", 0, "X:1,O:0", 7},
+    {"TTT/7/board", 0, "  X      ", 9},
+};
+#define STREAM_LEN (sizeof(stream) / sizeof(stream[0]))
+
+static uint8_t statePayload[TTT_WIRE_SIZE];
+
+// What the handlers did, so both versions can be checked against each other
+typedef struct {
+    TttBoard board;
+    long states, boards, players, wins, moves;
+} Result;
+
+static void updateState(Result *r, const char *payload, size_t len) {
+    TttState state;
+    if (tttWireDecode((const uint8_t *)payload, len, &state) == 0) {
+        r->board = state.board;
+        r->states++;
+    }
+}
+
+// ---- Before: as updateBoard() was in controlLinux.c ----
+static void dispatchLegacy(Result *r, const Message *m) {
+    char stateTopic[96];
+    char subTopic[256];
+    const char *topic = m->topic;
+    const char *message = m->payload;
+
+    snprintf(stateTopic, sizeof(stateTopic), "%s/state", gameTopic);
+    if (strcmp(topic, stateTopic) == 0) {
+        updateState(r, m->payload, m->payloadLen);
+        return;
+    }
+
+    snprintf(subTopic, sizeof(subTopic), "%s/board", gameTopic);
+    if (strcmp(topic, subTopic) == 0) {
+        tttFromString(&r->board, message);
+        r->boards++;
+        return;
+    }
+
+    snprintf(subTopic, sizeof(subTopic), "%s/player", gameTopic);
+    if (strcmp(topic, subTopic) == 0) {
+        r->board.player = (message[0] == 'O');
+        r->players++;
+        return;
+    }
+
+    snprintf(subTopic, sizeof(subTopic), "%s/status", gameTopic);
+    if (strcmp(topic, subTopic) == 0) {
+        if (strstr(message, "wins") != NULL) {
+            r->wins++;
+        }
+        return;
+    }
+
+    if (strstr(topic, "/moves") != NULL) {
+        if (strlen(message) >= 3) {
+            r->moves += (message[0] - '1') * 3 + (message[2] - '1');
+        }
+    }
+}
+
+// ---- After: tttTopics.h lookup, payload parsed where it lies ----
+static TttTopicTable topics;
+
+static void dispatchTable(Result *r, const Message *m) {
+    const char *message = m->payload;
+    size_t len = m->payloadLen;
+
+    switch (tttTopicLookup(&topics, m->topic, m->topicLen)) {
+    case TTT_SUB_STATE:
+        updateState(r, message, len);
+        break;
+    case TTT_SUB_BOARD:
+        if (len >= 9) {
+            tttFromString(&r->board, message);
+            r->boards++;
+        }
+        break;
+    case TTT_SUB_PLAYER:
+        r->board.player = (len > 0 && message[0] == 'O');
+        r->players++;
+        break;
+    case TTT_SUB_STATUS:
+        if (len >= 4 && memcmp(message + len - 4, "wins", 4) == 0) {
+            r->wins++;
+        }
+        break;
+    case TTT_SUB_MOVES:
+        if (len >= 3) {
+            r->moves += (message[0] - '1') * 3 + (message[2] - '1');
+        }
+        break;
+    }
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef void (*DispatchFn)(Result *, const Message *);
+
+static void run(const char *name, DispatchFn dispatch, Result *r) {
+    long messages = 0;
+    double start = now();
+
+    memset(r, 0, sizeof(*r));
+    for (int round = 0; round < ROUNDS; round++) {
+        for (size_t i = 0; i < STREAM_LEN; i++) {
+            dispatch(r, &stream[i]);
+        }
+        messages += STREAM_LEN;
+    }
+
+    double elapsed = now() - start;
+    printf("%-8s %ld messages in %.3f s: %.1f M msgs/s, %.1f ns/msg\n", name, messages, elapsed,
+           messages / elapsed / 1e6, elapsed * 1e9 / messages);
+}
+
+int main() {
+    TttState state = {{0x001, 0x010, 0, TTT_PLAYING}, 1, 4, 0, 0};
+    Result legacy, table;
+
+    tttWireEncode(&state, statePayload);
+    stream[0].payload = (const char *)statePayload;
+    for (size_t i = 0; i < STREAM_LEN; i++) {
+        stream[i].topicLen = strlen(stream[i].topic);
+    }
+
+    if (tttTopicTableInit(&topics, gameTopic) < 0) {
+        printf("Topic table does not fit\n");
+        return 1;
+    }
+
+    run("strcmp", dispatchLegacy, &legacy);
+    run("table", dispatchTable, &table);
+
+    if (memcmp(&legacy.board, &table.board, sizeof(TttBoard)) != 0 || legacy.states != table.states ||
+        legacy.boards != table.boards || legacy.players != table.players || legacy.wins != table.wins ||
+        legacy.moves != table.moves) {
+        printf("Results differ!\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,127 @@
+// bench/grid.c - Per-move cost of the tttGrid.h engine on 3x3, 5x5 four
+// in a row and 15x15/16x16 gomoku, vector line detection against the
+// scalar version, plus a check that 3x3 plays out exactly like ttt.h
+//
+//   gcc -O2 -mavx2 bench/grid.c -I. -o bench_grid && ./bench_grid
+//   gcc -O2 bench/grid.c -I. -o bench_grid && ./bench_grid   # SSE2
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ttt.h"
+#include "tttGrid.h"
+
+#define MOVES 4000000
+
+typedef int (*LineFn)(const TttGridMarks *, int);
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// tttGridPlay() with the line check passed in
+static int play(TttGrid *g, int row, int col, LineFn hasLine) {
+    if (!tttGridIsFree(g, row, col)) {
+        return TTT_ILLEGAL;
+    }
+
+    TttGridMarks *marks = g->player ? &g->o : &g->x;
+    marks->rows[row] |= (uint16_t)(1u << col);
+    g->filled++;
+
+    if (hasLine(marks, g->k)) {
+        g->status = g->player ? TTT_O_WINS : TTT_X_WINS;
+        return TTT_WON;
+    }
+    if (g->filled == g->width * g->height) {
+        g->status = TTT_DRAW;
+        return TTT_DREW;
+    }
+    g->player ^= 1;
+    return TTT_MOVED;
+}
+
+// Random games until MOVES moves were played. Returns a checksum of the
+// results so both line checks can be compared.
+static long run(const char *variant, const char *name, LineFn hasLine) {
+    int width = 0, height = 0, k = 0;
+    TttGrid g;
+    unsigned int seed = 1;
+    long games = 0;
+    long sum = 0;
+
+    tttGridParseVariant(variant, strlen(variant), &width, &height, &k);
+    tttGridInit(&g, width, height, k);
+
+    double start = now();
+    for (long m = 0; m < MOVES; ) {
+        seed = seed * 1664525u + 1013904223u;
+        int cell = (int)((seed >> 8) % (unsigned int)(width * height));
+        int result = play(&g, cell / width, cell % width, hasLine);
+
+        if (result == TTT_ILLEGAL) {
+            continue;
+        }
+        m++;
+        if (result != TTT_MOVED) {
+            sum = sum * 31 + g.status * 256 + g.filled;
+            games++;
+            tttGridReset(&g);
+        }
+    }
+    double elapsed = now() - start;
+
+    printf("%-8s %-7s %ld moves, %ld games in %.3f s: %.2f ns/move\n", variant, name, (long)MOVES, games,
+           elapsed, elapsed * 1e9 / MOVES);
+    return sum;
+}
+
+// 3x3 grid games must end exactly like ttt.h games with the same moves
+static int checkClassic() {
+    unsigned int seed = 7;
+
+    for (int game = 0; game < 100000; game++) {
+        TttBoard b;
+        TttGrid g;
+        TttBoard back;
+
+        tttReset(&b);
+        tttGridInit(&g, 3, 3, 3);
+        while (b.status == TTT_PLAYING) {
+            seed = seed * 1664525u + 1013904223u;
+            int cell = (int)((seed >> 8) % 9);
+            if (tttPlay(&b, cell) != tttGridPlay(&g, cell / 3, cell % 3)) {
+                return -1;
+            }
+        }
+        tttGridToBoard(&g, &back);
+        if (memcmp(&b, &back, sizeof(b)) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main() {
+    static const char *variants[] = {"3x3k3", "5x5k4", "15x15k5", "16x16k5", NULL};
+
+    if (checkClassic() < 0) {
+        printf("3x3 grid differs from ttt.h!\n");
+        return 1;
+    }
+
+    for (int i = 0; variants[i] != NULL; i++) {
+        long scalar = run(variants[i], "scalar", tttGridHasLineScalar);
+        long vector = run(variants[i], "vector", tttGridHasLine);
+
+        if (scalar != vector) {
+            printf("Results differ for %s!\n", variants[i]);
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,57 @@
+#!/bin/sh
+# bench/reconnect.sh - How long games stall when the broker restarts
+# Runs tttServer and tttBench -c <clients> against a local tttBroker,
+# kills the broker with SIGKILL partway through, starts it again after
+# <downMs>, and prints tttBench's result. outage_ms is the longest any
+# client went from losing its connection to its next board echo; minus
+# the time the broker was down, that is the time to recover.
+#
+#   gcc -O2 tttBroker.c reactor.c -o tttBroker
+#   gcc -O2 tttServer.c mqtt.c reactor.c metrics.c -o tttServer -lpthread
+#   gcc -O2 tttBench.c mqtt.c reactor.c -o tttBench
+#   bench/reconnect.sh [port] [downMs] [clients]
+
+PORT=${1:-18830}
+DOWN_MS=${2:-500}
+CLIENTS=${3:-64}
+
+broker=""
+server=""
+stopAll() {
+    [ -n "$server" ] && kill $server 2>/dev/null
+    [ -n "$broker" ] && kill $broker 2>/dev/null
+    wait 2>/dev/null
+    broker=""
+    server=""
+}
+trap stopAll EXIT INT TERM
+
+startBroker() {
+    ./tttBroker -p "$PORT" -q > /dev/null &
+    broker=$!
+    sleep 0.1
+}
+
+startBroker
+./tttServer -p "$PORT" -q > /dev/null 2>&1 &
+server=$!
+sleep 0.3
+
+# Long enough for the slowest backoff step after the restart
+./tttBench -p "$PORT" -c "$CLIENTS" -d "$(echo "$DOWN_MS" | awk '{print 2 + $1 * 3 / 1000 + 2}')" \
+    -o reconnect.json > /dev/null 2>&1 &
+bench=$!
+
+sleep 2
+kill -9 $broker
+wait $broker 2>/dev/null
+sleep "$(echo "$DOWN_MS" | awk '{print $1 / 1000}')"
+startBroker
+
+wait $bench
+sed -n 's/.*"moves_per_sec":\([0-9.]*\).*"reconnects":\([0-9]*\),"outage_ms":\([0-9.]*\).*/\1 \2 \3/p' reconnect.json |
+    while read rate count outage; do
+        echo "broker down ${DOWN_MS} ms: $count reconnects, longest outage $outage ms" \
+             "(recovered $(echo "$outage $DOWN_MS" | awk '{print $1 - $2}') ms after the restart), $rate moves/s overall"
+    done
+rm -f reconnect.json
@@ -0,0 +1,50 @@
+#!/bin/sh
+# bench/scale.sh - Moves/s of tttServer -W with 1, 2 and 4 workers
+# Starts a local tttBroker, the workers and tttBench -c <clients> for each
+# worker count, prints one line per run, and stops everything again. Each
+# run gets a fresh broker, so no retained games carry over. Workers only
+# add throughput when they have cores of their own (and the broker one).
+#
+#   gcc -O2 tttBroker.c reactor.c -o tttBroker
+#   gcc -O2 tttServer.c mqtt.c reactor.c metrics.c -o tttServer -lpthread
+#   gcc -O2 tttBench.c mqtt.c reactor.c -o tttBench
+#   bench/scale.sh [port] [seconds] [clients] [workerCounts]
+
+PORT=${1:-18830}
+DURATION=${2:-10}
+CLIENTS=${3:-64}
+COUNTS=${4:-"1 2 4"}
+
+broker=""
+workers=""
+stopAll() {
+    [ -n "$workers" ] && kill $workers 2>/dev/null
+    wait $workers 2>/dev/null
+    [ -n "$broker" ] && kill $broker 2>/dev/null
+    wait 2>/dev/null
+    broker=""
+    workers=""
+}
+trap stopAll EXIT INT TERM
+
+for n in $COUNTS; do
+    ./tttBroker -p "$PORT" -q > /dev/null &
+    broker=$!
+    sleep 0.2
+
+    i=0
+    while [ $i -lt "$n" ]; do
+        ./tttServer -p "$PORT" -q -W "w$i" > /dev/null &
+        workers="$workers $!"
+        i=$((i + 1))
+    done
+    sleep 0.5
+
+    result=$(./tttBench -p "$PORT" -c "$CLIENTS" -d "$DURATION")
+    rate=$(echo "$result" | sed -n 's/.*"moves_per_sec":\([0-9.]*\).*/\1/p')
+    p99=$(echo "$result" | sed -n 's/.*"p99":\([0-9]*\).*/\1/p')
+    echo "$n workers: $rate moves/s, p99 ${p99} us"
+
+    stopAll
+    sleep 0.2
+done
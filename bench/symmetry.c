@@ -0,0 +1,128 @@
+// bench/symmetry.c - The tttSolver.c 3^9 table (indexed by the board as it
+// stands) against the tttCache.h position cache (one entry per position up
+// to symmetry) filled from it: memory, lookup cost during random games,
+// and that both give the same values and best moves for every reachable
+// position.
+//
+//   gcc -O2 bench/symmetry.c tttSolver.c tttCache.c -I. -o bench_symmetry && ./bench_symmetry
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ttt.h"
+#include "tttSolver.h"
+#include "tttCache.h"
+
+#define GAMES 1000000
+#define TABLE_SIZE 19683  // 3^9
+#define CACHE_SLOTS 1024
+
+static TttPositionCache cache;
+
+static uint16_t cacheBestMoves(const TttBoard *b) {
+    int sym;
+    const TttCacheEntry *entry = tttCacheLookup(&cache, b->x, b->o, &sym);
+
+    return entry != NULL ? tttSymMap(tttSymInverse[sym], entry->moves) : 0;
+}
+
+static int cacheValue(const TttBoard *b) {
+    int sym;
+    const TttCacheEntry *entry = tttCacheLookup(&cache, b->x, b->o, &sym);
+
+    return entry != NULL ? entry->value : 0;
+}
+
+// ---- Benchmark ----
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef uint16_t (*BestMovesFn)(const TttBoard *);
+
+// Random games where every move asks for the best moves first, like
+// perfect autoplay does
+static void run(const char *name, BestMovesFn bestMovesOf, long *checksum) {
+    long lookups = 0;
+    long sum = 0;
+    unsigned int rng = 1;
+    double start = now();
+
+    for (int g = 0; g < GAMES; g++) {
+        TttBoard b;
+        tttReset(&b);
+        while (b.status == TTT_PLAYING) {
+            uint16_t moves = bestMovesOf(&b);
+            uint16_t empty = tttEmpty(&b);
+            sum += moves;
+            lookups++;
+
+            rng = rng * 1103515245u + 12345u;
+            int skip = (int)((rng >> 16) % (unsigned int)__builtin_popcount(empty));
+            while (skip-- > 0) {
+                empty &= (uint16_t)(empty - 1);
+            }
+            tttPlay(&b, __builtin_ctz(empty));
+        }
+    }
+
+    double elapsed = now() - start;
+    printf("%-10s %ld lookups in %.3f s: %.2f ns/lookup\n", name, lookups, elapsed, elapsed * 1e9 / lookups);
+    *checksum = sum;
+}
+
+// Every reachable position: same value and same best moves from both
+static long compareAll(uint16_t x, uint16_t o, int xToMove) {
+    TttBoard b = {x, o, (uint8_t)!xToMove, TTT_PLAYING};
+    long mismatches = 0;
+
+    if (tttValue(&b) != cacheValue(&b) || tttBestMoves(&b) != cacheBestMoves(&b)) {
+        mismatches++;
+    }
+    if (tttIsWin(x) || tttIsWin(o)) {
+        return mismatches;
+    }
+    for (int cell = 0; cell < 9; cell++) {
+        if (!((x | o) & (1u << cell))) {
+            if (xToMove) {
+                mismatches += compareAll((uint16_t)(x | (1u << cell)), o, 0);
+            } else {
+                mismatches += compareAll(x, (uint16_t)(o | (1u << cell)), 1);
+            }
+        }
+    }
+    return mismatches;
+}
+
+int main() {
+    long tableSum, cacheSum;
+
+    tttSolverInit();
+    if (tttCacheInit(&cache, CACHE_SLOTS) < 0 || tttCacheAddSolved(&cache) < 0) {
+        printf("Cache too small\n");
+        return 1;
+    }
+    printf("3^9 table  %d positions, %zu bytes\n", tttReachablePositions(), TABLE_SIZE * (sizeof(int8_t) + sizeof(uint16_t)));
+    printf("cache      %u positions, %zu bytes\n", cache.count, (size_t)(cache.mask + 1) * sizeof(TttCacheEntry));
+
+    long mismatches = compareAll(0, 0, 1);
+    if (mismatches > 0) {
+        printf("%ld positions differ!\n", mismatches);
+        return 1;
+    }
+
+    run("3^9 table", tttBestMoves, &tableSum);
+    run("cache", cacheBestMoves, &cacheSum);
+
+    if (tableSum != cacheSum) {
+        printf("Results differ! (%ld vs %ld)\n", tableSum, cacheSum);
+        return 1;
+    }
+    tttCacheFree(&cache);
+    return 0;
+}
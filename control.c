@@ -17,7 +17,7 @@ char mosquittoSub[] = "C:\\Progra~2\\mosquitto\\mosquitto_sub.exe";
 #define MQTT_HOST "" // You wouldn't believe how many time I had to rebase the repo to not dox myself
 #define MQTT_TOPIC "TTT"
 
-// Board state
+// Board state as shown, owned by the main (UI) thread
 char board[3][3] = {
     {' ', ' ', ' '},
     {' ', ' ', ' '},
@@ -27,7 +27,14 @@ char currentPlayer = 'X';
 char positions[9][4];  // Array to store position strings like "1,2"
 int current_index = 0;
 BOOL autoplay_enabled = FALSE;
-const int autoplay_delay = 500;
+
+// Autoplay follows the host: the next move goes out as soon as TTT/board
+// shows the last one was played (or a new game started), not on a fixed
+// delay. -d sets a minimum gap between moves for watching a game.
+DWORD autoplay_pace = 0;       // ms between moves, 0 = as fast as the host goes
+BOOL autoplayWaiting = FALSE;  // a move is out and the board hasn't changed yet
+int autoplayFilled = 0;        // cells taken when it was sent
+#define AUTOPLAY_RETRY_MS 1000 // resend if the host ignored the move
 
 // Color codes for Windows console
 #define COLOR_RED 12
@@ -36,10 +43,68 @@ const int autoplay_delay = 500;
 #define COLOR_YELLOW 14
 #define COLOR_WHITE 15
 
-// Handles for the MQTT subscriber process and pipes
+// -i: client id mosquitto_sub keeps a persistent session under, so the
+// broker holds the subscription and QoS 1 messages across its restarts
+const char *sessionId = NULL;
+
+// Handles for the MQTT subscriber process and pipes. Only the listener
+// thread opens and closes them once it runs; subscriberLock keeps
+// stopBoardListener() from terminating a process while they change.
 HANDLE mqtt_sub_process = NULL;
 HANDLE mqtt_pipe_read = NULL;
-BOOL listener_running = FALSE;
+volatile BOOL listener_running = FALSE;
+CRITICAL_SECTION subscriberLock;
+HANDLE listenerThread = NULL;
+HANDLE stopEvent = NULL;  // set by stopBoardListener(), ends the backoff wait
+
+// Restarting mosquitto_sub when it exits
+#define SUBSCRIBER_BACKOFF_MIN_MS 10
+#define SUBSCRIBER_BACKOFF_MAX_MS 5000
+DWORD subscriberBackoff = SUBSCRIBER_BACKOFF_MIN_MS;  // next step, reset by output
+
+// Only the main thread touches the console and the board above. The
+// listener and input threads hand their data over without locks and set
+// wakeEvent, so a slow console never holds up reading from the broker.
+
+// Latest board from the listener, published with a seqlock: the sequence
+// number is odd while the listener is writing, and the UI retries its copy
+// if the number changed under it. Only the newest state matters, so the
+// listener never waits and intermediate boards may be skipped.
+typedef struct {
+    char board[3][3];
+    char currentPlayer;
+} BoardSnapshot;
+
+BoardSnapshot sharedSnapshot;
+unsigned int snapshotSeq = 0;
+unsigned int shownSnapshotSeq = 0;  // UI thread: last snapshot drawn
+
+// Listener thread's own copy, built up from TTT/board and TTT/player
+BoardSnapshot listenerSnapshot = {
+    {{' ', ' ', ' '}, {' ', ' ', ' '}, {' ', ' ', ' '}}, 'X'
+};
+
+// Single-producer single-consumer queue of text lines: status and move
+// messages from the listener, typed lines from the input thread. Only the
+// producer stores head and only the consumer stores tail, so neither side
+// ever blocks the other. A full ring drops the new line.
+#define RING_SIZE 64  // lines, power of two
+#define RING_LINE 64
+
+typedef struct {
+    int color;
+    char text[RING_LINE];
+} RingEntry;
+
+typedef struct {
+    RingEntry entries[RING_SIZE];
+    unsigned int head __attribute__((aligned(64)));  // next entry to write
+    unsigned int tail __attribute__((aligned(64)));  // next entry to read
+} Ring;
+
+Ring messageRing;  // listener -> UI
+Ring inputRing;    // input thread -> UI
+HANDLE wakeEvent = NULL;
 
 // Function prototypes
 void displayBoard();
@@ -48,8 +113,14 @@ void resetConsoleColor();
 void publishMessage(const char *message);
 void startBoardListener();
 void stopBoardListener();
+DWORD startSubscriber();
+void closeSubscriber();
+BOOL restartSubscriber();
 DWORD WINAPI mqttListenerThread(LPVOID arg);
+DWORD WINAPI inputThread(LPVOID arg);
 void updateBoard(const char *topic, const char *message);
+int showUpdates();
+int countFilled();
 void makeMove(int row, int col);
 void resetGame();
 void generateBoardPositions();
@@ -73,6 +144,58 @@ void clearScreen() {
     system("cls");
 }
 
+// Producer side: add a line, 0 if the ring is full
+int ringPush(Ring *r, int color, const char *text) {
+    unsigned int head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+
+    if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == RING_SIZE) {
+        return 0;
+    }
+
+    RingEntry *e = &r->entries[head & (RING_SIZE - 1)];
+    e->color = color;
+    snprintf(e->text, sizeof(e->text), "%s", text);
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+// Consumer side: take the oldest line, 0 if there is none
+int ringPop(Ring *r, RingEntry *out) {
+    unsigned int tail = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+
+    if (tail == __atomic_load_n(&r->head, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+
+    *out = r->entries[tail & (RING_SIZE - 1)];
+    __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+// Listener thread: make listenerSnapshot the current board
+void publishSnapshot() {
+    unsigned int seq = snapshotSeq;
+
+    __atomic_store_n(&snapshotSeq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    sharedSnapshot = listenerSnapshot;
+    __atomic_store_n(&snapshotSeq, seq + 2, __ATOMIC_RELEASE);
+}
+
+// UI thread: copy the current board, returns its sequence number
+unsigned int readSnapshot(BoardSnapshot *out) {
+    unsigned int before, after;
+
+    do {
+        before = __atomic_load_n(&snapshotSeq, __ATOMIC_ACQUIRE);
+        *out = sharedSnapshot;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&snapshotSeq, __ATOMIC_RELAXED);
+    } while ((before & 1) || before != after);
+
+    return after;
+}
+
 // Display the current state of the board
 void displayBoard() {
     clearScreen();
@@ -116,14 +239,15 @@ void displayBoard() {
     printf("Or 'r' to reset, 'q' to quit, 'a' to automate\n\n");
 }
 
-// Publish a message to the MQTT broker
+// Publish a message to the MQTT broker, at QoS 1 so the host's persistent
+// session keeps it while the host is reconnecting
 void publishMessage(const char *message) {
     char command[512];
     printf("Sending: %s\n", message);
 
     // Create the command string
     snprintf(command, sizeof(command),
-             "\"%s\" -h %s -t %s -m \"%s\"",
+             "\"%s\" -h %s -t %s -q 1 -m \"%s\"",
              mosquittoPath, MQTT_HOST, MQTT_TOPIC, message);
 
     // Execute the command using Windows API
@@ -156,9 +280,57 @@ void publishMessage(const char *message) {
     // Close process and thread handles
     CloseHandle(pi.hProcess);
     CloseHandle(pi.hThread);
+}
 
-    // Sleep briefly to allow time for the message to be processed
-    Sleep(100);
+// Listener thread: mosquitto_sub is gone, e.g. it couldn't reach the
+// broker. Start it again after a jittered backoff, 10 ms doubling up to
+// 5 s, so a broker restart isn't met by every client at once. The step
+// only goes back down once the new subscriber prints something, so one
+// that can't connect and exits straight away keeps backing off. Returns
+// FALSE once stopBoardListener() has been called.
+BOOL restartSubscriber() {
+    DWORD lostAt = GetTickCount();
+    unsigned int seed = GetTickCount() ^ GetCurrentProcessId();
+    char text[RING_LINE];
+
+    if (!listener_running) {
+        return FALSE;
+    }
+    closeSubscriber();
+    ringPush(&messageRing, COLOR_YELLOW, "Lost connection to MQTT broker, reconnecting");
+    SetEvent(wakeEvent);
+
+    for (;;) {
+        // Half the step plus up to the other half at random
+        seed = seed * 1103515245u + 12345u;
+        if (WaitForSingleObject(stopEvent, subscriberBackoff / 2 +
+                                (seed >> 16) % (subscriberBackoff / 2 + 1)) == WAIT_OBJECT_0) {
+            return FALSE;
+        }
+        subscriberBackoff = subscriberBackoff * 2 < SUBSCRIBER_BACKOFF_MAX_MS ?
+                            subscriberBackoff * 2 : SUBSCRIBER_BACKOFF_MAX_MS;
+
+        // Checked under the lock: once stopBoardListener() has been through
+        // it, no new subscriber may start, or nothing would terminate it
+        DWORD error = ERROR_CANCELLED;
+        EnterCriticalSection(&subscriberLock);
+        if (listener_running) {
+            error = startSubscriber();
+        }
+        LeaveCriticalSection(&subscriberLock);
+        if (!listener_running) {
+            return FALSE;
+        }
+        if (error == 0) {
+            break;
+        }
+    }
+
+    snprintf(text, sizeof(text), "Subscriber restarted after %lu ms",
+             (unsigned long)(GetTickCount() - lostAt));
+    ringPush(&messageRing, COLOR_YELLOW, text);
+    SetEvent(wakeEvent);
+    return TRUE;
 }
 
 // Thread function to read from the pipe and process MQTT messages
@@ -171,13 +343,19 @@ DWORD WINAPI mqttListenerThread(LPVOID arg) {
         // Read data from the pipe
         if (!ReadFile(mqtt_pipe_read, buffer, sizeof(buffer)-1, &bytesRead, NULL) || bytesRead == 0) {
             if (GetLastError() == ERROR_BROKEN_PIPE) {
-                break; // Pipe has been closed
+                // mosquitto_sub exited (or was stopped): start a new one
+                leftover[0] = '\0';
+                if (!restartSubscriber()) {
+                    break;
+                }
+                continue;
             }
             Sleep(100);
             continue;
         }
 
         buffer[bytesRead] = '\0';
+        subscriberBackoff = SUBSCRIBER_BACKOFF_MIN_MS;
 
         // Combine with any leftover data from previous reads
         char fullBuffer[2048];
@@ -216,15 +394,17 @@ DWORD WINAPI mqttListenerThread(LPVOID arg) {
         Sleep(100);  // Don't monopolize CPU
     }
 
+    closeSubscriber();
     return 0;
 }
 
-// Start the MQTT subscriber process
-void startBoardListener() {
-    if (listener_running) {
-        return;
-    }
-
+// Start mosquitto_sub on a new pipe. Returns 0, or the GetLastError() code
+// of the step that failed; prints nothing, the listener thread calls it too
+// (holding subscriberLock).
+// With -i, -c and that id ask the broker to keep the subscription and queue
+// QoS 1 messages while the subscriber is being restarted. Without it the
+// session is clean, so nothing is left behind on the broker when we exit.
+DWORD startSubscriber() {
     // Create pipe for reading subscriber output
     SECURITY_ATTRIBUTES sa;
     sa.nLength = sizeof(SECURITY_ATTRIBUTES);
@@ -233,18 +413,18 @@ void startBoardListener() {
 
     HANDLE childStdoutRead = NULL;
     HANDLE childStdoutWrite = NULL;
+    DWORD error;
 
     if (!CreatePipe(&childStdoutRead, &childStdoutWrite, &sa, 0)) {
-        printf("CreatePipe failed (%d)\n", GetLastError());
-        return;
+        return GetLastError();
     }
 
     // Ensure the read handle to the pipe isn't inherited
     if (!SetHandleInformation(childStdoutRead, HANDLE_FLAG_INHERIT, 0)) {
-        printf("SetHandleInformation failed (%d)\n", GetLastError());
+        error = GetLastError();
         CloseHandle(childStdoutRead);
         CloseHandle(childStdoutWrite);
-        return;
+        return error;
     }
 
     // Create the child process - mosquitto_sub
@@ -260,9 +440,11 @@ void startBoardListener() {
     ZeroMemory(&pi, sizeof(pi));
 
     char command[512];
-    snprintf(command, sizeof(command),
-             "\"%s\" -h %s -t \"%s/#\" -v",
-             mosquittoSub, MQTT_HOST, MQTT_TOPIC);
+    int len = snprintf(command, sizeof(command), "\"%s\" -h %s -t \"%s/#\" -v -q 1",
+                       mosquittoSub, MQTT_HOST, MQTT_TOPIC);
+    if (sessionId != NULL) {
+        snprintf(command + len, sizeof(command) - len, " -c -i %s", sessionId);
+    }
 
     // Start the child process
     if (!CreateProcess(NULL,   // No module name (use command line)
@@ -276,24 +458,55 @@ void startBoardListener() {
                       &si,      // Pointer to STARTUPINFO structure
                       &pi))     // Pointer to PROCESS_INFORMATION structure
     {
-        printf("CreateProcess failed (%d).\n", GetLastError());
+        error = GetLastError();
         CloseHandle(childStdoutRead);
         CloseHandle(childStdoutWrite);
-        return;
+        return error;
     }
 
     // Close unnecessary handles
     CloseHandle(childStdoutWrite);
+    CloseHandle(pi.hThread);
 
     // Store global handles for later cleanup
     mqtt_sub_process = pi.hProcess;
     mqtt_pipe_read = childStdoutRead;
+    return 0;
+}
+
+// Close the subscriber's handles, stopping the process if it still runs
+void closeSubscriber() {
+    EnterCriticalSection(&subscriberLock);
+    if (mqtt_sub_process != NULL) {
+        TerminateProcess(mqtt_sub_process, 0);
+        CloseHandle(mqtt_sub_process);
+        mqtt_sub_process = NULL;
+    }
+    if (mqtt_pipe_read != NULL) {
+        CloseHandle(mqtt_pipe_read);
+        mqtt_pipe_read = NULL;
+    }
+    LeaveCriticalSection(&subscriberLock);
+}
+
+// Start the MQTT subscriber process
+void startBoardListener() {
+    if (listener_running) {
+        return;
+    }
+
+    DWORD error = startSubscriber();
+    if (error != 0) {
+        printf("Starting mosquitto_sub failed (%lu).\n", (unsigned long)error);
+        return;
+    }
 
     // Start a thread that reads from the pipe
     listener_running = TRUE;
+    ResetEvent(stopEvent);
 
-    // Create a thread to read the pipe
-    HANDLE thread = CreateThread(
+    // Create a thread to read the pipe; from here on it owns the handles
+    listenerThread = CreateThread(
         NULL,                   // default security attributes
         0,                      // default stack size
         mqttListenerThread,     // thread function
@@ -302,15 +515,12 @@ void startBoardListener() {
         NULL                    // receive thread identifier
     );
 
-    if (thread == NULL) {
+    if (listenerThread == NULL) {
         printf("CreateThread failed (%d).\n", GetLastError());
         stopBoardListener();
         return;
     }
 
-    // We don't need the thread handle
-    CloseHandle(thread);
-
     printf("MQTT subscriber started\n");
     displayBoard();
 }
@@ -321,75 +531,130 @@ void stopBoardListener() {
         return;
     }
 
+    // Terminating mosquitto_sub breaks the listener's pipe, and stopEvent
+    // ends its backoff wait; it closes the handles itself on the way out
+    EnterCriticalSection(&subscriberLock);
     listener_running = FALSE;
-
-    // Terminate the mosquitto_sub process
     if (mqtt_sub_process != NULL) {
         TerminateProcess(mqtt_sub_process, 0);
-        CloseHandle(mqtt_sub_process);
-        mqtt_sub_process = NULL;
     }
+    LeaveCriticalSection(&subscriberLock);
+    SetEvent(stopEvent);
 
-    // Close the pipe
-    if (mqtt_pipe_read != NULL) {
-        CloseHandle(mqtt_pipe_read);
-        mqtt_pipe_read = NULL;
+    if (listenerThread != NULL) {
+        WaitForSingleObject(listenerThread, INFINITE);
+        CloseHandle(listenerThread);
+        listenerThread = NULL;
+    } else {
+        closeSubscriber();
     }
 
     printf("MQTT listener stopped\n");
 }
 
-// Update the board state based on MQTT messages
+// Update the board state based on MQTT messages. Runs on the listener
+// thread: it only parses, then hands the result to the UI thread.
 void updateBoard(const char *topic, const char *message) {
     char subTopic[256];
+    char text[RING_LINE];
 
     // Check for board state updates
     snprintf(subTopic, sizeof(subTopic), "%s/board", MQTT_TOPIC);
     if (strcmp(topic, subTopic) == 0) {
+        if (strlen(message) < 9) {
+            return;
+        }
         // Update board state (flat string to 2D array)
         for (int i = 0; i < 3; i++) {
             for (int j = 0; j < 3; j++) {
-                board[i][j] = message[i * 3 + j];
+                listenerSnapshot.board[i][j] = message[i * 3 + j];
             }
         }
-        displayBoard();
+        publishSnapshot();
+        SetEvent(wakeEvent);
         return;
     }
 
     // Check for current player updates
     snprintf(subTopic, sizeof(subTopic), "%s/player", MQTT_TOPIC);
     if (strcmp(topic, subTopic) == 0) {
-        currentPlayer = message[0];
-        return;
+        listenerSnapshot.currentPlayer = message[0];
+        publishSnapshot();
+        return;  // Shown with the next board
     }
 
     // Check for game status updates
     snprintf(subTopic, sizeof(subTopic), "%s/status", MQTT_TOPIC);
     if (strcmp(topic, subTopic) == 0) {
         if (strstr(message, "wins") != NULL) {
-            setConsoleColor(COLOR_GREEN);
-            printf("Player %s!\n", message);
-            resetConsoleColor();
+            snprintf(text, sizeof(text), "Player %s!", message);
+            ringPush(&messageRing, COLOR_GREEN, text);
         }
         else if (strcmp(message, "draw") == 0) {
-            setConsoleColor(COLOR_BLUE);
-            printf("Game ended in a draw!\n");
-            resetConsoleColor();
+            ringPush(&messageRing, COLOR_BLUE, "Game ended in a draw!");
         }
         else if (strcmp(message, "reset") == 0) {
-            setConsoleColor(COLOR_YELLOW);
-            printf("Game has been reset.\n");
-            resetConsoleColor();
+            ringPush(&messageRing, COLOR_YELLOW, "Game has been reset.");
         }
-        return;  // Let the board update handle the display
+        SetEvent(wakeEvent);
+        return;
     }
 
     // Check for move updates
     if (strstr(topic, "/moves") != NULL) {
-        setConsoleColor(COLOR_BLUE);
-        printf("Move made: %s\n", message);
+        snprintf(text, sizeof(text), "Move made: %s", message);
+        ringPush(&messageRing, COLOR_BLUE, text);
+        SetEvent(wakeEvent);
+    }
+}
+
+// UI thread: pick up what the listener handed over. Redraws if the board
+// changed, then prints the queued status and move messages under it.
+// Returns 1 if anything was printed.
+int showUpdates() {
+    BoardSnapshot snapshot;
+    RingEntry entry;
+    unsigned int seq = readSnapshot(&snapshot);
+    int printed = 0;
+
+    if (seq != shownSnapshotSeq) {
+        shownSnapshotSeq = seq;
+        memcpy(board, snapshot.board, sizeof(board));
+        currentPlayer = snapshot.currentPlayer;
+        displayBoard();
+        printed = 1;
+    }
+
+    while (ringPop(&messageRing, &entry)) {
+        // Over the prompt, if there is one
+        setConsoleColor(entry.color);
+        printf("\r%s\n", entry.text);
         resetConsoleColor();
+        printed = 1;
     }
+    return printed;
+}
+
+// Read typed lines on a thread of their own, so the UI thread can wait
+// for board updates and input at the same time
+DWORD WINAPI inputThread(LPVOID arg) {
+    char input[RING_LINE];
+
+    while (fgets(input, sizeof(input), stdin) != NULL) {
+        input[strcspn(input, "\n")] = 0;
+        // The UI is behind; the typist can wait
+        while (!ringPush(&inputRing, 0, input)) {
+            Sleep(10);
+        }
+        SetEvent(wakeEvent);
+    }
+
+    // End of input quits like 'q'
+    while (!ringPush(&inputRing, 0, "q")) {
+        Sleep(10);
+    }
+    SetEvent(wakeEvent);
+    return 0;
 }
 
 // Make a move on the board
@@ -403,7 +668,6 @@ void makeMove(int row, int col) {
 void resetGame() {
     publishMessage("r");
     printf("Game reset command sent\n");
-    Sleep(500);  // Give time for the board to update
 }
 
 // Generate all possible board positions in random order
@@ -428,9 +692,35 @@ void generateBoardPositions() {
     current_index = 0;
 }
 
-// Make a random move
+// Cells taken on the board as last shown
+int countFilled() {
+    int filled = 0;
+
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            if (board[i][j] == 'X' || board[i][j] == 'O') {
+                filled++;
+            }
+        }
+    }
+    return filled;
+}
+
+// Make a random move: the next shuffled position that is still free
 void randomMove() {
-    // If all moves used, reset for next round
+    // New game, or all moves used: reset for next round
+    if (countFilled() == 0 || current_index >= 9) {
+        generateBoardPositions();
+    }
+    while (current_index < 9) {
+        int row = positions[current_index][0] - '1';
+        int col = positions[current_index][2] - '1';
+
+        if (board[row][col] != 'X' && board[row][col] != 'O') {
+            break;
+        }
+        current_index++;
+    }
     if (current_index >= 9) {
         printf("All positions played. Restarting board...\n");
         generateBoardPositions();
@@ -438,7 +728,6 @@ void randomMove() {
     publishMessage(positions[current_index]);
     printf("Random move sent: %s\n", positions[current_index]);
     current_index++;
-    Sleep(1000);  // Wait a second between moves
 }
 
 // Toggle autoplay mode
@@ -448,59 +737,123 @@ void toggleAutoplay() {
         srand(time(NULL));  // Initialize random seed
         printf("Autoplay enabled\n");
         generateBoardPositions();
+        autoplayWaiting = FALSE;
     } else {
         printf("Autoplay disabled\n");
     }
 }
 
+// Handle one line typed by the user. Returns 0 to quit.
+int handleInput(const char *input) {
+    int row, col;
+
+    if (input[0] == 'q' || input[0] == 'Q') {
+        return 0;
+    }
+    else if (input[0] == 'r' || input[0] == 'R') {
+        resetGame();
+    }
+    else if (input[0] == 'a' || input[0] == 'A') {
+        toggleAutoplay();
+    }
+    else if (sscanf(input, "%d,%d", &row, &col) == 2) {
+        if (row >= 1 && row <= 3 && col >= 1 && col <= 3) {
+            makeMove(row, col);
+        }
+        else {
+            printf("Invalid move! Row and column must be between 1 and 3.\n");
+        }
+    }
+    else {
+        printf("Invalid input! Enter 'row,col', 'r' to reset, 'a' to toggle autoplay, or 'q' to quit.\n");
+    }
+    return 1;
+}
+
 // Main function
 int main(int argc, char *argv[]) {
-    char input[20];
-    int row, col;
+    RingEntry line;
+    DWORD lastMove = 0;
+    int running = 1;
+
+    // -d ms between autoplay moves, -i client id for a persistent session
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            autoplay_pace = (DWORD)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            sessionId = argv[++i];
+        }
+        else {
+            printf("Usage: %s [-d autoplayPaceMs] [-i clientId]\n", argv[0]);
+            return 1;
+        }
+    }
 
     // Set console title
     SetConsoleTitle("Tic-Tac-Toe MQTT Client");
 
+    // Set by the listener and input threads whenever they hand something over
+    wakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    stopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (wakeEvent == NULL || stopEvent == NULL) {
+        printf("CreateEvent failed (%d).\n", GetLastError());
+        return 1;
+    }
+
     // Start the MQTT listener
+    InitializeCriticalSection(&subscriberLock);
     startBoardListener();
 
-    // Main game loop
-    while (1) {
-        displayBoard();
+    HANDLE reader = CreateThread(NULL, 0, inputThread, NULL, 0, NULL);
+    if (reader == NULL) {
+        printf("CreateThread failed (%d).\n", GetLastError());
+        stopBoardListener();
+        return 1;
+    }
+    CloseHandle(reader);
+
+    // Main game loop: the only thread that draws
+    displayBoard();
+    printf("> ");
+    while (running) {
+        DWORD timeout = INFINITE;
 
-        // Autoplay mode - make moves automatically
+        // Waiting for the host to show our move, or for the pacing gap
         if (autoplay_enabled) {
-            randomMove();
-            Sleep(autoplay_delay);  // Delay between moves
-            continue;  // Skip manual input when in autoplay mode
+            DWORD wait = autoplayWaiting ? AUTOPLAY_RETRY_MS : autoplay_pace;
+            DWORD elapsed = GetTickCount() - lastMove;
+            timeout = elapsed >= wait ? 0 : wait - elapsed;
         }
+        WaitForSingleObject(wakeEvent, timeout);
 
-        // Manual input mode
-        printf("> ");
-        fgets(input, sizeof(input), stdin);
-        input[strcspn(input, "\n")] = 0;
-
-        if (input[0] == 'q' || input[0] == 'Q') {
-            break;
-        }
-        else if (input[0] == 'r' || input[0] == 'R') {
-            resetGame();
+        int printed = showUpdates();
+        if (autoplayWaiting && countFilled() != autoplayFilled) {
+            autoplayWaiting = FALSE;
         }
-        else if (input[0] == 'a' || input[0] == 'A') {
-            toggleAutoplay();
-        }
-        else if (sscanf(input, "%d,%d", &row, &col) == 2) {
-            if (row >= 1 && row <= 3 && col >= 1 && col <= 3) {
-                makeMove(row, col);
-            }
-            else {
-                printf("Invalid move! Row and column must be between 1 and 3.\n");
-                Sleep(1000);
+
+        while (running && ringPop(&inputRing, &line)) {
+            running = handleInput(line.text);
+            if (running) {
+                displayBoard();
+                printed = 1;
             }
         }
-        else {
-            printf("Invalid input! Enter 'row,col', 'r' to reset, 'a' to toggle autoplay, or 'q' to quit.\n");
-            Sleep(1000);
+
+        // Autoplay mode - the next move once the last one is on the board,
+        // or again if the host never showed it
+        DWORD elapsed = GetTickCount() - lastMove;
+        if (running && autoplay_enabled &&
+            elapsed >= (autoplayWaiting ? AUTOPLAY_RETRY_MS : autoplay_pace)) {
+            randomMove();
+            autoplayWaiting = TRUE;
+            autoplayFilled = countFilled();
+            lastMove = GetTickCount();
+            printed |= showUpdates();
+        }
+
+        if (running && printed && !autoplay_enabled) {
+            printf("> ");
         }
     }
 
@@ -509,4 +862,4 @@ int main(int argc, char *argv[]) {
     printf("Thanks for playing!\n");
 
     return 0;
-}
\ No newline at end of file
+}
@@ -23,7 +23,7 @@ NC='\033[0m' # No Color
 publish_message() {
     message="$1"
     echo "Sending: $message"
-    powershell.exe -Command "& '$MOSQUITTO_PUB' -h $MQTT_HOST -t '$MQTT_TOPIC' -m '$message'"
+    powershell.exe -Command "& '$MOSQUITTO_PUB' -h $MQTT_HOST -t '$MQTT_TOPIC' -q 1 -m '$message'"
 }
 
 # Function to display the board
@@ -1,469 +1,1751 @@
 // controlLinux.c - Linux Version
-// Converted from Windows version for Linux with Mosquitto client
+// Converted from Windows version for Linux, talks MQTT natively (see mqtt.c)
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <string.h>
 #include <ctype.h>
 #include <unistd.h>
 #include <signal.h>
 #include <time.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <sys/types.h>
-#include <sys/wait.h>
-#include <pthread.h>
-
-// Just use the commands directly from PATH
-char mosquittoPath[] = "mosquitto_pub";
-char mosquittoSub[] = "mosquitto_sub";
+#include <sys/stat.h>
+
+#include "mqtt.h"
+#include "reactor.h"
+#include "ttt.h"
+#include "tttSolver.h"
+#include "histogram.h"
+#include "tttWire.h"
+#include "tttGrid.h"
+#include "screen.h"
+#include "tttTopics.h"
+#include "metrics.h"
 
 // MQTT Configuration
-#define MQTT_HOST "" // Add your MQTT broker address here
+#define MQTT_HOST "" // Add your MQTT broker address here (empty means localhost)
+#define MQTT_PORT 1883
 #define MQTT_TOPIC "TTT"
 
-// Board state
-char board[3][3] = {
-    {' ', ' ', ' '},
-    {' ', ' ', ' '},
-    {' ', ' ', ' '}
-};
-char currentPlayer = 'X';
-char positions[9][4];  // Array to store position strings like "1,2"
-int current_index = 0;
+const char *mqttHost = MQTT_HOST;
+int mqttPort = MQTT_PORT;
+const char *sessionId = NULL;  // -i: stable client id with a persistent session
+
+// Topic the game's messages arrive under: TTT, or TTT/<gameId> when
+// playing on tttServer. Moves go to commandTopic, TTT or the game's
+// partition topic TTT/p<n>/<gameId> (see tttTopics.h).
+char gameTopic[64] = MQTT_TOPIC;
+char commandTopic[80] = MQTT_TOPIC;
+
+// Subtopics of gameTopic we react to, set up once gameTopic is known
+TttTopicTable topics;
+
+// Board state, as last published by the game host. 3x3 until the host
+// says otherwise with a grid state or TTT/variant.
+TttGrid board;
+int xWins = -1;  // score from TTT/state, -1 until known
+int oWins = -1;
 int autoplay_enabled = 0;
-const int autoplay_delay = 500;
-
-// Color codes for Linux terminal
-#define COLOR_RED "\033[0;31m"
-#define COLOR_GREEN "\033[0;32m"
-#define COLOR_BLUE "\033[0;34m"
-#define COLOR_YELLOW "\033[0;33m"
-#define COLOR_WHITE "\033[0;37m"
-#define COLOR_RESET "\033[0m"
-
-// Handles for the MQTT subscriber process and pipes
-pid_t mqtt_sub_pid = -1;
-int mqtt_pipe_fd[2] = {-1, -1};
+int autoplay_mode = 0;
+
+// Autoplay is driven by the host: the next move goes out as soon as the
+// board shows the last one was played (or the game was reset). -d sets a
+// minimum gap between moves, -s limits autoplay to one side.
+unsigned int autoplay_pace = 0;    // ms between our moves, 0 = as fast as the host goes
+int autoplay_side = -1;            // 0 = X, 1 = O, -1 = both
+int autoplayWaiting = 0;           // a move is out and the host hasn't shown it yet
+int autoplayFilled = 0;            // cells taken when it was sent
+uint64_t lastAutoMoveNs = 0;
+#define AUTOPLAY_RETRY_MS 1000     // no change by then: rejected or lost, try again
+
+// Commands for the headless batch mode (-b), NULL when interactive
+FILE *batchSource = NULL;
+
+// Moves shown before the host confirms them. A move is checked with the
+// game rules against the host's board plus the moves still pending, and
+// drawn in the next frame as pending (yellow). Each board update from the
+// host settles them in order: a cell now holding the move's mark is
+// confirmed, one taken by the other side or no longer playable is rolled
+// back. A move the host never shows within PREDICT_TIMEOUT_MS (it was
+// illegal there, or lost) is rolled back too.
+#define MAX_PREDICTED 8
+#define PREDICT_TIMEOUT_MS 2000
+
+typedef struct {
+    int row;            // 0-indexed
+    int col;
+    int player;         // side it was played for: 0 = X, 1 = O
+    uint64_t sentNs;
+} PredictedMove;
+
+PredictedMove predicted[MAX_PREDICTED];
+int predictedCount = 0;
+TttGrid view;            // board plus the predicted moves, what gets drawn
+int predictTimer = -1;
+uint64_t predictShownNs = 0;  // a predicted move waits for its first frame, -l only
+
+// Screen layout: the board, the prompt, then the last few messages below
+// it where the cursor lands when the user presses Enter. Boards other than
+// 3x3 are drawn compactly to the right of the help text.
+#define GRID_COL 44
+#define PROMPT_ROW 19
+#define MESSAGE_ROW 20
+#define MESSAGE_LINES (SCREEN_ROWS - MESSAGE_ROW)
+
+// Redraws are capped at one frame per FRAME_INTERVAL_MS; every update in
+// between is folded into the next frame
+#define FRAME_INTERVAL_MS 33
+
+// Autoplay strategies
+#define AUTOPLAY_RANDOM 0   // any empty cell
+#define AUTOPLAY_PERFECT 1  // optimal move from the solved game table
+
+// Persistent MQTT connection, used for both publishing and subscribing
+MqttClient mqtt;
 int listener_running = 0;
 
+// Event loop multiplexing the MQTT socket, stdin and timers
+Reactor reactor;
+int keepaliveTimer = -1;
+int reconnectTimer = -1;   // armed with mqttBackoff() while the broker is gone
+int autoplayTimer = -1;
+
+// Terminal renderer and the message log shown under the prompt
+Screen screen;
+int frameTimer = -1;
+int framePending = 0;  // frameTimer is armed for the next frame
+uint64_t lastFrameNs = 0;
+
+// Time to first correct frame: from connecting until the host's board is
+// on screen, via the retained TTT/state or the answer to our "s" request.
+// After a lost connection it counts from the moment it was lost.
+uint64_t connectStartNs = 0;
+int reconnecting = 0;
+int haveSnapshot = 0;
+char messages[MESSAGE_LINES][SCREEN_COLS + 1];
+int messageColors[MESSAGE_LINES];
+int messageCount = 0;
+
+// Complete lines out of a non-blocking fd (stdin, or the batch source).
+// A line longer than the buffer comes out once, cut short and flagged,
+// and the rest of it up to the newline is dropped.
+typedef struct {
+    char buf[64];
+    size_t len;
+    size_t used;       // length of the line handed out last, dropped next time
+    int skipping;      // inside the rest of an overlong line
+    int eof;
+} LineReader;
+
+LineReader input;  // typed on stdin
+
+// Per-move latency instrumentation, enabled with -l. When off the only
+// cost is the latency_enabled check.
+#define MAX_PENDING_MOVES 16
+#define PENDING_MOVE_EXPIRY_NS 10000000000ull  // give up on an echo after 10s
+
+typedef struct {
+    int cell;           // row * width + col
+    uint64_t sentNs;
+    int movesSeen;  // TTT/moves echo already matched
+} PendingMove;
+
+int latency_enabled = 0;
+Histogram publishLatency;  // time spent handing the move to the socket
+Histogram movesLatency;    // move sent -> TTT/moves echo
+Histogram boardLatency;    // move sent -> TTT/board showing it
+Histogram renderLatency;   // drawing the board
+Histogram shownLatency;    // move typed -> first frame showing it as pending
+PendingMove pendingMoves[MAX_PENDING_MOVES];
+int pendingCount = 0;
+
+// Exported with -m/-M, see registerMetrics(). Turning them on also turns
+// on the pending move tracking above, for the move latency.
+#define SENT_MOVE 0
+#define SENT_RESET 1
+#define SENT_SNAPSHOT 2
+
+#define PREDICT_CONFIRMED 0
+#define PREDICT_ROLLED_BACK 1
+#define PREDICT_REFUSED 2       // illegal on the local board, never sent
+
+int metrics_enabled = 0;
+MetricCounter messagesIn[TTT_SUB_COUNT + 1];  // per subtopic, the last one for anything else
+MetricCounter messagesOut[3];                 // SENT_MOVE, SENT_RESET, SENT_SNAPSHOT
+MetricCounter parseFailures;
+MetricCounter movesRejected;
+MetricCounter connects;
+MetricCounter connectionsLost;
+MetricCounter frames;
+MetricCounter predictions[3];  // PREDICT_CONFIRMED, PREDICT_ROLLED_BACK, PREDICT_REFUSED
+MetricHistogram renderTime;
+MetricHistogram moveLatency;  // move sent -> board showing it (batch: state acknowledging it)
+MetricHistogram recoveryTime; // connection lost -> host's board on screen again
+
 // Function prototypes
 void displayBoard();
-void setConsoleColor(const char *color);
-void resetConsoleColor();
+void drawFrame();
+void showMessage(int color, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+uint64_t nowNs();
 void publishMessage(const char *message);
 void startBoardListener();
 void stopBoardListener();
-void *mqttListenerThread(void *arg);
-void updateBoard(const char *topic, const char *message);
+void connectionLost();
+void onMqttReadable(int fd, unsigned int events, void *ctx);
+void updateBoard(int subtopic, const char *message, size_t len);
+void updateState(const unsigned char *payload, size_t len);
+void onMqttMessage(const char *topic, size_t topicLen, const char *payload, size_t payloadLen, void *ctx);
 void makeMove(int row, int col);
+void rebuildView();
 void resetGame();
-void generateBoardPositions();
-void randomMove();
-void toggleAutoplay();
+int randomEmptyCell();
+int autoMove();
+void autoplayTurn();
+void toggleAutoplay(int mode);
+void handleInput(char *input);
+void printLatencyReport();
+void showLatencyReport();
 void cleanup();
+int decodeState(const unsigned char *payload, size_t len, TttGridState *out);
+void batchState(const unsigned char *payload, size_t len);
+void startBatch();
 
-// Set console text color
-void setConsoleColor(const char *color) {
-    printf("%s", color);
-}
+// The 3x3 board, as it has always looked
+void drawClassicBoard() {
+    screenPrint(&screen, 7, 0, SCREEN_DEFAULT, "    1   2   3");
+    screenPrint(&screen, 8, 0, SCREEN_DEFAULT, "  +-----------+");
+
+    for (int i = 0; i < 3; i++) {
+        int row = 9 + i * 2;
+
+        screenPrint(&screen, row, 0, SCREEN_DEFAULT, "%d |   |   |   |", i + 1);
+        for (int j = 0; j < 3; j++) {
+            char mark = tttGridCellChar(&view, i, j);
+            int pending = tttGridCellChar(&board, i, j) != mark;
+            screenPrint(&screen, row, 4 + j * 4, pending ? SCREEN_YELLOW : SCREEN_RED, "%c", mark);
+        }
 
-// Reset console text color to default
-void resetConsoleColor() {
-    printf("%s", COLOR_RESET);
+        if (i < 2) {
+            screenPrint(&screen, row + 1, 0, SCREEN_DEFAULT, "  |-----------|");
+        }
+    }
+
+    screenPrint(&screen, 14, 0, SCREEN_DEFAULT, "  +-----------+");
 }
 
-// Clear the console screen
-void clearScreen() {
-    printf("\033[H\033[J");  // ANSI escape code to clear screen
+// Larger boards: one screen row per board row, three columns per cell
+void drawGridBoard() {
+    for (int c = 0; c < board.width; c++) {
+        screenPrint(&screen, 0, GRID_COL + 3 + c * 3, SCREEN_DEFAULT, "%2d", c + 1);
+    }
+
+    for (int r = 0; r < board.height; r++) {
+        screenPrint(&screen, r + 1, GRID_COL, SCREEN_DEFAULT, "%2d", r + 1);
+        for (int c = 0; c < board.width; c++) {
+            char mark = tttGridCellChar(&view, r, c);
+            int color = mark == ' ' ? SCREEN_DEFAULT : tttGridCellChar(&board, r, c) != mark ? SCREEN_YELLOW : SCREEN_RED;
+            screenPrint(&screen, r + 1, GRID_COL + 4 + c * 3, color, "%c", mark == ' ' ? '.' : mark);
+        }
+    }
 }
 
-// Display the current state of the board
-void displayBoard() {
-    clearScreen();
+// Compose the whole frame off-screen and send the cells that changed
+void drawFrame() {
+    uint64_t start = latency_enabled || metrics_enabled ? nowNs() : 0;
+    int col;
 
-    setConsoleColor(COLOR_YELLOW);
-    printf("===========================\n");
-    printf("Tic-Tac-Toe Game Board\n");
-    printf("===========================\n\n");
-    resetConsoleColor();
+    if (framePending) {
+        reactorSetTimer(frameTimer, 0, 0);
+        framePending = 0;
+    }
 
-    printf("Current Player: ");
-    setConsoleColor(COLOR_GREEN);
-    printf("%c\n\n", currentPlayer);
-    resetConsoleColor();
+    screenClear(&screen);
+    rebuildView();
 
-    printf("    1   2   3\n");
-    printf("  +-----------+\n");
+    screenPrint(&screen, 0, 0, SCREEN_YELLOW, "===========================");
+    if (tttGridIsClassic(&board)) {
+        screenPrint(&screen, 1, 0, SCREEN_YELLOW, "Tic-Tac-Toe Game Board");
+    } else {
+        screenPrint(&screen, 1, 0, SCREEN_YELLOW, "%dx%d, %d in a row", board.width, board.height, board.k);
+    }
+    screenPrint(&screen, 2, 0, SCREEN_YELLOW, "===========================");
 
-    for (int i = 0; i < 3; i++) {
-        printf("%d | ", i + 1);
+    col = screenPrint(&screen, 4, 0, SCREEN_DEFAULT, "Current Player: ");
+    screenPrint(&screen, 4, col, SCREEN_GREEN, "%c", tttGridPlayerChar(&view));
 
-        for (int j = 0; j < 3; j++) {
-            setConsoleColor(COLOR_RED);
-            printf("%c", board[i][j]);
-            resetConsoleColor();
+    if (xWins >= 0) {
+        screenPrint(&screen, 5, 0, SCREEN_DEFAULT, "Score: X %d - O %d", xWins, oWins);
+    }
 
-            if (j < 2) {
-                printf(" | ");
-            }
-        }
+    if (tttGridIsClassic(&board)) {
+        drawClassicBoard();
+    } else {
+        drawGridBoard();
+    }
 
-        printf(" |\n");
+    screenPrint(&screen, 16, 0, SCREEN_DEFAULT, "Enter move as 'row,col' (e.g. '1,3')");
+    screenPrint(&screen, 17, 0, SCREEN_DEFAULT,
+                "Or 'r' to reset, 'q' to quit, 'a' to automate, 'p' for perfect autoplay");
 
-        if (i < 2) {
-            printf("  |-----------|\n");
+    if (autoplay_enabled) {
+        screenSetCursor(&screen, PROMPT_ROW, 0);
+    } else {
+        col = screenPrint(&screen, PROMPT_ROW, 0, SCREEN_DEFAULT, "> ");
+        screenSetCursor(&screen, PROMPT_ROW, col);
+    }
+
+    for (int i = 0; i < messageCount; i++) {
+        screenPrint(&screen, MESSAGE_ROW + i, 0, messageColors[i], "%s", messages[i]);
+    }
+
+    // Anything printed before the first frame must come out first
+    fflush(stdout);
+    screenPresent(&screen);
+
+    lastFrameNs = nowNs();
+    if (latency_enabled) {
+        histRecord(&renderLatency, lastFrameNs - start);
+        if (predictShownNs != 0) {
+            histRecord(&shownLatency, lastFrameNs - predictShownNs);
+            predictShownNs = 0;
         }
     }
+    metricInc(&frames);
+    metricObserveNs(&renderTime, lastFrameNs - start);
+}
 
-    printf("  +-----------+\n\n");
-    printf("Enter move as 'row,col' (e.g. '1,3')\n");
-    printf("Or 'r' to reset, 'q' to quit, 'a' to automate\n\n");
+// The frame timer fired: draw everything that changed since the last frame
+void onFrameTimer(int fd, unsigned int events, void *ctx) {
+    framePending = 0;
+    drawFrame();
 }
 
-// Publish a message to the MQTT broker
-void publishMessage(const char *message) {
-    char command[512];
-    printf("Sending: %s\n", message);
+// Ask for the board to be redrawn. Draws right away if the last frame is
+// older than FRAME_INTERVAL_MS, otherwise a burst of updates collapses
+// into one frame at the end of the interval.
+void displayBoard() {
+    if (framePending) {
+        return;
+    }
 
-    // Create the command string
-    snprintf(command, sizeof(command),
-             "%s -h %s -t %s -m \"%s\" > /dev/null 2>&1",
-             mosquittoPath, MQTT_HOST, MQTT_TOPIC, message);
+    uint64_t sinceLast = nowNs() - lastFrameNs;
+    if (frameTimer < 0 || sinceLast >= FRAME_INTERVAL_MS * 1000000ull) {
+        drawFrame();
+        return;
+    }
+
+    reactorSetTimer(frameTimer, (unsigned int)(FRAME_INTERVAL_MS - sinceLast / 1000000), 0);
+    framePending = 1;
+}
+
+// Add a line to the message log under the prompt and redraw
+void showMessage(int color, const char *fmt, ...) {
+    va_list args;
+
+    // No screen in batch mode, stdout is for results
+    if (batchSource != NULL) {
+        va_start(args, fmt);
+        vfprintf(stderr, fmt, args);
+        va_end(args);
+        fputc('\n', stderr);
+        return;
+    }
+
+    if (messageCount == MESSAGE_LINES) {
+        memmove(messages[0], messages[1], sizeof(messages[0]) * (MESSAGE_LINES - 1));
+        memmove(&messageColors[0], &messageColors[1], sizeof(messageColors[0]) * (MESSAGE_LINES - 1));
+        messageCount--;
+    }
 
-    // Execute the command using system
-    system(command);
+    va_start(args, fmt);
+    vsnprintf(messages[messageCount], sizeof(messages[0]), fmt, args);
+    va_end(args);
+    messageColors[messageCount] = color;
+    messageCount++;
 
-    // Sleep briefly to allow time for the message to be processed
-    usleep(100000);  // 100ms in microseconds
+    displayBoard();
 }
 
-// Thread function to read from the pipe and process MQTT messages
-void *mqttListenerThread(void *arg) {
-    char buffer[1024];
-    ssize_t bytesRead;
-    static char leftover[1024] = "";
-    FILE *fp = fdopen(mqtt_pipe_fd[0], "r");
+// Show the final frame and park the cursor under it, so whatever is
+// printed on the way out doesn't land inside the board
+void closeScreen() {
+    if (!screen.valid) {
+        return;
+    }
+    drawFrame();
 
-    if (fp == NULL) {
-        perror("fdopen failed");
-        return NULL;
+    printf("\033[%d;1H\n", SCREEN_ROWS);
+    fflush(stdout);
+    screenInvalidate(&screen);
+}
+
+// Watch for writability only while the MQTT client has bytes queued
+void updateMqttEvents() {
+    unsigned int events = EPOLLIN;
+    if (mqttPending(&mqtt) > 0) {
+        events |= EPOLLOUT;
     }
+    reactorModify(&reactor, mqtt.fd, events);
+}
 
-    while (listener_running) {
-        // Read a line from the pipe
-        if (fgets(buffer, sizeof(buffer), fp) == NULL) {
-            if (feof(fp)) {
-                break; // End of file
-            }
-            usleep(100000);  // 100ms
-            continue;
+// Count a command sent to the host: a move, "r" or "s"
+void countSent(const char *message) {
+    metricInc(&messagesOut[message[0] == 'r' ? SENT_RESET : message[0] == 's' ? SENT_SNAPSHOT : SENT_MOVE]);
+}
+
+// Publish a message to the MQTT broker, at QoS 1 so a host with a
+// persistent session gets it even if it is reconnecting
+void publishMessage(const char *message) {
+    showMessage(SCREEN_DEFAULT, "Sending: %s", message);
+    countSent(message);
+
+    if (mqttPublish(&mqtt, commandTopic, message, strlen(message), 1, 0) < 0) {
+        showMessage(SCREEN_DEFAULT, "Failed to send message, is the broker reachable?");
+        return;
+    }
+
+    if (mqttPending(&mqtt) > 0) {
+        updateMqttEvents();
+    }
+}
+
+// Called by the MQTT client for every message on the subscribed topics
+// Topic and payload point into the receive buffer and are parsed in place.
+void onMqttMessage(const char *topic, size_t topicLen, const char *payload, size_t payloadLen, void *ctx) {
+    int subtopic = tttTopicLookup(&topics, topic, topicLen);
+
+    metricInc(&messagesIn[subtopic == TTT_SUB_NONE ? TTT_SUB_COUNT : subtopic]);
+
+    // Batch mode only follows the binary state
+    if (batchSource != NULL) {
+        if (subtopic == TTT_SUB_STATE) {
+            batchState((const unsigned char *)payload, payloadLen);
         }
+        return;
+    }
 
-        // Remove trailing newline
-        buffer[strcspn(buffer, "\n")] = '\0';
+    // The binary state can contain NUL bytes, so it needs the length
+    if (subtopic == TTT_SUB_STATE) {
+        updateState((const unsigned char *)payload, payloadLen);
+    } else if (subtopic != TTT_SUB_NONE) {
+        updateBoard(subtopic, payload, payloadLen);
+    }
+}
 
-        // Skip empty lines
-        if (strlen(buffer) == 0) {
-            continue;
+// The MQTT socket is readable or writable: dispatch messages right away
+void onMqttReadable(int fd, unsigned int events, void *ctx) {
+    if (events & EPOLLOUT) {
+        if (mqttFlush(&mqtt) < 0) {
+            events |= EPOLLERR;
         }
+        updateMqttEvents();
+    }
 
-        // Parse the line: format is "topic message"
-        char *space = strchr(buffer, ' ');
-        if (space) {
-            *space = '\0';  // Split topic and message
-            char *topic = buffer;
-            char *message = space + 1;
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        int n;
+        while ((n = mqttRead(&mqtt)) > 0) {
+        }
 
-            // Process the message
-            updateBoard(topic, message);
+        if (n < 0) {
+            connectionLost();
         }
+    }
+}
+
+// Keep the broker connection alive while nothing is being sent
+void onKeepaliveTimer(int fd, unsigned int events, void *ctx) {
+    if (mqtt.connected) {
+        mqttPing(&mqtt);
+    }
+}
+
+// Subscribe to the game (unless the broker kept our session) and ask the
+// host for its board: the retained TTT/state normally arrives right after
+// the subscribe, the "s" is for when the broker has none. With a persistent
+// session the subscription is QoS 1, so the broker keeps what is published
+// at QoS 1 while we're away.
+void subscribeGame() {
+    char topic_arg[100];
+
+    if (!mqtt.sessionPresent) {
+        snprintf(topic_arg, sizeof(topic_arg), "%s/#", gameTopic);
+        mqttSubscribe(&mqtt, topic_arg, mqtt.persistent ? 1 : 0);
+    }
+    countSent("s");
+    mqttPublishString(&mqtt, commandTopic, "s");
+}
+
+// The broker went away: keep playing offline (moves wait in the MQTT
+// client's offline queue) and reconnect after a backoff
+void connectionLost() {
+    metricInc(&connectionsLost);
+    reactorRemove(&reactor, mqtt.fd);
+    if (!reconnecting) {
+        reconnecting = 1;
+        haveSnapshot = 0;
+        connectStartNs = nowNs();
+        showMessage(SCREEN_DEFAULT, "Lost connection to MQTT broker, reconnecting");
+    }
+    reactorSetTimer(reconnectTimer, mqttBackoff(&mqtt), 0);
+}
 
-        usleep(100000);  // 100ms, don't monopolize CPU
+void onReconnectTimer(int fd, unsigned int events, void *ctx) {
+    if (mqttConnect(&mqtt, mqttHost, mqttPort) < 0) {
+        reactorSetTimer(reconnectTimer, mqttBackoff(&mqtt), 0);
+        return;
     }
 
-    fclose(fp);
-    return NULL;
+    mqttSetNonBlocking(&mqtt);
+    reactorAdd(&reactor, mqtt.fd, EPOLLIN, onMqttReadable, NULL);
+    metricInc(&connects);
+    showMessage(SCREEN_DEFAULT, "Reconnected after %.1f ms%s", (double)(nowNs() - connectStartNs) / 1e6,
+                mqtt.sessionPresent ? ", session kept" : "");
+    subscribeGame();
+    updateMqttEvents();
 }
 
-// Start the MQTT subscriber process
+// Connect to the broker and start listening for board updates
 void startBoardListener() {
     if (listener_running) {
         return;
     }
 
-    // Create pipe for reading subscriber output
-    if (pipe(mqtt_pipe_fd) == -1) {
-        perror("pipe failed");
+    // Only a stable id gets a persistent session: one per pid would be
+    // left behind on the broker by every run
+    char clientId[32];
+    snprintf(clientId, sizeof(clientId), "TTT_ctl_%d", (int)getpid());
+    mqttInit(&mqtt, sessionId != NULL ? sessionId : clientId, onMqttMessage, NULL);
+    mqttSetPersistent(&mqtt, sessionId != NULL);
+    connectStartNs = nowNs();
+
+    if (mqttConnect(&mqtt, mqttHost, mqttPort) < 0) {
+        printf("Could not connect to MQTT broker\n");
         return;
     }
 
-    // Fork to create child process
-    mqtt_sub_pid = fork();
-
-    if (mqtt_sub_pid < 0) {
-        perror("fork failed");
-        close(mqtt_pipe_fd[0]);
-        close(mqtt_pipe_fd[1]);
+    // Hand the socket to the event loop
+    mqttSetNonBlocking(&mqtt);
+    if (reactorAdd(&reactor, mqtt.fd, EPOLLIN, onMqttReadable, NULL) < 0) {
+        perror("reactorAdd failed");
+        mqttDisconnect(&mqtt);
         return;
     }
+    keepaliveTimer = reactorAddTimer(&reactor, MQTT_KEEPALIVE * 1000 / 2, onKeepaliveTimer, NULL);
+    reconnectTimer = reactorAddTimer(&reactor, 0, onReconnectTimer, NULL);
 
-    if (mqtt_sub_pid == 0) {
-        // Child process - will run mosquitto_sub
+    listener_running = 1;
+    metricInc(&connects);
 
-        // Close read end of pipe
-        close(mqtt_pipe_fd[0]);
+    showMessage(SCREEN_DEFAULT, "MQTT subscriber started");
 
-        // Redirect stdout to pipe
-        dup2(mqtt_pipe_fd[1], STDOUT_FILENO);
-        close(mqtt_pipe_fd[1]);
+    subscribeGame();
+    updateMqttEvents();
+}
 
-        // Execute mosquitto_sub
-        char topic_arg[100];
-        snprintf(topic_arg, sizeof(topic_arg), "%s/#", MQTT_TOPIC);
+// Disconnect from the broker and stop watching the socket
+void stopBoardListener() {
+    if (!listener_running) {
+        return;
+    }
+
+    listener_running = 0;
+    reactorRemoveTimer(&reactor, keepaliveTimer);
+    keepaliveTimer = -1;
+    reactorRemoveTimer(&reactor, reconnectTimer);
+    reconnectTimer = -1;
+    reactorRemove(&reactor, mqtt.fd);
+    mqttDisconnect(&mqtt);
+
+    showMessage(SCREEN_DEFAULT, "MQTT listener stopped");
+}
 
-        // Since we're using commands from PATH, we need to use the first argument as the program name
-        execlp("mosquitto_sub", "mosquitto_sub", "-h", MQTT_HOST, "-t", topic_arg, "-v", NULL);
+// Monotonic clock in nanoseconds
+uint64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
 
-        // If execl returns, there was an error
-        perror("execl failed");
-        exit(EXIT_FAILURE);
+// Forget a pending move
+void dropPendingMove(int i) {
+    pendingMoves[i] = pendingMoves[--pendingCount];
+}
+
+// The host announced a move on cell (row * width + col): match it to the
+// oldest move we sent for that cell
+void matchMovesEcho(int cell, uint64_t now) {
+    for (int i = 0; i < pendingCount; i++) {
+        if (pendingMoves[i].cell == cell && !pendingMoves[i].movesSeen) {
+            histRecord(&movesLatency, now - pendingMoves[i].sentNs);
+            pendingMoves[i].movesSeen = 1;
+            return;
+        }
     }
+}
 
-    // Parent process continues here
+// A new board arrived: every pending move whose cell is now taken is done
+void matchBoardEcho(uint64_t now) {
+    for (int i = 0; i < pendingCount; ) {
+        int cell = pendingMoves[i].cell;
+
+        if (cell < board.width * board.height && !tttGridIsFree(&board, cell / board.width, cell % board.width)) {
+            histRecord(&boardLatency, now - pendingMoves[i].sentNs);
+            metricObserveNs(&moveLatency, now - pendingMoves[i].sentNs);
+            dropPendingMove(i);
+        } else if (now - pendingMoves[i].sentNs > PENDING_MOVE_EXPIRY_NS) {
+            dropPendingMove(i);  // rejected or lost
+        } else {
+            i++;
+        }
+    }
+}
 
-    // Close write end of pipe in parent
-    close(mqtt_pipe_fd[1]);
-    mqtt_pipe_fd[1] = -1;
+// Print the per-stage histograms (microseconds)
+void printLatencyReport() {
+    printf("\nMove latency per stage (us):\n");
+    histPrint(&publishLatency, "publish", "", 1000.0, stdout);
+    histPrint(&movesLatency, "moves echo", "", 1000.0, stdout);
+    histPrint(&boardLatency, "board echo", "", 1000.0, stdout);
+    histPrint(&renderLatency, "render", "", 1000.0, stdout);
+    histPrint(&shownLatency, "shown", "", 1000.0, stdout);
+    fflush(stdout);
+}
 
-    // Start a thread that reads from the pipe
-    listener_running = 1;
+// Put the per-stage histograms in the message log
+void showLatencyReport() {
+    char report[1280];
+    char *line, *next;
+    FILE *out = fmemopen(report, sizeof(report), "w");
 
-    pthread_t thread_id;
-    if (pthread_create(&thread_id, NULL, mqttListenerThread, NULL) != 0) {
-        perror("pthread_create failed");
-        stopBoardListener();
+    if (out == NULL) {
         return;
     }
+    histPrint(&publishLatency, "publish", "", 1000.0, out);
+    histPrint(&movesLatency, "moves echo", "", 1000.0, out);
+    histPrint(&boardLatency, "board echo", "", 1000.0, out);
+    histPrint(&renderLatency, "render", "", 1000.0, out);
+    histPrint(&shownLatency, "shown", "", 1000.0, out);
+    fclose(out);
+
+    for (line = strtok_r(report, "\n", &next); line != NULL; line = strtok_r(NULL, "\n", &next)) {
+        showMessage(SCREEN_DEFAULT, "%s", line);
+    }
+}
 
-    // Detach the thread so its resources are freed automatically
-    pthread_detach(thread_id);
+// Redraw after the board changed, matching echoes when instrumentation is on
+void reconcilePredictions();
 
-    printf("MQTT subscriber started\n");
-    displayBoard();
-}
+void boardChanged() {
+    if (latency_enabled || metrics_enabled) {
+        matchBoardEcho(nowNs());
+    }
+    reconcilePredictions();
+
+    // The first board from the host skips the frame rate cap
+    if (!haveSnapshot) {
+        uint64_t elapsed = nowNs() - connectStartNs;
+
+        haveSnapshot = 1;
+        drawFrame();
+        if (reconnecting) {
+            reconnecting = 0;
+            metricObserveNs(&recoveryTime, elapsed);
+            showMessage(SCREEN_DEFAULT, "Board from host %.1f ms after losing the broker", (double)elapsed / 1e6);
+        } else {
+            showMessage(SCREEN_DEFAULT, "Board from host after %.1f ms", (double)elapsed / 1e6);
+        }
+    } else {
+        displayBoard();
+    }
 
-// Stop the MQTT subscriber process
-void stopBoardListener() {
-    if (!listener_running) {
-        return;
+    // Any move or reset answers the move we are waiting for
+    if (autoplayWaiting && board.filled != autoplayFilled) {
+        autoplayWaiting = 0;
     }
+    autoplayTurn();
+}
 
-    listener_running = 0;
+// Decode a binary TTT/state message: the tttWire.h format from a 3x3
+// host, or a tttGrid.h state for the variants. Returns 0 or -1.
+int decodeState(const unsigned char *payload, size_t len, TttGridState *out) {
+    TttState classic;
 
-    // Terminate the mosquitto_sub process
-    if (mqtt_sub_pid > 0) {
-        kill(mqtt_sub_pid, SIGTERM);
-        waitpid(mqtt_sub_pid, NULL, 0);
-        mqtt_sub_pid = -1;
+    if (len > 0 && payload[0] == TTT_GRID_WIRE_TAG) {
+        return tttGridWireDecode(payload, len, out);
     }
+    if (tttWireDecode(payload, len, &classic) < 0) {
+        return -1;
+    }
+    tttGridFromBoard(&out->board, &classic.board);
+    out->seq = classic.seq;
+    out->lastMove = classic.lastMove;
+    out->xWins = classic.xWins;
+    out->oWins = classic.oWins;
+    return 0;
+}
 
-    // Close the pipe
-    if (mqtt_pipe_fd[0] >= 0) {
-        close(mqtt_pipe_fd[0]);
-        mqtt_pipe_fd[0] = -1;
+// Update the whole game state from a binary TTT/state message
+void updateState(const unsigned char *payload, size_t len) {
+    TttGridState next;
+
+    if (decodeState(payload, len, &next) < 0) {
+        metricInc(&parseFailures);
+        return;
     }
+    // Version 1 states carry no score
+    if (payload[0] == TTT_GRID_WIRE_TAG || payload[0] >= 2) {
+        xWins = next.xWins;
+        oWins = next.oWins;
+    }
+
+    int finished = next.board.status != TTT_PLAYING && next.board.status != board.status;
+    board = next.board;
 
-    if (mqtt_pipe_fd[1] >= 0) {
-        close(mqtt_pipe_fd[1]);
-        mqtt_pipe_fd[1] = -1;
+    if (latency_enabled && next.lastMove != TTT_NO_MOVE) {
+        matchMovesEcho(next.lastMove, nowNs());
     }
+    boardChanged();
 
-    printf("MQTT listener stopped\n");
+    if (finished) {
+        if (board.status == TTT_DRAW) {
+            showMessage(SCREEN_BLUE, "Game ended in a draw!");
+        } else {
+            showMessage(SCREEN_GREEN, "Player %c wins!", board.status == TTT_X_WINS ? 'X' : 'O');
+        }
+    }
 }
 
 // Update the board state based on MQTT messages
-void updateBoard(const char *topic, const char *message) {
-    char subTopic[256];
-
-    // Check for board state updates
-    snprintf(subTopic, sizeof(subTopic), "%s/board", MQTT_TOPIC);
-    if (strcmp(topic, subTopic) == 0) {
-        // Update board state (flat string to 2D array)
-        for (int i = 0; i < 3; i++) {
-            for (int j = 0; j < 3; j++) {
-                board[i][j] = message[i * 3 + j];
-            }
+void updateBoard(int subtopic, const char *message, size_t len) {
+    switch (subtopic) {
+    case TTT_SUB_BOARD:
+        // Update board state (flat string to bitboard)
+        if (len >= (size_t)(board.width * board.height)) {
+            uint8_t player = board.player;
+            tttGridFromString(&board, message, len);
+            board.player = player;
+            boardChanged();
+        } else {
+            metricInc(&parseFailures);
         }
-        displayBoard();
+        break;
+
+    case TTT_SUB_VARIANT: {
+        // Geometry of a tttServer -v game in text mode, ahead of its board
+        int width, height, k;
+        if (tttGridParseVariant(message, len, &width, &height, &k) == 0 &&
+            (width != board.width || height != board.height || k != board.k)) {
+            tttGridInit(&board, width, height, k);
+            predictedCount = 0;
+            displayBoard();
+        }
+        break;
+    }
+
+    case TTT_SUB_PLAYER:
+        board.player = (len > 0 && message[0] == 'O');
+        break;
+
+    case TTT_SUB_STATUS:
+        // "X wins", "O wins", "draw" or "reset"; the board update handles the display
+        if (len >= 4 && memcmp(message + len - 4, "wins", 4) == 0) {
+            showMessage(SCREEN_GREEN, "Player %s!", message);
+        }
+        else if (len == 4 && memcmp(message, "draw", 4) == 0) {
+            showMessage(SCREEN_BLUE, "Game ended in a draw!");
+        }
+        else if (len == 5 && memcmp(message, "reset", 5) == 0) {
+            showMessage(SCREEN_YELLOW, "Game has been reset.");
+        }
+        break;
+
+    case TTT_SUB_MOVES: {
+        // "row,col,symbol"
+        int row, col;
+        if (latency_enabled && sscanf(message, "%d,%d", &row, &col) == 2) {
+            matchMovesEcho((row - 1) * board.width + (col - 1), nowNs());
+        }
+        showMessage(SCREEN_BLUE, "Move made: %s", message);
+        break;
+    }
+    }
+}
+
+// ---- Move prediction ----
+
+// The host's board with the pending moves played on top. X always opens,
+// so the side to move follows from the marks even when TTT/player lags
+// behind TTT/board in text mode.
+void rebuildView() {
+    view = board;
+    if (view.status == TTT_PLAYING) {
+        view.player = view.filled & 1;
+    }
+    for (int i = 0; i < predictedCount; i++) {
+        tttGridPlay(&view, predicted[i].row, predicted[i].col);
+    }
+}
+
+// Arm the timer for the oldest pending move, or disarm it
+void armPredictTimer(uint64_t now) {
+    if (predictedCount == 0) {
+        reactorSetTimer(predictTimer, 0, 0);
         return;
     }
+    uint64_t age = (now - predicted[0].sentNs) / 1000000;
+    reactorSetTimer(predictTimer, age >= PREDICT_TIMEOUT_MS ? 1 : (unsigned int)(PREDICT_TIMEOUT_MS - age), 0);
+}
+
+void rollBack(const PredictedMove *p, const char *why) {
+    metricInc(&predictions[PREDICT_ROLLED_BACK]);
+    showMessage(SCREEN_RED, "Move %d,%d rolled back: %s", p->row + 1, p->col + 1, why);
+}
+
+// The host's board changed: settle the pending moves against it
+void reconcilePredictions() {
+    PredictedMove pending[MAX_PREDICTED];
+    TttGrid next = board;
+    int count = predictedCount;
 
-    // Check for current player updates
-    snprintf(subTopic, sizeof(subTopic), "%s/player", MQTT_TOPIC);
-    if (strcmp(topic, subTopic) == 0) {
-        currentPlayer = message[0];
+    if (count == 0) {
         return;
     }
+    if (next.status == TTT_PLAYING) {
+        next.player = next.filled & 1;
+    }
+
+    // Rebuilt as we go, so a frame drawn for a message in between is right
+    memcpy(pending, predicted, (size_t)count * sizeof(PredictedMove));
+    predictedCount = 0;
+
+    for (int i = 0; i < count; i++) {
+        PredictedMove p = pending[i];
+        char mark = tttGridCellChar(&board, p.row, p.col);
 
-    // Check for game status updates
-    snprintf(subTopic, sizeof(subTopic), "%s/status", MQTT_TOPIC);
-    if (strcmp(topic, subTopic) == 0) {
-        if (strstr(message, "wins") != NULL) {
-            setConsoleColor(COLOR_GREEN);
-            printf("Player %s!\n", message);
-            resetConsoleColor();
+        if (mark != ' ') {
+            if (mark == (p.player ? 'O' : 'X')) {
+                metricInc(&predictions[PREDICT_CONFIRMED]);
+            } else {
+                rollBack(&p, "the other side took the cell");
+            }
+            continue;
         }
-        else if (strcmp(message, "draw") == 0) {
-            setConsoleColor(COLOR_BLUE);
-            printf("Game ended in a draw!\n");
-            resetConsoleColor();
+
+        // Still pending: it has to fit on the new board too
+        int player = next.player;
+        if (tttGridPlay(&next, p.row, p.col) == TTT_ILLEGAL) {
+            rollBack(&p, next.status != TTT_PLAYING ? "the game is over" : "no longer legal");
+            continue;
         }
-        else if (strcmp(message, "reset") == 0) {
-            setConsoleColor(COLOR_YELLOW);
-            printf("Game has been reset.\n");
-            resetConsoleColor();
+        p.player = player;
+        predicted[predictedCount++] = p;
+    }
+    armPredictTimer(nowNs());
+}
+
+// Pending moves the host never showed: it ignored them or they got lost
+void onPredictTimer(int fd, unsigned int events, void *ctx) {
+    PredictedMove pending[MAX_PREDICTED];
+    uint64_t now = nowNs();
+    int count = predictedCount;
+
+    if (count == 0 || now - predicted[0].sentNs < PREDICT_TIMEOUT_MS * 1000000ull) {
+        armPredictTimer(now);
+        return;
+    }
+
+    // The later ones were played on top of the oldest, so they all go
+    memcpy(pending, predicted, (size_t)count * sizeof(PredictedMove));
+    predictedCount = 0;
+    rollBack(&pending[0], "no answer from the host");
+    for (int i = 1; i < count; i++) {
+        rollBack(&pending[i], "played after a move the host didn't take");
+    }
+    armPredictTimer(now);
+}
+
+// Check a move (0-indexed) against the board as the player sees it and
+// show it right away. Returns -1 if it is illegal there.
+int predictMove(int row, int col, uint64_t now) {
+    // Until the host's board is known there is nothing to check against
+    if (!haveSnapshot || predictTimer < 0) {
+        return 0;
+    }
+
+    rebuildView();
+    int player = view.player;
+    if (tttGridPlay(&view, row, col) == TTT_ILLEGAL) {
+        metricInc(&predictions[PREDICT_REFUSED]);
+        if (view.status != TTT_PLAYING) {
+            showMessage(SCREEN_DEFAULT, "The game is over, waiting for the next one");
+        } else {
+            showMessage(SCREEN_DEFAULT, "Cell %d,%d is already taken", row + 1, col + 1);
         }
-        return;  // Let the board update handle the display
+        return -1;
     }
 
-    // Check for move updates
-    if (strstr(topic, "/moves") != NULL) {
-        setConsoleColor(COLOR_BLUE);
-        printf("Move made: %s\n", message);
-        resetConsoleColor();
+    // Too many outstanding: still send it, just don't draw it early
+    if (predictedCount == MAX_PREDICTED) {
+        return 0;
     }
+    predicted[predictedCount].row = row;
+    predicted[predictedCount].col = col;
+    predicted[predictedCount].player = player;
+    predicted[predictedCount].sentNs = now;
+    if (predictedCount++ == 0) {
+        armPredictTimer(now);
+    }
+    if (latency_enabled && predictShownNs == 0) {
+        predictShownNs = now;
+    }
+    displayBoard();
+    return 0;
 }
 
 // Make a move on the board
 void makeMove(int row, int col) {
-    char move[10];
-    sprintf(move, "%d,%d", row, col);
+    char move[16];
+    snprintf(move, sizeof(move), "%d,%d", row, col);
+
+    uint64_t start = nowNs();
+    if (predictMove(row - 1, col - 1, start) < 0) {
+        return;
+    }
+
+    if (!latency_enabled && !metrics_enabled) {
+        publishMessage(move);
+        return;
+    }
+
     publishMessage(move);
+    histRecord(&publishLatency, nowNs() - start);
+
+    // Oldest entry makes room if echoes stopped coming
+    if (pendingCount == MAX_PENDING_MOVES) {
+        dropPendingMove(0);
+    }
+    pendingMoves[pendingCount].cell = (row - 1) * board.width + (col - 1);
+    pendingMoves[pendingCount].sentNs = start;
+    pendingMoves[pendingCount].movesSeen = 0;
+    pendingCount++;
 }
 
 // Reset the game
 void resetGame() {
     publishMessage("r");
-    printf("Game reset command sent\n");
-    usleep(500000);  // 500ms in microseconds
+    showMessage(SCREEN_DEFAULT, "Game reset command sent");
 }
 
-// Generate all possible board positions in random order
-void generateBoardPositions() {
-    int index = 0;
-    // Create array of all positions
-    for (int i = 1; i <= 3; i++) {
-        for (int j = 1; j <= 3; j++) {
-            sprintf(positions[index], "%d,%d", i, j);
-            index++;
+// Pick a random empty cell (row * width + col) on the current board, -1 if full
+int randomEmptyCell() {
+    int empty = board.width * board.height - board.filled;
+
+    if (empty <= 0) {
+        return -1;
+    }
+
+    int skip = rand() % empty;
+    for (int r = 0; r < board.height; r++) {
+        uint16_t free = (uint16_t)(~(board.x.rows[r] | board.o.rows[r]) & ((1u << board.width) - 1));
+        int count = __builtin_popcount(free);
+
+        if (skip >= count) {
+            skip -= count;
+            continue;
         }
+        while (skip-- > 0) {
+            free &= (uint16_t)(free - 1);
+        }
+        return r * board.width + __builtin_ctz(free);
     }
+    return -1;
+}
 
-    // Fisher-Yates shuffle
-    for (int i = 8; i > 0; i--) {
-        int j = rand() % (i + 1);
-        char temp[4];
-        strcpy(temp, positions[i]);
-        strcpy(positions[i], positions[j]);
-        strcpy(positions[j], temp);
+// Make the next autoplay move based on the last board we were sent.
+// Returns 0 if there was nothing to play.
+int autoMove() {
+    int cell;
+
+    // Game over, wait for the host to start the next one
+    if (tttGridHasLine(&board.x, board.k) || tttGridHasLine(&board.o, board.k)) {
+        return 0;
     }
-    current_index = 0;
+
+    // Only 3x3 is solved; on larger boards perfect autoplay plays randomly
+    int perfect = autoplay_mode == AUTOPLAY_PERFECT && tttGridIsClassic(&board);
+    if (perfect) {
+        TttBoard classic;
+        tttGridToBoard(&board, &classic);
+        cell = tttBestMove(&classic, (unsigned int)rand());
+    } else {
+        cell = randomEmptyCell();
+    }
+
+    if (cell < 0) {
+        return 0;
+    }
+
+    int row = cell / board.width + 1;
+    int col = cell % board.width + 1;
+    makeMove(row, col);
+    showMessage(SCREEN_DEFAULT, "%s move sent: %d,%d", perfect ? "Perfect" : "Random", row, col);
+    return 1;
 }
 
-// Make a random move
-void randomMove() {
-    // If all moves used, reset for next round
-    if (current_index >= 9) {
-        printf("All positions played. Restarting board...\n");
-        generateBoardPositions();
+// Send the next autoplay move if it is our turn, the last one has been
+// played and the pacing allows it; otherwise the autoplay timer or the
+// next board update brings us back here
+void autoplayTurn() {
+    if (!autoplay_enabled || autoplayWaiting || board.status != TTT_PLAYING) {
+        return;
+    }
+
+    // X always opens, so the side to move follows from the marks even
+    // before TTT/player catches up with TTT/board
+    if (autoplay_side >= 0 && (board.filled & 1) != autoplay_side) {
+        return;
+    }
+
+    uint64_t now = nowNs();
+    uint64_t sinceMs = (now - lastAutoMoveNs) / 1000000;
+    if (sinceMs < autoplay_pace) {
+        reactorSetTimer(autoplayTimer, (unsigned int)(autoplay_pace - sinceMs), 0);
+        return;
+    }
+
+    if (autoMove()) {
+        autoplayWaiting = 1;
+        autoplayFilled = board.filled;
+        lastAutoMoveNs = now;
+        reactorSetTimer(autoplayTimer, AUTOPLAY_RETRY_MS, 0);
     }
-    publishMessage(positions[current_index]);
-    printf("Random move sent: %s\n", positions[current_index]);
-    current_index++;
-    sleep(1);  // Wait a second between moves
 }
 
-// Toggle autoplay mode
-void toggleAutoplay() {
-    autoplay_enabled = !autoplay_enabled;
-    if (autoplay_enabled) {
-        srand(time(NULL));  // Initialize random seed
-        printf("Autoplay enabled\n");
-        generateBoardPositions();
+// Autoplay timer fired: the pacing gap is over, or the host never showed
+// our last move
+void onAutoplayTimer(int fd, unsigned int events, void *ctx) {
+    if (autoplayWaiting) {
+        metricInc(&movesRejected);
+    }
+    autoplayWaiting = 0;
+    autoplayTurn();
+}
+
+// Toggle autoplay mode; selecting the other strategy switches to it
+void toggleAutoplay(int mode) {
+    if (autoplay_enabled && autoplay_mode == mode) {
+        autoplay_enabled = 0;
+        showMessage(SCREEN_DEFAULT, "Autoplay disabled");
+        reactorSetTimer(autoplayTimer, 0, 0);
+        return;
+    }
+
+    autoplay_enabled = 1;
+    autoplay_mode = mode;
+    srand(time(NULL));  // Initialize random seed
+    showMessage(SCREEN_DEFAULT, "%s autoplay enabled", mode == AUTOPLAY_PERFECT ? "Perfect" : "Random");
+    if (mode == AUTOPLAY_PERFECT && !tttGridIsClassic(&board)) {
+        showMessage(SCREEN_DEFAULT, "Perfect play is only known for 3x3, moves will be random");
+    }
+    autoplayWaiting = 0;
+    autoplayTurn();
+}
+
+// ---- Line input ----
+
+// Read what fd has into r. Returns read()'s result; 0 also sets r->eof.
+ssize_t lineRead(LineReader *r, int fd) {
+    if (r->used > 0) {
+        memmove(r->buf, r->buf + r->used, r->len - r->used);
+        r->len -= r->used;
+        r->used = 0;
+    }
+
+    ssize_t n = read(fd, r->buf + r->len, sizeof(r->buf) - 1 - r->len);
+    if (n > 0) {
+        r->len += (size_t)n;
+    } else if (n == 0) {
+        r->eof = 1;
+    }
+    return n;
+}
+
+// Next complete line without its line ending, NULL if there is none yet.
+// *overlong is set if it didn't fit. At end of input an unterminated last
+// line counts as complete.
+char *lineNext(LineReader *r, int *overlong) {
+    char *newline;
+
+    memmove(r->buf, r->buf + r->used, r->len - r->used);
+    r->len -= r->used;
+    r->used = 0;
+
+    while (r->skipping) {
+        newline = memchr(r->buf, '\n', r->len);
+        if (newline == NULL) {
+            r->len = 0;
+            return NULL;
+        }
+        r->used = (size_t)(newline - r->buf) + 1;
+        memmove(r->buf, r->buf + r->used, r->len - r->used);
+        r->len -= r->used;
+        r->used = 0;
+        r->skipping = 0;
+    }
+
+    *overlong = 0;
+    newline = memchr(r->buf, '\n', r->len);
+    if (newline != NULL) {
+        r->used = (size_t)(newline - r->buf) + 1;
+    } else if (r->len == sizeof(r->buf) - 1) {
+        r->used = r->len;
+        r->skipping = 1;
+        *overlong = 1;
+    } else if (r->eof && r->len > 0) {
+        r->used = r->len;
+    } else {
+        return NULL;
+    }
+
+    r->buf[r->used - (newline != NULL)] = '\0';
+    r->buf[strcspn(r->buf, "\r")] = '\0';
+    return r->buf;
+}
+
+// ---- Headless batch mode (-b) ----
+
+// Commands are read from a file or stdin, one per line ("row,col" or "r",
+// blank lines and # comments skipped), and sent without waiting for each
+// answer, up to batchWindow at a time. The host handles commands in order,
+// publishes one TTT/state per move or reset (sequence number +1) and
+// ignores illegal moves, so each new state acknowledges the first queued
+// command that could have produced it and everything queued before that
+// was rejected. An "s" request works as a barrier: its answer repeats the
+// current sequence number and settles the commands sent before it. One is
+// queued whenever the window is full or the source is done, and again if
+// answers stop coming. Results go to stdout as JSON lines.
+#define BATCH_QUEUE 1024           // commands in flight, plus one barrier
+#define BATCH_STALL_MS 50          // no new state for this long: send a barrier
+
+#define BATCH_MOVE 0
+#define BATCH_RESET 1
+#define BATCH_SNAPSHOT 2
+
+typedef struct {
+    int kind;          // BATCH_MOVE, BATCH_RESET or BATCH_SNAPSHOT
+    int cell;          // row * width + col for a move
+    long line;         // line in the batch source
+    uint64_t sentNs;
+    int seq;           // state that settled it, -1 if none did
+    char text[16];
+} BatchCommand;
+
+int batchWindow = 16;
+unsigned int batchTimeoutMs = 5000;
+int batchQuiet = 0;                // -q: summary only
+BatchCommand batchQueue[BATCH_QUEUE];
+int batchHead = 0;
+int batchCount = 0;                // queued, barriers included
+int batchInFlight = 0;             // moves and resets queued
+int batchBarrier = 0;              // an "s" is queued
+int batchEof = 0;
+int batchStarted = 0;
+int batchDone = 0;
+int batchProgress = 0;             // a state arrived since the last tick
+int batchHaveSeq = 0;
+uint16_t batchSeq = 0;
+long batchLine = 0;
+int batchTimer = -1;
+
+// A regular file is read as the window needs it. A pipe or terminal is
+// made non-blocking and read when the reactor says it's readable, so a
+// slow producer never holds up the states, timers and keepalives.
+LineReader batchInput;
+int batchFd = -1;
+int batchPollable = 0;
+int batchFdFlags = -1;            // to restore on exit
+int batchWatching = 0;            // batchFd is in the reactor
+uint64_t batchStartNs = 0;
+
+// Results
+unsigned long long batchSent = 0, batchPlayed = 0, batchResets = 0, batchRejected = 0;
+unsigned long long batchInvalid = 0, batchTimeouts = 0, batchUnmatched = 0, batchGaps = 0;
+Histogram batchLatency;            // command sent -> state acknowledging it
+
+// One JSON line per command
+void batchReport(const BatchCommand *c, const char *result, uint64_t now) {
+    if (batchQuiet) {
+        return;
+    }
+    printf("{\"line\":%ld,\"command\":\"%s\",\"result\":\"%s\"", c->line, c->text, result);
+    if (c->sentNs != 0) {
+        if (c->seq >= 0) {
+            printf(",\"seq\":%d", c->seq);
+        }
+        printf(",\"us\":%.1f", (double)(now - c->sentNs) / 1000.0);
+    }
+    printf("}\n");
+}
+
+// Add a command to the queue and send it
+void batchSend(int kind, int cell, long line, const char *text) {
+    BatchCommand *c = &batchQueue[(batchHead + batchCount) % BATCH_QUEUE];
+
+    c->kind = kind;
+    c->cell = cell;
+    c->line = line;
+    c->sentNs = nowNs();
+    c->seq = -1;
+    snprintf(c->text, sizeof(c->text), "%s", text);
+    batchCount++;
+
+    if (kind == BATCH_SNAPSHOT) {
+        batchBarrier = 1;
+    } else {
+        batchInFlight++;
+        batchSent++;
+    }
+    countSent(text);
+    if (mqttPublishString(&mqtt, commandTopic, text) < 0) {
+        fprintf(stderr, "Failed to send %s, is the broker reachable?\n", text);
+    }
+}
+
+// Take the oldest queued command off the queue
+BatchCommand *batchPop() {
+    BatchCommand *c = &batchQueue[batchHead];
+
+    batchHead = (batchHead + 1) % BATCH_QUEUE;
+    batchCount--;
+    if (c->kind == BATCH_SNAPSHOT) {
+        batchBarrier = 0;
+    } else {
+        batchInFlight--;
+    }
+    return c;
+}
+
+// The last command has been answered: print the totals and stop
+void batchFinish() {
+    if (batchDone) {
+        return;
+    }
+    batchDone = 1;
+
+    double elapsed = (double)(nowNs() - batchStartNs) / 1e9;
+    unsigned long long answered = batchPlayed + batchResets + batchRejected;
+
+    printf("{\"sent\":%llu,\"played\":%llu,\"resets\":%llu,\"rejected\":%llu,\"invalid\":%llu,"
+           "\"timeouts\":%llu,\"unmatched\":%llu,\"seq_gaps\":%llu,\"window\":%d,\"duration_s\":%.3f,"
+           "\"commands_per_sec\":%.1f,",
+           batchSent, batchPlayed, batchResets, batchRejected, batchInvalid, batchTimeouts, batchUnmatched,
+           batchGaps, batchWindow, elapsed, elapsed > 0 ? answered / elapsed : 0.0);
+    printf("\"latency_us\":{\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"max\":%.1f}}\n",
+           histPercentile(&batchLatency, 50) / 1000.0, histPercentile(&batchLatency, 90) / 1000.0,
+           histPercentile(&batchLatency, 99) / 1000.0, histPercentile(&batchLatency, 100) / 1000.0);
+    fflush(stdout);
+    reactorStop(&reactor);
+}
+
+void onBatchReadable(int fd, unsigned int events, void *ctx);
+
+// A line that is no command
+void batchReportInvalid(const char *line) {
+    BatchCommand bad = {BATCH_MOVE, -1, batchLine, 0, -1, ""};
+
+    snprintf(bad.text, sizeof(bad.text), "%.15s", line);
+    // Keep the JSON line valid whatever was in the file
+    for (char *p = bad.text; *p; p++) {
+        if (*p == '"' || *p == '\\' || (unsigned char)*p < ' ') {
+            *p = '?';
+        }
+    }
+    batchInvalid++;
+    batchReport(&bad, "invalid", 0);
+}
+
+// Send commands from the source until the window is full
+void batchFill() {
+    char *line;
+    int overlong;
+
+    mqttCork(&mqtt, 1);
+    while (!batchEof && batchInFlight < batchWindow) {
+        int row, col;
+
+        line = lineNext(&batchInput, &overlong);
+        if (line == NULL) {
+            if (batchInput.eof) {
+                batchEof = 1;
+                break;
+            }
+            if (batchPollable) {
+                break;
+            }
+            if (lineRead(&batchInput, batchFd) < 0) {
+                perror("Reading commands");
+                batchInput.eof = 1;
+            }
+            continue;
+        }
+        batchLine++;
+
+        if (line[0] == '\0' || line[0] == '#') {
+            continue;
+        }
+        // A line longer than the buffer is one invalid command, even if it
+        // starts like a move
+        if (overlong) {
+            batchReportInvalid(line);
+        }
+        else if ((line[0] == 'r' || line[0] == 'R') && line[1] == '\0') {
+            batchSend(BATCH_RESET, TTT_NO_MOVE, batchLine, "r");
+        }
+        else if (sscanf(line, "%d,%d", &row, &col) == 2 && row >= 1 && row <= board.height && col >= 1 &&
+                 col <= board.width) {
+            char move[16];
+            snprintf(move, sizeof(move), "%d,%d", row, col);
+            batchSend(BATCH_MOVE, (row - 1) * board.width + (col - 1), batchLine, move);
+        }
+        else {
+            batchReportInvalid(line);
+        }
+    }
+
+    // Only watch the source while there's room for more, a pipe whose
+    // writer is gone would report itself ready forever
+    int watch = batchPollable && !batchEof && batchInFlight < batchWindow;
+    if (watch != batchWatching) {
+        if (watch) {
+            reactorAdd(&reactor, batchFd, EPOLLIN, onBatchReadable, NULL);
+        } else {
+            reactorRemove(&reactor, batchFd);
+        }
+        batchWatching = watch;
+    }
+
+    // Nothing more can be sent until something is answered, and rejected
+    // moves are never answered: a barrier settles them
+    if ((batchEof || batchInFlight == batchWindow) && batchInFlight > 0 && !batchBarrier) {
+        batchSend(BATCH_SNAPSHOT, TTT_NO_MOVE, 0, "s");
+    }
+    mqttCork(&mqtt, 0);
+    mqttFlush(&mqtt);
+    updateMqttEvents();
+
+    if (batchEof && batchCount == 0) {
+        batchFinish();
+    }
+}
+
+// More commands on a pipe or terminal
+void onBatchReadable(int fd, unsigned int events, void *ctx) {
+    if (lineRead(&batchInput, fd) < 0) {
+        if (errno == EAGAIN || errno == EINTR) {
+            return;
+        }
+        perror("Reading commands");
+        batchInput.eof = 1;
+    }
+    batchFill();
+}
+
+// The host played a move on cell (kind BATCH_MOVE), reset the game or
+// answered an "s" in the state with sequence number seq: settle the queue
+// up to the command that caused it
+void batchAcknowledge(int kind, int cell, uint16_t seq, uint64_t now) {
+    int match;
+
+    for (match = 0; match < batchCount; match++) {
+        const BatchCommand *c = &batchQueue[(batchHead + match) % BATCH_QUEUE];
+        if (c->kind == kind && (kind != BATCH_MOVE || c->cell == cell)) {
+            break;
+        }
+    }
+    if (match == batchCount) {
+        // Someone else's move or "s", or the answer to a command that timed out
+        if (kind != BATCH_SNAPSHOT) {
+            batchUnmatched++;
+        }
+        return;
+    }
+
+    while (match-- > 0) {
+        BatchCommand *c = batchPop();
+        c->seq = seq;
+        if (c->kind != BATCH_SNAPSHOT) {
+            // A reset is never refused, so one settled this way was lost
+            batchRejected++;
+            metricInc(&movesRejected);
+            batchReport(c, c->kind == BATCH_MOVE ? "rejected" : "lost", now);
+        }
+    }
+
+    BatchCommand *c = batchPop();
+    c->seq = seq;
+    if (kind != BATCH_SNAPSHOT) {
+        histRecord(&batchLatency, now - c->sentNs);
+        metricObserveNs(&moveLatency, now - c->sentNs);
+        if (kind == BATCH_MOVE) {
+            batchPlayed++;
+        } else {
+            batchResets++;
+        }
+        batchReport(c, kind == BATCH_MOVE ? "played" : "reset", now);
+    }
+}
+
+// A TTT/state message in batch mode
+void batchState(const unsigned char *payload, size_t len) {
+    TttGridState next;
+    uint64_t now = nowNs();
+
+    if (decodeState(payload, len, &next) < 0) {
+        metricInc(&parseFailures);
+        return;
+    }
+    batchProgress = 1;
+
+    // The retained state from before we subscribed answers nothing
+    if (mqtt.retained) {
+        board = next.board;
+        batchSeq = next.seq;
+        batchHaveSeq = 1;
+        return;
+    }
+
+    // Same sequence number: the answer to an "s"
+    if (!batchHaveSeq || next.seq == batchSeq) {
+        board = next.board;
+        batchSeq = next.seq;
+        batchHaveSeq = 1;
+        batchAcknowledge(BATCH_SNAPSHOT, TTT_NO_MOVE, next.seq, now);
     } else {
-        printf("Autoplay disabled\n");
+        // The host starts the next game by itself once one is over
+        int autoReset = board.status != TTT_PLAYING && next.lastMove == TTT_NO_MOVE;
+
+        if ((uint16_t)(next.seq - batchSeq) != 1) {
+            batchGaps++;
+        }
+        board = next.board;
+        batchSeq = next.seq;
+        if (!autoReset) {
+            batchAcknowledge(next.lastMove == TTT_NO_MOVE ? BATCH_RESET : BATCH_MOVE, next.lastMove, next.seq, now);
+        }
+    }
+
+    // Start once the board size is known
+    if (!batchStarted) {
+        batchStarted = 1;
+        batchStartNs = now;
+    }
+    batchFill();
+}
+
+// Every BATCH_STALL_MS: give up on commands older than the timeout, and
+// send a barrier if the host went quiet with commands outstanding
+void onBatchTimer(int fd, unsigned int events, void *ctx) {
+    uint64_t now = nowNs();
+
+    while (batchCount > 0 && now - batchQueue[batchHead].sentNs > batchTimeoutMs * 1000000ull) {
+        BatchCommand *c = batchPop();
+        if (c->kind != BATCH_SNAPSHOT) {
+            batchTimeouts++;
+            batchReport(c, "timeout", now);
+        }
+    }
+
+    if (batchStarted && !batchProgress && batchInFlight > 0 && !batchBarrier) {
+        mqttCork(&mqtt, 1);
+        batchSend(BATCH_SNAPSHOT, TTT_NO_MOVE, 0, "s");
+        mqttCork(&mqtt, 0);
+        mqttFlush(&mqtt);
+        updateMqttEvents();
+    }
+    batchProgress = 0;
+
+    if (batchStarted) {
+        batchFill();
+    } else if (batchCount == 0) {
+        fprintf(stderr, "No game state from the host on %s\n", gameTopic);
+        batchDone = 1;
+        reactorStop(&reactor);
+    }
+}
+
+// Queue the "s" sent on connecting, so its answer starts the batch
+void startBatch() {
+    struct stat st;
+
+    batchFd = fileno(batchSource);
+    batchPollable = fstat(batchFd, &st) < 0 || !S_ISREG(st.st_mode);
+    if (batchPollable) {
+        batchFdFlags = fcntl(batchFd, F_GETFL);
+        fcntl(batchFd, F_SETFL, batchFdFlags | O_NONBLOCK);
+    }
+    histReset(&batchLatency);
+    batchQueue[0].kind = BATCH_SNAPSHOT;
+    batchQueue[0].sentNs = nowNs();
+    batchCount = 1;
+    batchBarrier = 1;
+    batchTimer = reactorAddTimer(&reactor, BATCH_STALL_MS, onBatchTimer, NULL);
+}
+
+void registerMetrics() {
+    static const char *sentNames[] = {"move", "reset", "snapshot"};
+    char labels[64];
+
+    for (int i = 0; i <= TTT_SUB_COUNT; i++) {
+        snprintf(labels, sizeof(labels), "topic=\"%s\"", i < TTT_SUB_COUNT ? tttSubtopicNames[i] : "other");
+        metricCounter(&messagesIn[i], "ttt_client_messages_in_total", labels, "Messages received, by subtopic");
+    }
+    for (int i = 0; i < 3; i++) {
+        snprintf(labels, sizeof(labels), "kind=\"%s\"", sentNames[i]);
+        metricCounter(&messagesOut[i], "ttt_client_messages_out_total", labels, "Commands sent, by kind");
     }
+    metricCounter(&parseFailures, "ttt_client_parse_failures_total", NULL,
+                  "Game states that did not decode and boards that were too short");
+    metricCounter(&movesRejected, "ttt_client_moves_rejected_total", NULL,
+                  "Moves the host never played (batch mode) or autoplay had to send again");
+    metricCounter(&connects, "ttt_client_connects_total", NULL, "Connections made to the broker");
+    metricCounter(&connectionsLost, "ttt_client_connections_lost_total", NULL, "Connections to the broker lost");
+    metricCounter(&frames, "ttt_client_frames_total", NULL, "Frames drawn");
+    for (int i = 0; i < 3; i++) {
+        static const char *results[] = {"confirmed", "rolled_back", "refused"};
+        snprintf(labels, sizeof(labels), "result=\"%s\"", results[i]);
+        metricCounter(&predictions[i], "ttt_client_predicted_moves_total", labels,
+                      "Moves shown before the host answered, by outcome");
+    }
+    metricHistogram(&renderTime, "ttt_client_render_seconds", NULL, "Time spent drawing a frame");
+    metricHistogram(&moveLatency, "ttt_client_move_seconds", NULL,
+                    "Time from sending a move to the host showing it");
+    metricHistogram(&recoveryTime, "ttt_client_recovery_seconds", NULL,
+                    "Time from losing the broker to having the host's board again");
 }
 
 // Cleanup function to be called on exit
 void cleanup() {
     stopBoardListener();
-    printf("Thanks for playing!\n");
+    closeScreen();
+    metricsDump();
+    if (latency_enabled) {
+        printLatencyReport();
+    }
+    if (batchSource == NULL) {
+        printf("Thanks for playing!\n");
+    } else if (batchFdFlags >= 0) {
+        // stdin may be shared with the shell
+        fcntl(batchFd, F_SETFL, batchFdFlags);
+    }
 }
 
 // Signal handler for graceful termination
 void signalHandler(int sig) {
-    printf("\nReceived signal %d. Exiting...\n", sig);
+    showMessage(SCREEN_DEFAULT, "Received signal %d. Exiting...", sig);
     cleanup();
     exit(0);
 }
 
+// Handle one line typed by the user
+void handleInput(char *input) {
+    int row, col;
+
+    if (input[0] == 'q' || input[0] == 'Q') {
+        reactorStop(&reactor);
+        return;
+    }
+    else if (input[0] == 'r' || input[0] == 'R') {
+        resetGame();
+    }
+    else if (input[0] == 'a' || input[0] == 'A') {
+        toggleAutoplay(AUTOPLAY_RANDOM);
+    }
+    else if (input[0] == 'p' || input[0] == 'P') {
+        toggleAutoplay(AUTOPLAY_PERFECT);
+    }
+    else if (input[0] == 'l' || input[0] == 'L') {
+        if (latency_enabled) {
+            showLatencyReport();
+        } else {
+            showMessage(SCREEN_DEFAULT, "Latency instrumentation is off, start with -l");
+        }
+    }
+    else if (sscanf(input, "%d,%d", &row, &col) == 2) {
+        if (row >= 1 && row <= board.height && col >= 1 && col <= board.width) {
+            makeMove(row, col);
+        }
+        else if (board.width == board.height) {
+            showMessage(SCREEN_DEFAULT, "Invalid move! Row and column must be between 1 and %d.", board.width);
+        }
+        else {
+            showMessage(SCREEN_DEFAULT, "Invalid move! Row must be between 1 and %d, column between 1 and %d.",
+                        board.height, board.width);
+        }
+    }
+    else {
+        showMessage(SCREEN_DEFAULT, "Invalid input! Enter 'row,col', 'r' to reset, 'a'/'p' to toggle random/perfect autoplay, 'l' for latency stats, or 'q' to quit.");
+    }
+
+    displayBoard();
+}
+
+// stdin is readable: collect complete lines without ever blocking the loop
+void onStdinReadable(int fd, unsigned int events, void *ctx) {
+    char *line;
+    int overlong;
+
+    if (lineRead(&input, fd) <= 0) {
+        reactorStop(&reactor);  // Handle EOF (Ctrl+D)
+        return;
+    }
+
+    while (reactor.running && (line = lineNext(&input, &overlong)) != NULL) {
+        // The terminal echoed the line onto the prompt row
+        screenInvalidateRow(&screen, PROMPT_ROW);
+        if (overlong) {
+            showMessage(SCREEN_DEFAULT, "Input too long, ignored");
+            displayBoard();
+        } else {
+            handleInput(line);
+        }
+    }
+}
+
 // Main function
 int main(int argc, char *argv[]) {
-    char input[20];
-    int row, col;
+    int opt;
+
+    // Optional broker override: -h host -p port, -g gameId for tttServer,
+    // -l to measure per-move latency, -d ms between autoplay moves,
+    // -s X or O to autoplay one side only, -b file (- for stdin) to run
+    // its commands headless, -w commands in flight, -t timeout in ms,
+    // -q for the batch summary only, -m port to serve metrics, -M file to
+    // write them to, -i client id to keep a persistent session under
+    const char *metricsFile = NULL;
+    int metricsPort = 0;
+
+    while ((opt = getopt(argc, argv, "h:p:g:ld:s:b:w:t:qm:M:i:")) != -1) {
+        switch (opt) {
+        case 'h':
+            mqttHost = optarg;
+            break;
+        case 'p':
+            mqttPort = atoi(optarg);
+            break;
+        case 'g':
+            snprintf(gameTopic, sizeof(gameTopic), "%s/%s", MQTT_TOPIC, optarg);
+            if (tttCommandTopic(commandTopic, sizeof(commandTopic), MQTT_TOPIC, optarg) < 0) {
+                fprintf(stderr, "Game id %s is too long\n", optarg);
+                return 1;
+            }
+            break;
+        case 'l':
+            latency_enabled = 1;
+            histReset(&publishLatency);
+            histReset(&movesLatency);
+            histReset(&boardLatency);
+            histReset(&renderLatency);
+            histReset(&shownLatency);
+            break;
+        case 'd':
+            autoplay_pace = (unsigned int)atoi(optarg);
+            break;
+        case 's':
+            autoplay_side = (optarg[0] == 'O' || optarg[0] == 'o') ? 1 : 0;
+            break;
+        case 'b':
+            batchSource = strcmp(optarg, "-") == 0 ? stdin : fopen(optarg, "r");
+            if (batchSource == NULL) {
+                perror(optarg);
+                return 1;
+            }
+            break;
+        case 'w':
+            batchWindow = atoi(optarg);
+            if (batchWindow < 1 || batchWindow > BATCH_QUEUE - 1) {
+                fprintf(stderr, "Window must be between 1 and %d\n", BATCH_QUEUE - 1);
+                return 1;
+            }
+            break;
+        case 't':
+            batchTimeoutMs = (unsigned int)atoi(optarg);
+            break;
+        case 'q':
+            batchQuiet = 1;
+            break;
+        case 'm':
+            metricsPort = atoi(optarg);
+            metrics_enabled = 1;
+            break;
+        case 'M':
+            metricsFile = optarg;
+            metrics_enabled = 1;
+            break;
+        case 'i':
+            sessionId = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-h host] [-p port] [-g gameId] [-l] [-d paceMs] [-s X|O] "
+                    "[-b commands|- [-w window] [-t timeoutMs] [-q]] [-m metricsPort] [-M metricsFile] [-i clientId]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    tttGridInit(&board, 3, 3, 3);
 
     // Set up signal handlers for graceful termination
     signal(SIGINT, signalHandler);
     signal(SIGTERM, signalHandler);
 
+    if (reactorInit(&reactor) < 0) {
+        return 1;
+    }
+
+    // Solve the game once so perfect autoplay is a table lookup
+    tttSolverInit();
+
     // Register cleanup function to be called on normal exit
     atexit(cleanup);
 
-    // Start the MQTT listener
-    startBoardListener();
+    if (tttTopicTableInit(&topics, gameTopic) < 0) {
+        fprintf(stderr, "Game topic %s is too long\n", gameTopic);
+        return 1;
+    }
 
-    // Main game loop
-    while (1) {
-        displayBoard();
+    registerMetrics();
+    if ((metricsPort > 0 && metricsServe(&reactor, metricsPort) < 0) ||
+        (metricsFile != NULL && metricsDumpTo(&reactor, metricsFile) < 0)) {
+        return 1;
+    }
 
-        // Autoplay mode - make moves automatically
-        if (autoplay_enabled) {
-            randomMove();
-            usleep(autoplay_delay * 1000);  // Convert to microseconds
-            continue;  // Skip manual input when in autoplay mode
+    if (batchSource != NULL) {
+        startBoardListener();
+        if (!listener_running) {
+            return 1;
         }
+        startBatch();
+        reactorRun(&reactor);
+        return batchDone && batchStarted ? 0 : 1;
+    }
 
-        // Manual input mode
-        printf("> ");
-        if (fgets(input, sizeof(input), stdin) == NULL) {
-            break;  // Handle EOF (Ctrl+D)
-        }
+    screenInit(&screen, STDOUT_FILENO);
+    frameTimer = reactorAddTimer(&reactor, 0, onFrameTimer, NULL);
 
-        input[strcspn(input, "\n")] = 0;
+    // Start the MQTT listener
+    startBoardListener();
 
-        if (input[0] == 'q' || input[0] == 'Q') {
-            break;
-        }
-        else if (input[0] == 'r' || input[0] == 'R') {
-            resetGame();
-        }
-        else if (input[0] == 'a' || input[0] == 'A') {
-            toggleAutoplay();
-        }
-        else if (sscanf(input, "%d,%d", &row, &col) == 2) {
-            if (row >= 1 && row <= 3 && col >= 1 && col <= 3) {
-                makeMove(row, col);
-            }
-            else {
-                printf("Invalid move! Row and column must be between 1 and 3.\n");
-                sleep(1);
-            }
-        }
-        else {
-            printf("Invalid input! Enter 'row,col', 'r' to reset, 'a' to toggle autoplay, or 'q' to quit.\n");
-            sleep(1);
-        }
+    autoplayTimer = reactorAddTimer(&reactor, 0, onAutoplayTimer, NULL);
+    predictTimer = reactorAddTimer(&reactor, 0, onPredictTimer, NULL);
+    if (reactorAdd(&reactor, STDIN_FILENO, EPOLLIN, onStdinReadable, NULL) < 0) {
+        perror("Cannot watch stdin");
+        return 1;
     }
 
+    // Main game loop: everything happens in the callbacks
+    reactorRun(&reactor);
+
     return 0;
-}
\ No newline at end of file
+}
@@ -24,7 +24,7 @@ NC='\033[0m' # No Color
 publish_message() {
     message="$1"
     echo "Sending: $message"
-    $MOSQUITTO_PUB -h $MQTT_HOST -t "$MQTT_TOPIC" -m "$message"
+    $MOSQUITTO_PUB -h $MQTT_HOST -t "$MQTT_TOPIC" -q 1 -m "$message"
 }
 
 # Function to display the board
@@ -0,0 +1,102 @@
+// histogram.c - HDR-style latency histogram
+
+#include <string.h>
+
+#include "histogram.h"
+
+static int slotFor(uint64_t value) {
+    if (value < 2 * HIST_SUB_COUNT) {
+        return (int)value;
+    }
+
+    int exponent = 63 - __builtin_clzll(value);
+    int shift = exponent - HIST_SUB_BITS;
+    int sub = (int)(value >> shift) - HIST_SUB_COUNT;
+    int slot = 2 * HIST_SUB_COUNT + (shift - 1) * HIST_SUB_COUNT + sub;
+
+    return slot < HIST_SLOTS ? slot : HIST_SLOTS - 1;
+}
+
+// Midpoint of the range of values that land in a slot
+static uint64_t valueFor(int slot) {
+    if (slot < 2 * HIST_SUB_COUNT) {
+        return (uint64_t)slot;
+    }
+
+    int shift = (slot - 2 * HIST_SUB_COUNT) / HIST_SUB_COUNT + 1;
+    uint64_t sub = (uint64_t)((slot - 2 * HIST_SUB_COUNT) % HIST_SUB_COUNT + HIST_SUB_COUNT);
+    return (sub << shift) + ((1ull << shift) >> 1);
+}
+
+void histReset(Histogram *h) {
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+void histRecord(Histogram *h, uint64_t value) {
+    h->counts[slotFor(value)]++;
+    h->total++;
+    h->sum += value;
+    if (value < h->min) {
+        h->min = value;
+    }
+    if (value > h->max) {
+        h->max = value;
+    }
+}
+
+uint64_t histPercentile(const Histogram *h, double percentile) {
+    if (h->total == 0) {
+        return 0;
+    }
+    if (percentile >= 100.0) {
+        return h->max;
+    }
+
+    uint64_t target = (uint64_t)(percentile / 100.0 * (double)h->total + 0.5);
+    uint64_t seen = 0;
+
+    if (target == 0) {
+        target = 1;
+    }
+
+    for (int slot = 0; slot < HIST_SLOTS; slot++) {
+        seen += h->counts[slot];
+        if (seen >= target) {
+            uint64_t value = valueFor(slot);
+            // Never report beyond the observed range
+            return value < h->min ? h->min : value > h->max ? h->max : value;
+        }
+    }
+    return h->max;
+}
+
+void histMerge(Histogram *dst, const Histogram *src) {
+    for (int slot = 0; slot < HIST_SLOTS; slot++) {
+        dst->counts[slot] += src->counts[slot];
+    }
+    dst->total += src->total;
+    dst->sum += src->sum;
+    if (src->min < dst->min) {
+        dst->min = src->min;
+    }
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+}
+
+void histPrint(const Histogram *h, const char *name, const char *unit, double scale, FILE *out) {
+    static const double percentiles[] = {50, 75, 90, 95, 99, 99.9};
+
+    if (h->total == 0) {
+        fprintf(out, "%-14s no samples\n", name);
+        return;
+    }
+
+    fprintf(out, "%-14s n=%-8llu mean=%.1f%s", name, (unsigned long long)h->total,
+            (double)h->sum / (double)h->total / scale, unit);
+    for (size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+        fprintf(out, "  p%g=%.1f", percentiles[i], (double)histPercentile(h, percentiles[i]) / scale);
+    }
+    fprintf(out, "  max=%.1f\n", (double)h->max / scale);
+}
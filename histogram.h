@@ -0,0 +1,39 @@
+// histogram.h - HDR-style latency histogram
+// Log-linear buckets: exact below 64, then 32 sub-buckets per power of two,
+// so any recorded value is reported within about 3%. Recording is a few
+// integer ops and one increment, no allocation.
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define HIST_SUB_BITS 5
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_SLOTS (2 * HIST_SUB_COUNT + 58 * HIST_SUB_COUNT)
+
+typedef struct {
+    uint64_t counts[HIST_SLOTS];
+    uint64_t total;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+} Histogram;
+
+void histReset(Histogram *h);
+
+// Record one value (any unit, the histogram doesn't care)
+void histRecord(Histogram *h, uint64_t value);
+
+// Value at the given percentile (0..100), 0 if empty
+uint64_t histPercentile(const Histogram *h, double percentile);
+
+// Add every count from src into dst
+void histMerge(Histogram *dst, const Histogram *src);
+
+// Print count, mean and a percentile table. scale divides every value
+// (e.g. 1000 to print nanosecond samples as microseconds).
+void histPrint(const Histogram *h, const char *name, const char *unit, double scale, FILE *out);
+
+#endif
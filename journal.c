@@ -0,0 +1,336 @@
+// journal.c - Append-only game journal
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "journal.h"
+#include "tttTopics.h"
+
+#define JOURNAL_BASE_TOPIC "TTT"
+#define JOURNAL_MIN_CAPACITY 65536  // records, 4 MB
+
+static size_t fileSizeFor(uint64_t records) {
+    return sizeof(JournalHeader) + (size_t)records * sizeof(JournalRecord);
+}
+
+// Map the first capacity records of the file (which must be that big)
+static int mapRecords(Journal *j, uint64_t capacity) {
+    size_t size = fileSizeFor(capacity);
+    int prot = j->writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    void *map = mmap(NULL, size, prot, MAP_SHARED, j->fd, 0);
+
+    if (map == MAP_FAILED) {
+        perror("Cannot map journal");
+        return -1;
+    }
+    if (j->map != NULL) {
+        munmap(j->map, j->mapSize);
+    }
+
+    j->map = map;
+    j->mapSize = size;
+    j->capacity = capacity;
+    j->header = (JournalHeader *)j->map;
+    j->records = (JournalRecord *)(j->map + sizeof(JournalHeader));
+    return 0;
+}
+
+static int growTo(Journal *j, uint64_t capacity) {
+    if (ftruncate(j->fd, (off_t)fileSizeFor(capacity)) < 0) {
+        perror("Cannot grow journal");
+        return -1;
+    }
+    return mapRecords(j, capacity);
+}
+
+int journalOpen(Journal *j, const char *path, int writable) {
+    struct stat st;
+
+    memset(j, 0, sizeof(*j));
+    j->writable = writable;
+    j->fd = open(path, writable ? O_RDWR | O_CREAT | O_CLOEXEC : O_RDONLY | O_CLOEXEC, 0644);
+    if (j->fd < 0) {
+        perror(path);
+        return -1;
+    }
+    if (fstat(j->fd, &st) < 0) {
+        perror(path);
+        close(j->fd);
+        return -1;
+    }
+
+    // A new file gets a header and room to start with
+    if (st.st_size == 0 && writable) {
+        if (growTo(j, JOURNAL_MIN_CAPACITY) < 0) {
+            close(j->fd);
+            return -1;
+        }
+        memcpy(j->header->magic, JOURNAL_MAGIC, sizeof(j->header->magic));
+        j->header->recordSize = sizeof(JournalRecord);
+        return 0;
+    }
+
+    if ((size_t)st.st_size < sizeof(JournalHeader) ||
+        mapRecords(j, ((size_t)st.st_size - sizeof(JournalHeader)) / sizeof(JournalRecord)) < 0) {
+        fprintf(stderr, "%s is not a game journal\n", path);
+        close(j->fd);
+        return -1;
+    }
+    if (memcmp(j->header->magic, JOURNAL_MAGIC, sizeof(j->header->magic)) != 0 ||
+        j->header->recordSize != sizeof(JournalRecord) || j->header->count > j->capacity) {
+        fprintf(stderr, "%s is not a game journal\n", path);
+        journalClose(j);
+        return -1;
+    }
+
+    if (writable && j->capacity < JOURNAL_MIN_CAPACITY && growTo(j, JOURNAL_MIN_CAPACITY) < 0) {
+        journalClose(j);
+        return -1;
+    }
+    return 0;
+}
+
+void journalClose(Journal *j) {
+    if (j->map != NULL) {
+        uint64_t count = j->header->count;
+        munmap(j->map, j->mapSize);
+        j->map = NULL;
+        if (j->writable && ftruncate(j->fd, (off_t)fileSizeFor(count)) < 0) {
+            perror("Cannot trim journal");
+        }
+    }
+    if (j->fd >= 0) {
+        close(j->fd);
+        j->fd = -1;
+    }
+}
+
+int journalAppend(Journal *j, const JournalRecord *r) {
+    uint64_t count = j->header->count;
+
+    if (count == j->capacity && growTo(j, j->capacity * 2) < 0) {
+        return -1;
+    }
+
+    j->records[count] = *r;
+    // Publish the record only once it is complete
+    __atomic_store_n(&j->header->count, count + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void journalSync(Journal *j) {
+    msync(j->map, fileSizeFor(j->header->count), MS_ASYNC);
+}
+
+uint64_t journalFindTime(const Journal *j, uint64_t timeNs) {
+    uint64_t lo = 0;
+    uint64_t hi = journalCount(j);
+
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (j->records[mid].timeNs < timeNs) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// FNV-1a, never returns 0 so 0 can mark an empty slot
+uint32_t journalHashId(const char *id, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)id[i]) * 16777619u;
+    }
+    return h ? h : 1;
+}
+
+static int subtopicKind(const char *sub, size_t len) {
+    for (int kind = 0; kind < TTT_SUB_COUNT; kind++) {
+        if (strlen(tttSubtopicNames[kind]) == len && memcmp(sub, tttSubtopicNames[kind], len) == 0) {
+            return kind;
+        }
+    }
+    return TTT_SUB_NONE;
+}
+
+int journalRecordMessage(JournalRecord *r, uint64_t timeNs, const char *topic, size_t topicLen,
+                         const char *payload, size_t payloadLen) {
+    size_t baseLen = sizeof(JOURNAL_BASE_TOPIC) - 1;
+    const char *id = topic + baseLen + 1;
+    size_t idLen = 0;
+    int kind = TTT_SUB_NONE;
+
+    if (topicLen < baseLen || memcmp(topic, JOURNAL_BASE_TOPIC, baseLen) != 0) {
+        return -1;
+    }
+
+    // TTT, TTT/<sub> (legacy game), TTT/<gameId>, TTT/<gameId>/<sub> or a
+    // command on TTT/p<n>/<gameId>
+    if (topicLen > baseLen) {
+        if (topic[baseLen] != '/') {
+            return -1;
+        }
+
+        size_t rest = topicLen - baseLen - 1;
+        const char *slash = memchr(id, '/', rest);
+        size_t partition = tttPartitionLevel(id, rest);
+        if (partition > 0 && memchr(id + partition, '/', rest - partition) == NULL &&
+            subtopicKind(id + partition, rest - partition) == TTT_SUB_NONE) {
+            id += partition;
+            idLen = rest - partition;
+        } else if (slash != NULL) {
+            idLen = (size_t)(slash - id);
+            kind = subtopicKind(slash + 1, rest - idLen - 1);
+            if (kind == TTT_SUB_NONE) {
+                return -1;
+            }
+        } else {
+            kind = subtopicKind(id, rest);
+            idLen = kind == TTT_SUB_NONE ? rest : 0;
+        }
+    }
+
+    // The formatted board is only a rendering of TTT/board
+    if (kind == TTT_SUB_BOARD_FORMATTED || idLen >= JOURNAL_ID_LEN) {
+        return -1;
+    }
+
+    memset(r, 0, sizeof(*r));
+    r->timeNs = timeNs;
+    r->gameHash = journalHashId(id, idLen);
+    memcpy(r->gameId, id, idLen);
+    r->idLen = (uint8_t)idLen;
+
+    if (kind != TTT_SUB_NONE) {
+        r->type = (uint8_t)(JOURNAL_HOST + kind);
+    } else if (payloadLen > 0 && (payload[0] == 's' || payload[0] == 'S')) {
+        return -1;  // a snapshot request changes nothing
+    } else if (payloadLen > 0 && (payload[0] == 'r' || payload[0] == 'R')) {
+        r->type = JOURNAL_RESET;
+    } else {
+        r->type = JOURNAL_MOVE;
+    }
+
+    // Cut short, a state would decode as garbage or not at all, and a
+    // replay would publish it
+    if (payloadLen > JOURNAL_PAYLOAD_LEN) {
+        r->flags = JOURNAL_TOO_LONG;
+        return 0;
+    }
+    r->payloadLen = (uint8_t)payloadLen;
+    memcpy(r->payload, payload, payloadLen);
+    return 0;
+}
+
+size_t journalTopic(const JournalRecord *r, const char *prefix, char *out, size_t size) {
+    int n;
+
+    if (r->idLen > 0 || prefix[0] != '\0') {
+        char id[96];
+        snprintf(id, sizeof(id), "%s%.*s", prefix, (int)r->idLen, r->gameId);
+        if (r->type < JOURNAL_HOST) {
+            n = tttCommandTopic(out, size, JOURNAL_BASE_TOPIC, id);
+        } else {
+            n = snprintf(out, size, "%s/%s", JOURNAL_BASE_TOPIC, id);
+        }
+    } else {
+        n = snprintf(out, size, "%s", JOURNAL_BASE_TOPIC);
+    }
+
+    if (r->type >= JOURNAL_HOST && n >= 0 && (size_t)n < size) {
+        n += snprintf(out + n, size - (size_t)n, "/%s", tttSubtopicNames[r->type - JOURNAL_HOST]);
+    }
+    return n < 0 ? 0 : (size_t)n < size ? (size_t)n : size - 1;
+}
+
+// ---- Index by game ----
+
+static JournalIndexSlot *findSlot(JournalIndexSlot *slots, uint32_t mask, uint32_t hash) {
+    uint32_t i = hash & mask;
+    while (slots[i].hash != 0 && slots[i].hash != hash) {
+        i = (i + 1) & mask;
+    }
+    return &slots[i];
+}
+
+// Double the slot table, kept at most half full
+static int growIndex(JournalIndex *idx) {
+    uint32_t mask = idx->slotMask ? idx->slotMask * 2 + 1 : 1023;
+    JournalIndexSlot *slots = calloc((size_t)mask + 1, sizeof(JournalIndexSlot));
+
+    if (slots == NULL) {
+        return -1;
+    }
+    for (uint32_t i = 0; idx->slots != NULL && i <= idx->slotMask; i++) {
+        if (idx->slots[i].hash != 0) {
+            *findSlot(slots, mask, idx->slots[i].hash) = idx->slots[i];
+        }
+    }
+    free(idx->slots);
+    idx->slots = slots;
+    idx->slotMask = mask;
+    return 0;
+}
+
+int journalIndexBuild(JournalIndex *idx, const Journal *j) {
+    uint64_t count = journalCount(j);
+    uint64_t next = 0;
+
+    memset(idx, 0, sizeof(*idx));
+    idx->positions = malloc((size_t)(count ? count : 1) * sizeof(uint64_t));
+    if (idx->positions == NULL || growIndex(idx) < 0) {
+        journalIndexFree(idx);
+        return -1;
+    }
+
+    // Count the records of each game...
+    for (uint64_t i = 0; i < count; i++) {
+        JournalIndexSlot *slot = findSlot(idx->slots, idx->slotMask, j->records[i].gameHash);
+        if (slot->hash == 0) {
+            if ((idx->games + 1) * 2 > (uint64_t)idx->slotMask + 1) {
+                if (growIndex(idx) < 0) {
+                    journalIndexFree(idx);
+                    return -1;
+                }
+                slot = findSlot(idx->slots, idx->slotMask, j->records[i].gameHash);
+            }
+            slot->hash = j->records[i].gameHash;
+            idx->games++;
+        }
+        slot->count++;
+    }
+
+    // ...give each game its run of positions...
+    for (uint32_t i = 0; i <= idx->slotMask; i++) {
+        idx->slots[i].first = next;
+        next += idx->slots[i].count;
+        idx->slots[i].count = 0;
+    }
+
+    // ...and fill them in record order
+    for (uint64_t i = 0; i < count; i++) {
+        JournalIndexSlot *slot = findSlot(idx->slots, idx->slotMask, j->records[i].gameHash);
+        idx->positions[slot->first + slot->count++] = i;
+    }
+    return 0;
+}
+
+void journalIndexFree(JournalIndex *idx) {
+    free(idx->slots);
+    free(idx->positions);
+    memset(idx, 0, sizeof(*idx));
+}
+
+const uint64_t *journalIndexFind(const JournalIndex *idx, const char *id, size_t len, uint64_t *count) {
+    const JournalIndexSlot *slot = findSlot(idx->slots, idx->slotMask, journalHashId(id, len));
+
+    *count = slot->count;
+    return slot->hash != 0 ? idx->positions + slot->first : NULL;
+}
@@ -0,0 +1,117 @@
+// journal.h - Append-only game journal
+// Every move, reset and host update seen on TTT/# is stored as one 64-byte
+// record in a memory-mapped file, in arrival order:
+//
+//   offset 0    header (magic, record size, committed record count)
+//   offset 64   record 0, record 1, ...
+//
+// Appending is a copy into the mapping and a bump of the header count, so
+// a reader that maps the same file never sees a half-written record.
+// Records are in time order, so a timestamp lookup is a binary search;
+// an in-memory index built on open finds every record of one game.
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define JOURNAL_MAGIC "TTTJRNL1"
+#define JOURNAL_ID_LEN 28       // same limit as tttServer's game ids
+#define JOURNAL_PAYLOAD_LEN 20  // longer payloads are not kept, see JOURNAL_TOO_LONG
+
+// Record flags. Records hold 3x3 messages; a tttGrid.h variant state
+// (13 + 2*ceil(w*h/8) bytes) doesn't fit, so only the event is recorded.
+#define JOURNAL_TOO_LONG 0x01  // payload didn't fit, payloadLen is 0
+
+// Record types: a command sent to a game, or something the host published
+#define JOURNAL_MOVE   0   // "row,col" on TTT/<gameId>
+#define JOURNAL_RESET  1   // "r" on TTT/<gameId>
+#define JOURNAL_HOST   2   // + TTT_SUB_* (state, board, ...) on TTT/<gameId>/<sub>
+
+typedef struct {
+    uint64_t timeNs;        // wall clock, ns since the epoch
+    uint32_t gameHash;      // FNV-1a of gameId, for the index
+    uint8_t type;           // JOURNAL_MOVE, JOURNAL_RESET or JOURNAL_HOST + subtopic
+    uint8_t idLen;
+    uint8_t payloadLen;
+    uint8_t flags;          // JOURNAL_TOO_LONG
+    char gameId[JOURNAL_ID_LEN];  // empty for the legacy game on TTT
+    uint8_t payload[JOURNAL_PAYLOAD_LEN];
+} JournalRecord;
+
+typedef struct {
+    char magic[8];
+    uint32_t recordSize;
+    uint32_t reserved;
+    uint64_t count;         // records committed
+    uint8_t pad[sizeof(JournalRecord) - 24];
+} JournalHeader;
+
+typedef struct {
+    int fd;
+    int writable;
+    unsigned char *map;
+    size_t mapSize;
+    uint64_t capacity;      // records the mapping has room for
+    JournalHeader *header;
+    JournalRecord *records;
+} Journal;
+
+// Records of each game, in order, found by game id hash
+typedef struct {
+    uint32_t hash;          // 0 = empty slot
+    uint64_t first;         // offset into positions
+    uint64_t count;
+} JournalIndexSlot;
+
+typedef struct {
+    JournalIndexSlot *slots;
+    uint32_t slotMask;
+    uint64_t *positions;    // record numbers, grouped by game
+    uint64_t games;
+} JournalIndex;
+
+// Open (and with writable, create) a journal. Returns 0 or -1.
+int journalOpen(Journal *j, const char *path, int writable);
+
+// Trim the file to the committed records and unmap it
+void journalClose(Journal *j);
+
+// Add one record, growing the file as needed. Returns 0 or -1.
+int journalAppend(Journal *j, const JournalRecord *r);
+
+// Ask the kernel to write dirty pages back, without waiting
+void journalSync(Journal *j);
+
+// Records committed, as far as this mapping reaches: a reader of a live
+// journal sees the records that fit the file as it was when opened, and
+// the writer's later growth only once it opens the journal again
+static inline uint64_t journalCount(const Journal *j) {
+    uint64_t count = __atomic_load_n(&j->header->count, __ATOMIC_ACQUIRE);
+    return count < j->capacity ? count : j->capacity;
+}
+
+// First record at or after timeNs (journalCount() if none)
+uint64_t journalFindTime(const Journal *j, uint64_t timeNs);
+
+// Turn a message seen on TTT/# into a record stamped timeNs.
+// Returns -1 for messages that aren't worth keeping.
+int journalRecordMessage(JournalRecord *r, uint64_t timeNs, const char *topic, size_t topicLen,
+                         const char *payload, size_t payloadLen);
+
+// Topic the record was seen on, with prefix put in front of the game id
+// (e.g. to replay into different games). Commands for a game go to its
+// partition topic, TTT/p<n>/<gameId>. Returns the topic length.
+size_t journalTopic(const JournalRecord *r, const char *prefix, char *out, size_t size);
+
+uint32_t journalHashId(const char *id, size_t len);
+
+int journalIndexBuild(JournalIndex *idx, const Journal *j);
+void journalIndexFree(JournalIndex *idx);
+
+// Record numbers for a game id (hash match; compare gameId to rule out
+// collisions). Returns NULL and *count = 0 if the game never appears.
+const uint64_t *journalIndexFind(const JournalIndex *idx, const char *id, size_t len, uint64_t *count);
+
+#endif
@@ -0,0 +1,206 @@
+// metrics.c - Prometheus text export for metrics.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "metrics.h"
+
+#define METRIC_COUNTER 0
+#define METRIC_GAUGE 1
+#define METRIC_HISTOGRAM 2
+
+typedef struct {
+    int type;
+    void *metric;
+    const char *name;
+    const char *help;
+    char *labels;   // NULL if none
+} MetricEntry;
+
+static MetricEntry *entries = NULL;
+static int entryCount = 0;
+static int entryCap = 0;
+
+static Reactor *metricsReactor = NULL;
+static char *dumpPath = NULL;
+
+static void registerMetric(int type, void *metric, const char *name, const char *labels, const char *help) {
+    if (entryCount == entryCap) {
+        int cap = entryCap ? entryCap * 2 : 32;
+        MetricEntry *grown = realloc(entries, (size_t)cap * sizeof(MetricEntry));
+        if (grown == NULL) {
+            return;
+        }
+        entries = grown;
+        entryCap = cap;
+    }
+
+    MetricEntry *e = &entries[entryCount++];
+    e->type = type;
+    e->metric = metric;
+    e->name = name;
+    e->help = help;
+    e->labels = labels != NULL && labels[0] != '\0' ? strdup(labels) : NULL;
+}
+
+void metricCounter(MetricCounter *c, const char *name, const char *labels, const char *help) {
+    registerMetric(METRIC_COUNTER, c, name, labels, help);
+}
+
+void metricGauge(MetricCounter *c, const char *name, const char *labels, const char *help) {
+    registerMetric(METRIC_GAUGE, c, name, labels, help);
+}
+
+void metricHistogram(MetricHistogram *h, const char *name, const char *labels, const char *help) {
+    registerMetric(METRIC_HISTOGRAM, h, name, labels, help);
+}
+
+static void writeHistogram(FILE *out, const MetricEntry *e) {
+    const MetricHistogram *h = e->metric;
+    const char *labels = e->labels ? e->labels : "";
+    const char *comma = e->labels ? "," : "";
+    uint64_t count = 0;
+
+    for (int i = 0; i <= METRIC_BUCKETS; i++) {
+        count += __atomic_load_n(&h->buckets[i], __ATOMIC_RELAXED);
+        if (i < METRIC_BUCKETS) {
+            fprintf(out, "%s_bucket{%s%sle=\"%g\"} %llu\n", e->name, labels, comma, (double)(1ull << i) / 1e6,
+                    (unsigned long long)count);
+        } else {
+            fprintf(out, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", e->name, labels, comma, (unsigned long long)count);
+        }
+    }
+
+    const char *open = e->labels ? "{" : "";
+    const char *close = e->labels ? "}" : "";
+    fprintf(out, "%s_sum%s%s%s %.9f\n", e->name, open, labels, close,
+            (double)__atomic_load_n(&h->sumNs, __ATOMIC_RELAXED) / 1e9);
+    fprintf(out, "%s_count%s%s%s %llu\n", e->name, open, labels, close, (unsigned long long)count);
+}
+
+void metricsWrite(FILE *out) {
+    static const char *types[] = {"counter", "gauge", "histogram"};
+
+    for (int i = 0; i < entryCount; i++) {
+        const MetricEntry *e = &entries[i];
+
+        if (i == 0 || strcmp(entries[i - 1].name, e->name) != 0) {
+            fprintf(out, "# HELP %s %s\n# TYPE %s %s\n", e->name, e->help, e->name, types[e->type]);
+        }
+
+        if (e->type == METRIC_HISTOGRAM) {
+            writeHistogram(out, e);
+        } else if (e->labels) {
+            fprintf(out, "%s{%s} %llu\n", e->name, e->labels,
+                    (unsigned long long)__atomic_load_n(&((MetricCounter *)e->metric)->value, __ATOMIC_RELAXED));
+        } else {
+            fprintf(out, "%s %llu\n", e->name,
+                    (unsigned long long)__atomic_load_n(&((MetricCounter *)e->metric)->value, __ATOMIC_RELAXED));
+        }
+    }
+}
+
+// A scraper sent its request: answer with the metrics and hang up
+static void onMetricsRequest(int fd, unsigned int events, void *ctx) {
+    char request[2048];
+    char *body = NULL;
+    size_t bodyLen = 0;
+
+    // One read is enough, the request itself doesn't matter
+    if (recv(fd, request, sizeof(request), 0) < 0 && errno == EAGAIN) {
+        return;
+    }
+    reactorRemove(metricsReactor, fd);
+
+    FILE *out = open_memstream(&body, &bodyLen);
+    if (out != NULL) {
+        metricsWrite(out);
+        fclose(out);
+
+        char header[128];
+        int headerLen = snprintf(header, sizeof(header),
+                                 "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                                 "Content-Length: %zu\r\n\r\n", bodyLen);
+        // Small enough for the socket buffer, so plain blocking sends
+        send(fd, header, (size_t)headerLen, MSG_NOSIGNAL);
+        send(fd, body, bodyLen, MSG_NOSIGNAL);
+        free(body);
+    }
+    shutdown(fd, SHUT_WR);
+    close(fd);
+}
+
+static void onMetricsAccept(int fd, unsigned int events, void *ctx) {
+    int conn = accept(fd, NULL, NULL);
+
+    if (conn < 0) {
+        return;
+    }
+    if (reactorAdd(metricsReactor, conn, EPOLLIN, onMetricsRequest, NULL) < 0) {
+        close(conn);
+    }
+}
+
+int metricsServe(Reactor *r, int port) {
+    struct sockaddr_in addr;
+    int one = 1;
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (fd < 0) {
+        perror("metrics socket");
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+        perror("metrics bind/listen");
+        close(fd);
+        return -1;
+    }
+
+    metricsReactor = r;
+    if (reactorAdd(r, fd, EPOLLIN, onMetricsAccept, NULL) < 0) {
+        close(fd);
+        return -1;
+    }
+    return 0;
+}
+
+void metricsDump() {
+    char tmp[4096];
+    FILE *out;
+
+    if (dumpPath == NULL) {
+        return;
+    }
+    snprintf(tmp, sizeof(tmp), "%s.tmp", dumpPath);
+    if ((out = fopen(tmp, "w")) == NULL) {
+        perror(tmp);
+        return;
+    }
+    metricsWrite(out);
+    if (fclose(out) == 0) {
+        rename(tmp, dumpPath);
+    }
+}
+
+static void onDumpTimer(int fd, unsigned int events, void *ctx) {
+    metricsDump();
+}
+
+int metricsDumpTo(Reactor *r, const char *path) {
+    free(dumpPath);
+    dumpPath = strdup(path);
+    return reactorAddTimer(r, METRICS_DUMP_MS, onDumpTimer, NULL) < 0 ? -1 : 0;
+}
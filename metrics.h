@@ -0,0 +1,82 @@
+// metrics.h - Counters and histograms in Prometheus text format
+// Each program keeps its metrics in MetricCounter/MetricHistogram variables
+// and registers them once with a name, labels and help text. Every metric
+// has a single writing thread (the reactor thread in all our programs), so
+// counting is a relaxed atomic load and store of the counter: a plain add
+// on x86, no lock prefix, and readers on any thread never see a torn value.
+// The text is served on a local TCP port (every request gets the current
+// values, so curl and a Prometheus scrape both work) and/or written to a
+// file every few seconds.
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "reactor.h"
+
+// Histogram bucket bounds are 1us, 2us, 4us ... about 8.4s, then +Inf
+#define METRIC_BUCKETS 24
+#define METRICS_DUMP_MS 5000
+
+typedef struct {
+    uint64_t value;
+} MetricCounter;
+
+typedef struct {
+    uint64_t buckets[METRIC_BUCKETS + 1];  // not cumulative, the last one is +Inf
+    uint64_t sumNs;
+} MetricHistogram;
+
+// Single writer: no read-modify-write needed
+static inline void metricBump(uint64_t *v, uint64_t n) {
+    __atomic_store_n(v, __atomic_load_n(v, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+static inline void metricAdd(MetricCounter *c, uint64_t n) {
+    metricBump(&c->value, n);
+}
+
+static inline void metricInc(MetricCounter *c) {
+    metricBump(&c->value, 1);
+}
+
+// For gauges
+static inline void metricSet(MetricCounter *c, uint64_t value) {
+    __atomic_store_n(&c->value, value, __ATOMIC_RELAXED);
+}
+
+// Record a duration in nanoseconds
+static inline void metricObserveNs(MetricHistogram *h, uint64_t ns) {
+    uint64_t us = ns / 1000;
+    int bucket = us == 0 ? 0 : 64 - __builtin_clzll(us);
+
+    if (bucket > METRIC_BUCKETS) {
+        bucket = METRIC_BUCKETS;
+    }
+    metricBump(&h->buckets[bucket], 1);
+    metricBump(&h->sumNs, ns);
+}
+
+// Register a metric under name, with labels like topic="board" (or NULL).
+// Metrics sharing a name must be registered one after the other and with
+// the same help text.
+void metricCounter(MetricCounter *c, const char *name, const char *labels, const char *help);
+void metricGauge(MetricCounter *c, const char *name, const char *labels, const char *help);
+void metricHistogram(MetricHistogram *h, const char *name, const char *labels, const char *help);
+
+// Write every registered metric in Prometheus text format
+void metricsWrite(FILE *out);
+
+// Answer HTTP requests on 127.0.0.1:port from the reactor. Returns 0 or -1.
+int metricsServe(Reactor *r, int port);
+
+// Write the metrics to path every METRICS_DUMP_MS (through a temporary
+// file, so readers never see half of it). Returns 0 or -1.
+int metricsDumpTo(Reactor *r, const char *path);
+
+// Write the file now, e.g. on the way out; does nothing without a path
+void metricsDump();
+
+#endif
@@ -0,0 +1,658 @@
+// mqtt.c - Minimal MQTT 3.1.1 client
+// Only what the Tic-Tac-Toe clients need: CONNECT, PUBLISH (QoS 0/1),
+// SUBSCRIBE, UNSUBSCRIBE, wills, PINGREQ and DISCONNECT over a plain TCP socket.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <stdint.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "mqtt.h"
+
+// Control packet types (upper nibble of the fixed header)
+#define MQTT_CONNECT     0x10
+#define MQTT_CONNACK     0x20
+#define MQTT_PUBLISH     0x30
+#define MQTT_PUBACK      0x40
+#define MQTT_SUBSCRIBE   0x82
+#define MQTT_SUBACK      0x90
+#define MQTT_UNSUBSCRIBE 0xA2
+#define MQTT_PINGREQ     0xC0
+#define MQTT_PINGRESP    0xD0
+#define MQTT_DISCONNECT  0xE0
+
+// Length of the packet at p, fixed header included. Only used on packets
+// we built ourselves, so the length field is well-formed.
+static size_t packetLength(const unsigned char *p) {
+    size_t len = 0;
+    size_t multiplier = 1;
+    size_t i = 1;
+
+    do {
+        len += (p[i] & 0x7F) * multiplier;
+        multiplier *= 128;
+    } while ((p[i++] & 0x80) && i < 5);
+    return i + len;
+}
+
+// Send as much of the outgoing queue as the socket takes. Caller holds writeLock.
+static int flushLocked(MqttClient *c) {
+    int result = 0;
+
+    while (c->txSent < c->txLen) {
+        ssize_t n = send(c->fd, c->tx + c->txSent, c->txLen - c->txSent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                c->connected = 0;
+                result = -1;
+            }
+            break;
+        }
+        c->txSent += (size_t)n;
+    }
+
+    // Drop the packets that went out completely. One the socket only took
+    // part of stays whole, so a reconnect can send it again.
+    size_t done = c->txSent;
+    if (done < c->txLen) {
+        done = 0;
+        while (done + packetLength(c->tx + done) <= c->txSent) {
+            done += packetLength(c->tx + done);
+        }
+    }
+    memmove(c->tx, c->tx + done, c->txLen - done);
+    c->txLen -= done;
+    c->txSent -= done;
+
+    return result;
+}
+
+// Queue bytes that the socket could not take right now (or that are held
+// back while corked), making room by flushing if the queue is full
+static int bufferTx(MqttClient *c, const unsigned char *buf, size_t len) {
+    if (c->txLen + len > MQTT_TX_BUFFER) {
+        if (flushLocked(c) < 0 || c->txLen + len > MQTT_TX_BUFFER) {
+            return -1;
+        }
+    }
+    memcpy(c->tx + c->txLen, buf, len);
+    c->txLen += len;
+    return 0;
+}
+
+// Write the whole buffer, retrying on partial writes. On a non-blocking
+// socket whatever does not fit is queued until mqttFlush() is called.
+static int writeAll(MqttClient *c, const unsigned char *buf, size_t len) {
+    int result = 0;
+
+    pthread_mutex_lock(&c->writeLock);
+
+    // Keep ordering: nothing goes out ahead of already queued bytes
+    if (c->txLen > 0 || c->corked) {
+        result = bufferTx(c, buf, len);
+        pthread_mutex_unlock(&c->writeLock);
+        return result;
+    }
+
+    size_t sent = 0;
+    while (sent < len) {
+        ssize_t n = send(c->fd, buf + sent, len - sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // Queued whole, with the part already out marked as sent
+                result = bufferTx(c, buf, len);
+                if (result == 0) {
+                    c->txSent = sent;
+                }
+                break;
+            }
+            c->connected = 0;
+            result = -1;
+            break;
+        }
+        sent += (size_t)n;
+    }
+    pthread_mutex_unlock(&c->writeLock);
+
+    return result;
+}
+
+int mqttFlush(MqttClient *c) {
+    int result;
+
+    pthread_mutex_lock(&c->writeLock);
+    result = flushLocked(c);
+    pthread_mutex_unlock(&c->writeLock);
+
+    return result;
+}
+
+void mqttCork(MqttClient *c, int corked) {
+    c->corked = corked;
+}
+
+size_t mqttPending(MqttClient *c) {
+    return c->txLen - c->txSent;
+}
+
+int mqttSetNonBlocking(MqttClient *c) {
+    int flags = fcntl(c->fd, F_GETFL, 0);
+    if (flags < 0) {
+        return -1;
+    }
+    return fcntl(c->fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+// Encode the "remaining length" field, returns the number of bytes used
+static size_t encodeLength(unsigned char *out, size_t len) {
+    size_t i = 0;
+    do {
+        unsigned char digit = len % 128;
+        len /= 128;
+        if (len > 0) {
+            digit |= 0x80;
+        }
+        out[i++] = digit;
+    } while (len > 0);
+    return i;
+}
+
+// Append a length-prefixed UTF-8 string
+static size_t putString(unsigned char *out, const char *s, size_t len) {
+    out[0] = (unsigned char)(len >> 8);
+    out[1] = (unsigned char)(len & 0xFF);
+    memcpy(out + 2, s, len);
+    return len + 2;
+}
+
+void mqttInit(MqttClient *c, const char *clientId, MqttMessageHandler onMessage, void *ctx) {
+    memset(c, 0, sizeof(*c));
+    c->fd = -1;
+    c->nextPacketId = 1;
+    snprintf(c->clientId, sizeof(c->clientId), "%s", clientId);
+    c->backoffMs = MQTT_BACKOFF_MIN_MS;
+    c->backoffSeed = (unsigned int)getpid() ^ (unsigned int)(uintptr_t)c;
+    c->onMessage = onMessage;
+    c->ctx = ctx;
+    pthread_mutex_init(&c->writeLock, NULL);
+}
+
+// Handle one complete packet sitting in the receive buffer
+static void handlePacket(MqttClient *c, unsigned char *pkt, unsigned char *body, size_t bodyLen) {
+    unsigned char type = pkt[0] & 0xF0;
+
+    if (type == MQTT_CONNACK) {
+        c->connected = (bodyLen >= 2 && body[1] == 0);
+        c->sessionPresent = c->connected && (body[0] & 0x01);
+        return;
+    }
+
+    if (type != MQTT_PUBLISH || bodyLen < 2) {
+        // SUBACK, PUBACK and PINGRESP carry nothing we act on
+        return;
+    }
+
+    int qos = (pkt[0] >> 1) & 0x03;
+    size_t topicLen = ((size_t)body[0] << 8) | body[1];
+    size_t offset = 2 + topicLen;
+    unsigned short packetId = 0;
+
+    if (offset > bodyLen) {
+        return;
+    }
+    if (qos > 0) {
+        if (offset + 2 > bodyLen) {
+            return;
+        }
+        packetId = (unsigned short)((body[offset] << 8) | body[offset + 1]);
+        offset += 2;
+    }
+
+    // Shift the topic over its length prefix so it can be NUL-terminated
+    // in place without touching the payload
+    char *topic = (char *)body;
+    memmove(topic, body + 2, topicLen);
+    topic[topicLen] = '\0';
+
+    // The byte after the payload belongs to the next packet (or is the
+    // spare byte at the end of rx), so save it around the callback
+    char *payload = (char *)body + offset;
+    size_t payloadLen = bodyLen - offset;
+    char saved = payload[payloadLen];
+    payload[payloadLen] = '\0';
+
+    if (c->onMessage) {
+        c->retained = pkt[0] & 0x01;
+        c->onMessage(topic, topicLen, payload, payloadLen, c->ctx);
+    }
+
+    payload[payloadLen] = saved;
+
+    if (qos == 1) {
+        unsigned char ack[4] = {MQTT_PUBACK, 2, (unsigned char)(packetId >> 8), (unsigned char)(packetId & 0xFF)};
+        writeAll(c, ack, sizeof(ack));
+    }
+}
+
+// Dispatch every complete packet in rx and keep any trailing partial one
+static void processBuffer(MqttClient *c) {
+    size_t pos = 0;
+
+    // The tail of a packet that could never fit, then framing resumes
+    if (c->rxSkip > 0) {
+        pos = c->rxSkip < c->rxLen ? c->rxSkip : c->rxLen;
+        c->rxSkip -= pos;
+    }
+
+    while (pos + 2 <= c->rxLen) {
+        size_t len = 0;
+        size_t multiplier = 1;
+        size_t i = pos + 1;
+        int complete = 0;
+
+        while (i < c->rxLen && i < pos + 5) {
+            len += (c->rx[i] & 0x7F) * multiplier;
+            multiplier *= 128;
+            if ((c->rx[i++] & 0x80) == 0) {
+                complete = 1;
+                break;
+            }
+        }
+
+        if (complete && i + len - pos > MQTT_RX_BUFFER) {
+            fprintf(stderr, "MQTT packet too large, dropping\n");
+            c->rxSkip = i + len - c->rxLen;
+            pos = c->rxLen;
+            break;
+        }
+        if (!complete || i + len > c->rxLen) {
+            break;
+        }
+
+        handlePacket(c, c->rx + pos, c->rx + i, len);
+        pos = i + len;
+    }
+
+    if (pos > 0) {
+        memmove(c->rx, c->rx + pos, c->rxLen - pos);
+        c->rxLen -= pos;
+    }
+}
+
+int mqttRead(MqttClient *c) {
+    ssize_t n;
+
+    do {
+        n = recv(c->fd, c->rx + c->rxLen, MQTT_RX_BUFFER - c->rxLen, 0);
+    } while (n < 0 && errno == EINTR);
+
+    if (n == 0) {
+        c->connected = 0;
+        return -1;
+    }
+    if (n < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        }
+        c->connected = 0;
+        return -1;
+    }
+
+    c->rxLen += (size_t)n;
+    processBuffer(c);
+    return (int)n;
+}
+
+// Copy the whole packets at the front of src that fit in room bytes, only
+// the PUBLISHes if publishOnly. Returns the bytes copied.
+static size_t copyPackets(unsigned char *dst, size_t room, const unsigned char *src, size_t len, int publishOnly) {
+    size_t copied = 0;
+    size_t pos = 0;
+
+    while (pos < len) {
+        size_t n = packetLength(src + pos);
+        if (!publishOnly || (src[pos] & 0xF0) == MQTT_PUBLISH) {
+            if (copied + n > room) {
+                break;
+            }
+            memcpy(dst + copied, src + pos, n);
+            copied += n;
+        }
+        pos += n;
+    }
+    return copied;
+}
+
+// Publish to keep for the next mqttConnect(). Returns -1 if there's no room.
+static int keepOffline(MqttClient *c, const unsigned char *pkt, size_t len) {
+    int result = -1;
+
+    pthread_mutex_lock(&c->writeLock);
+    if (c->offlineLen + len <= MQTT_OFFLINE_BUFFER) {
+        memcpy(c->offline + c->offlineLen, pkt, len);
+        c->offlineLen += len;
+        result = 0;
+    }
+    pthread_mutex_unlock(&c->writeLock);
+    return result;
+}
+
+// Reconnecting: the publishes the old connection never got out go ahead
+// of the ones made since. Subscriptions, pings and acks belong to the old
+// session and are dropped.
+static void keepUnsent(MqttClient *c) {
+    unsigned char kept[MQTT_OFFLINE_BUFFER];
+    size_t keptLen;
+
+    pthread_mutex_lock(&c->writeLock);
+    keptLen = copyPackets(kept, sizeof(kept), c->tx, c->txLen, 1);
+    keptLen += copyPackets(kept + keptLen, sizeof(kept) - keptLen, c->offline, c->offlineLen, 0);
+    memcpy(c->offline, kept, keptLen);
+    c->offlineLen = keptLen;
+    c->txLen = 0;
+    c->txSent = 0;
+    pthread_mutex_unlock(&c->writeLock);
+}
+
+// Send and receive timeouts on the socket; 0 turns them off
+static void setTimeouts(int fd, int ms) {
+    struct timeval tv = {ms / 1000, (ms % 1000) * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+int mqttConnect(MqttClient *c, const char *host, int port) {
+    struct addrinfo hints, *res, *ai;
+    char portStr[16];
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(portStr, sizeof(portStr), "%d", port > 0 ? port : MQTT_DEFAULT_PORT);
+
+    if (host == NULL || host[0] == '\0') {
+        host = "localhost";
+    }
+
+    if (getaddrinfo(host, portStr, &hints, &res) != 0) {
+        fprintf(stderr, "Could not resolve MQTT host %s\n", host);
+        return -1;
+    }
+
+    // Reconnecting: the old connection is dead
+    if (c->fd >= 0) {
+        close(c->fd);
+    }
+
+    c->fd = -1;
+    for (ai = res; ai != NULL; ai = ai->ai_next) {
+        c->fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (c->fd < 0) {
+            continue;
+        }
+        // Bounds the connect() below as well as the handshake
+        setTimeouts(c->fd, MQTT_CONNECT_TIMEOUT_MS);
+        if (connect(c->fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        close(c->fd);
+        c->fd = -1;
+    }
+    freeaddrinfo(res);
+
+    if (c->fd < 0) {
+        perror("MQTT connect failed");
+        return -1;
+    }
+
+    // Moves are tiny, don't let Nagle hold them back
+    int one = 1;
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    // CONNECT: protocol name, level 4, clean session unless persistent,
+    // keepalive, client id, then the will if there is one
+    unsigned char pkt[96 + 2 * MQTT_WILL_MAX];
+    unsigned char body[80 + 2 * MQTT_WILL_MAX];
+    size_t bodyLen = 0;
+    size_t idLen = strlen(c->clientId);
+    unsigned char flags = c->persistent ? 0 : 0x02;
+
+    if (c->willTopic[0] != '\0') {
+        flags |= 0x04 | (c->willRetain ? 0x20 : 0);
+    }
+
+    bodyLen += putString(body, "MQTT", 4);
+    body[bodyLen++] = 4;     // protocol level 3.1.1
+    body[bodyLen++] = flags;
+    body[bodyLen++] = MQTT_KEEPALIVE >> 8;
+    body[bodyLen++] = MQTT_KEEPALIVE & 0xFF;
+    bodyLen += putString(body + bodyLen, c->clientId, idLen);
+    if (flags & 0x04) {
+        bodyLen += putString(body + bodyLen, c->willTopic, strlen(c->willTopic));
+        bodyLen += putString(body + bodyLen, (const char *)c->will, c->willLen);
+    }
+
+    size_t len = 0;
+    pkt[len++] = MQTT_CONNECT;
+    len += encodeLength(pkt + len, bodyLen);
+    memcpy(pkt + len, body, bodyLen);
+    len += bodyLen;
+
+    // The handshake goes out now even on a corked client
+    int corked = c->corked;
+    c->corked = 0;
+    c->rxLen = 0;
+    c->rxSkip = 0;
+    c->connected = 0;
+    keepUnsent(c);
+    if (writeAll(c, pkt, len) < 0) {
+        c->corked = corked;
+        c->txLen = 0;
+        c->txSent = 0;
+        close(c->fd);
+        c->fd = -1;
+        return -1;
+    }
+
+    // Wait for the CONNACK before handing the connection out; 0 from the
+    // blocking socket means the timeout ran out
+    while (!c->connected) {
+        if (mqttRead(c) <= 0) {
+            fprintf(stderr, "MQTT broker refused the connection\n");
+            c->corked = corked;
+            c->txLen = 0;
+            c->txSent = 0;
+            close(c->fd);
+            c->fd = -1;
+            return -1;
+        }
+    }
+    setTimeouts(c->fd, 0);
+
+    // What was published while we were away, in order
+    if (c->offlineLen > 0 && writeAll(c, c->offline, c->offlineLen) == 0) {
+        c->offlineLen = 0;
+    }
+    c->corked = corked;
+    c->backoffMs = MQTT_BACKOFF_MIN_MS;
+
+    return 0;
+}
+
+void mqttSetPersistent(MqttClient *c, int persistent) {
+    c->persistent = persistent;
+}
+
+unsigned int mqttBackoff(MqttClient *c) {
+    unsigned int step = c->backoffMs;
+
+    c->backoffSeed = c->backoffSeed * 1103515245u + 12345u;
+    c->backoffMs = step * 2 < MQTT_BACKOFF_MAX_MS ? step * 2 : MQTT_BACKOFF_MAX_MS;
+    return step / 2 + (c->backoffSeed >> 16) % (step / 2 + 1);
+}
+
+int mqttSetWill(MqttClient *c, const char *topic, const void *payload, size_t len, int retain) {
+    if (strlen(topic) >= MQTT_WILL_MAX || len > MQTT_WILL_MAX) {
+        return -1;
+    }
+    snprintf(c->willTopic, sizeof(c->willTopic), "%s", topic);
+    memcpy(c->will, payload, len);
+    c->willLen = len;
+    c->willRetain = retain;
+    return 0;
+}
+
+int mqttSubscribe(MqttClient *c, const char *filter, int qos) {
+    unsigned char pkt[512];
+    size_t filterLen = strlen(filter);
+    size_t bodyLen = 2 + 2 + filterLen + 1;
+    size_t len = 0;
+
+    if (filterLen > sizeof(pkt) - 16) {
+        return -1;
+    }
+
+    unsigned short id = c->nextPacketId++;
+    if (c->nextPacketId == 0) {
+        c->nextPacketId = 1;
+    }
+
+    pkt[len++] = MQTT_SUBSCRIBE;
+    len += encodeLength(pkt + len, bodyLen);
+    pkt[len++] = (unsigned char)(id >> 8);
+    pkt[len++] = (unsigned char)(id & 0xFF);
+    len += putString(pkt + len, filter, filterLen);
+    pkt[len++] = (unsigned char)qos;
+
+    return writeAll(c, pkt, len);
+}
+
+int mqttUnsubscribe(MqttClient *c, const char *filter) {
+    unsigned char pkt[512];
+    size_t filterLen = strlen(filter);
+    size_t len = 0;
+
+    if (filterLen > sizeof(pkt) - 16) {
+        return -1;
+    }
+
+    unsigned short id = c->nextPacketId++;
+    if (c->nextPacketId == 0) {
+        c->nextPacketId = 1;
+    }
+
+    pkt[len++] = MQTT_UNSUBSCRIBE;
+    len += encodeLength(pkt + len, 2 + 2 + filterLen);
+    pkt[len++] = (unsigned char)(id >> 8);
+    pkt[len++] = (unsigned char)(id & 0xFF);
+    len += putString(pkt + len, filter, filterLen);
+
+    return writeAll(c, pkt, len);
+}
+
+int mqttPublish(MqttClient *c, const char *topic, const void *payload,
+                size_t payloadLen, int qos, int retain) {
+    unsigned char stackBuf[512];
+    unsigned char *pkt = stackBuf;
+    size_t topicLen = strlen(topic);
+    size_t bodyLen = 2 + topicLen + (qos > 0 ? 2 : 0) + payloadLen;
+    size_t len = 0;
+    int result;
+
+    if (bodyLen + 5 > sizeof(stackBuf)) {
+        pkt = malloc(bodyLen + 5);
+        if (pkt == NULL) {
+            return -1;
+        }
+    }
+
+    pkt[len++] = (unsigned char)(MQTT_PUBLISH | (qos << 1) | (retain ? 1 : 0));
+    len += encodeLength(pkt + len, bodyLen);
+    len += putString(pkt + len, topic, topicLen);
+    if (qos > 0) {
+        unsigned short id = c->nextPacketId++;
+        if (c->nextPacketId == 0) {
+            c->nextPacketId = 1;
+        }
+        pkt[len++] = (unsigned char)(id >> 8);
+        pkt[len++] = (unsigned char)(id & 0xFF);
+    }
+    memcpy(pkt + len, payload, payloadLen);
+    len += payloadLen;
+
+    // Kept for the next mqttConnect() while there is no connection, or
+    // when this write is what finds out it's gone
+    if (c->fd < 0 || !c->connected) {
+        result = keepOffline(c, pkt, len);
+    } else {
+        result = writeAll(c, pkt, len);
+        if (result < 0 && !c->connected) {
+            result = keepOffline(c, pkt, len);
+        }
+    }
+
+    if (pkt != stackBuf) {
+        free(pkt);
+    }
+    return result;
+}
+
+int mqttPublishString(MqttClient *c, const char *topic, const char *message) {
+    return mqttPublish(c, topic, message, strlen(message), 0, 0);
+}
+
+int mqttPing(MqttClient *c) {
+    unsigned char pkt[2] = {MQTT_PINGREQ, 0};
+    return writeAll(c, pkt, sizeof(pkt));
+}
+
+void mqttDisconnect(MqttClient *c) {
+    if (c->fd >= 0) {
+        unsigned char pkt[2] = {MQTT_DISCONNECT, 0};
+        int flags = fcntl(c->fd, F_GETFL, 0);
+        int drained;
+
+        // Blocking again, so what is still queued goes out ahead of the
+        // DISCONNECT, each send giving up after MQTT_CONNECT_TIMEOUT_MS
+        if (flags >= 0) {
+            fcntl(c->fd, F_SETFL, flags & ~O_NONBLOCK);
+        }
+        setTimeouts(c->fd, MQTT_CONNECT_TIMEOUT_MS);
+        c->corked = 0;
+        pthread_mutex_lock(&c->writeLock);
+        drained = c->connected && flushLocked(c) == 0 && c->txLen == 0;
+        pthread_mutex_unlock(&c->writeLock);
+
+        // Without the DISCONNECT the broker sends our will, which is right
+        // if the rest never made it either. Otherwise wait for the broker
+        // to close: closing with its messages unread would reset the
+        // connection and could lose what we just sent.
+        if (drained && writeAll(c, pkt, sizeof(pkt)) == 0) {
+            char discard[512];
+            shutdown(c->fd, SHUT_WR);
+            while (recv(c->fd, discard, sizeof(discard), 0) > 0) {
+            }
+        }
+        shutdown(c->fd, SHUT_RDWR);
+        close(c->fd);
+        c->fd = -1;
+        c->txLen = 0;
+        c->txSent = 0;
+    }
+    c->connected = 0;
+}
@@ -0,0 +1,145 @@
+// mqtt.h - Minimal MQTT 3.1.1 client
+// Keeps one long-lived TCP connection that is used for both publishing and
+// subscribing, so the game clients don't have to spawn mosquitto_pub/sub.
+
+#ifndef MQTT_H
+#define MQTT_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+#define MQTT_DEFAULT_PORT 1883
+#define MQTT_RX_BUFFER 8192
+#define MQTT_TX_BUFFER 65536
+#define MQTT_KEEPALIVE 60  // seconds
+#define MQTT_WILL_MAX 128  // will topic and will message, each
+#define MQTT_OFFLINE_BUFFER 8192      // publishes kept while disconnected
+#define MQTT_CONNECT_TIMEOUT_MS 2000  // TCP connect and CONNACK, each
+#define MQTT_BACKOFF_MIN_MS 10        // first reconnect delay, doubling from there
+#define MQTT_BACKOFF_MAX_MS 5000
+
+// Called once for every PUBLISH packet received from the broker.
+// topic and payload point into the receive buffer and are NUL-terminated;
+// they are only valid for the duration of the call.
+typedef void (*MqttMessageHandler)(const char *topic, size_t topicLen,
+                                   const char *payload, size_t payloadLen,
+                                   void *ctx);
+
+typedef struct {
+    int fd;
+    int connected;
+    unsigned short nextPacketId;
+    char clientId[64];
+
+    // Receive buffer, holds at most one partial packet between reads
+    unsigned char rx[MQTT_RX_BUFFER + 1];
+    size_t rxLen;
+    size_t rxSkip;  // rest of a packet too large for rx, discarded as it arrives
+
+    // Outgoing packets a non-blocking socket could not take yet; the first
+    // txSent bytes are out already (part of the first packet)
+    unsigned char tx[MQTT_TX_BUFFER];
+    size_t txLen;
+    size_t txSent;
+    int corked;
+
+    MqttMessageHandler onMessage;
+    void *ctx;
+
+    // Publishes made while disconnected, sent right after the next CONNACK
+    unsigned char offline[MQTT_OFFLINE_BUFFER];
+    size_t offlineLen;
+
+    // Persistent session (clean session off), and whether the broker
+    // still had ours at the last connect, subscriptions included
+    int persistent;
+    int sessionPresent;
+
+    // Reconnect delay, see mqttBackoff()
+    unsigned int backoffMs;
+    unsigned int backoffSeed;
+
+    // RETAIN flag of the message being handed to onMessage: set when the
+    // broker sends a stored message because we just subscribed
+    int retained;
+
+    // Sent with CONNECT when willTopic is set, see mqttSetWill()
+    char willTopic[MQTT_WILL_MAX];
+    unsigned char will[MQTT_WILL_MAX];
+    size_t willLen;
+    int willRetain;
+
+    // Serialises writes when more than one thread uses the connection
+    pthread_mutex_t writeLock;
+} MqttClient;
+
+// Set up the client structure; does not connect
+void mqttInit(MqttClient *c, const char *clientId, MqttMessageHandler onMessage, void *ctx);
+
+// Open the TCP connection and perform the CONNECT/CONNACK handshake,
+// giving up after MQTT_CONNECT_TIMEOUT_MS per step. Also reconnects a
+// client whose connection was lost (take its old fd out of any event loop
+// first): publishes the old connection never sent, then those made
+// meanwhile, go out first thing. The socket is blocking again afterwards.
+// Returns 0 on success, -1 on failure.
+int mqttConnect(MqttClient *c, const char *host, int port);
+
+// Ask the broker to keep our session (subscriptions, and QoS 1 messages
+// for us) across disconnects. Call before mqttConnect(); check
+// c->sessionPresent afterwards to see whether subscribing again is needed.
+void mqttSetPersistent(MqttClient *c, int persistent);
+
+// How long to wait before the next reconnect attempt: exponential backoff
+// from MQTT_BACKOFF_MIN_MS to MQTT_BACKOFF_MAX_MS, jittered between half
+// and all of the current step so clients don't return in lockstep. Reset
+// by a successful mqttConnect().
+unsigned int mqttBackoff(MqttClient *c);
+
+// Message the broker publishes (QoS 0) if the connection ends without
+// mqttDisconnect(). Call before mqttConnect(). Returns 0, or -1 if the
+// topic or message is longer than MQTT_WILL_MAX.
+int mqttSetWill(MqttClient *c, const char *topic, const void *payload, size_t len, int retain);
+
+// Subscribe to a topic filter (wildcards allowed). Returns 0 on success.
+int mqttSubscribe(MqttClient *c, const char *filter, int qos);
+
+// Drop a subscription made with the same filter. Returns 0 on success.
+int mqttUnsubscribe(MqttClient *c, const char *filter);
+
+// Publish a message. While disconnected, or if writing it finds the
+// connection gone, it is kept for the next connect, up to
+// MQTT_OFFLINE_BUFFER bytes. Returns 0 on success, -1 on failure.
+int mqttPublish(MqttClient *c, const char *topic, const void *payload,
+                size_t len, int qos, int retain);
+
+// Publish a NUL-terminated string payload with QoS 0
+int mqttPublishString(MqttClient *c, const char *topic, const char *message);
+
+// Read whatever is available on the socket and dispatch every complete
+// packet. Blocks if the socket is blocking. Returns the number of bytes
+// read, 0 if the call would block, or -1 when the connection is gone.
+int mqttRead(MqttClient *c);
+
+// Switch the socket to non-blocking mode for use with an event loop.
+// Call after mqttConnect().
+int mqttSetNonBlocking(MqttClient *c);
+
+// Try to send queued outgoing bytes. Returns -1 if the connection is gone.
+int mqttFlush(MqttClient *c);
+
+// While corked, publishes are only queued so a burst of them goes out in
+// one write at the next mqttFlush()
+void mqttCork(MqttClient *c, int corked);
+
+// Number of outgoing bytes still waiting for the socket
+size_t mqttPending(MqttClient *c);
+
+// Send a PINGREQ to keep the connection alive
+int mqttPing(MqttClient *c);
+
+// Send what is still queued, then DISCONNECT, and close the socket. Blocks
+// for up to MQTT_CONNECT_TIMEOUT_MS per send while the broker catches up;
+// if the queue can't be sent the DISCONNECT is left out, so the will goes.
+void mqttDisconnect(MqttClient *c);
+
+#endif
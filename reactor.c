@@ -0,0 +1,175 @@
+// reactor.c - Small epoll event loop
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include "reactor.h"
+
+#define REACTOR_MAX_EVENTS 64
+
+int reactorInit(Reactor *r) {
+    memset(r, 0, sizeof(*r));
+    r->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (r->epfd < 0) {
+        perror("epoll_create1 failed");
+        return -1;
+    }
+    return 0;
+}
+
+// Make sure sources[fd] exists
+static int growSources(Reactor *r, int fd) {
+    if (fd < r->sourceCount) {
+        return 0;
+    }
+
+    int count = r->sourceCount ? r->sourceCount : 16;
+    while (count <= fd) {
+        count *= 2;
+    }
+
+    ReactorSource *sources = realloc(r->sources, count * sizeof(ReactorSource));
+    if (sources == NULL) {
+        return -1;
+    }
+    memset(sources + r->sourceCount, 0, (count - r->sourceCount) * sizeof(ReactorSource));
+    r->sources = sources;
+    r->sourceCount = count;
+    return 0;
+}
+
+int reactorAdd(Reactor *r, int fd, unsigned int events, ReactorCallback cb, void *ctx) {
+    struct epoll_event ev;
+
+    if (fd < 0 || growSources(r, fd) < 0) {
+        return -1;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        return -1;
+    }
+
+    r->sources[fd].cb = cb;
+    r->sources[fd].ctx = ctx;
+    r->sources[fd].isTimer = 0;
+    return 0;
+}
+
+int reactorModify(Reactor *r, int fd, unsigned int events) {
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+    return epoll_ctl(r->epfd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+void reactorRemove(Reactor *r, int fd) {
+    if (fd < 0 || fd >= r->sourceCount) {
+        return;
+    }
+    epoll_ctl(r->epfd, EPOLL_CTL_DEL, fd, NULL);
+    r->sources[fd].cb = NULL;
+    r->sources[fd].ctx = NULL;
+}
+
+int reactorSetTimer(int timerFd, unsigned int initialMs, unsigned int intervalMs) {
+    struct itimerspec spec;
+
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = initialMs / 1000;
+    spec.it_value.tv_nsec = (long)(initialMs % 1000) * 1000000L;
+    spec.it_interval.tv_sec = intervalMs / 1000;
+    spec.it_interval.tv_nsec = (long)(intervalMs % 1000) * 1000000L;
+    return timerfd_settime(timerFd, 0, &spec, NULL);
+}
+
+int reactorAddTimer(Reactor *r, unsigned int intervalMs, ReactorCallback cb, void *ctx) {
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) {
+        perror("timerfd_create failed");
+        return -1;
+    }
+
+    if (reactorAdd(r, fd, EPOLLIN, cb, ctx) < 0) {
+        close(fd);
+        return -1;
+    }
+    r->sources[fd].isTimer = 1;
+
+    if (intervalMs > 0) {
+        reactorSetTimer(fd, intervalMs, intervalMs);
+    }
+    return fd;
+}
+
+void reactorRemoveTimer(Reactor *r, int timerFd) {
+    if (timerFd < 0) {
+        return;
+    }
+    reactorRemove(r, timerFd);
+    close(timerFd);
+}
+
+int reactorRunOnce(Reactor *r, int timeoutMs) {
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+    int n = epoll_wait(r->epfd, events, REACTOR_MAX_EVENTS, timeoutMs);
+
+    if (n < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+
+    for (int i = 0; i < n; i++) {
+        int fd = events[i].data.fd;
+
+        // The source may have been removed by an earlier callback
+        if (fd >= r->sourceCount || r->sources[fd].cb == NULL) {
+            continue;
+        }
+
+        if (r->sources[fd].isTimer) {
+            uint64_t expirations;
+            if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+                continue;
+            }
+        }
+
+        r->sources[fd].cb(fd, events[i].events, r->sources[fd].ctx);
+    }
+
+    return n;
+}
+
+int reactorRun(Reactor *r) {
+    r->running = 1;
+    while (r->running) {
+        if (reactorRunOnce(r, -1) < 0) {
+            perror("epoll_wait failed");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void reactorStop(Reactor *r) {
+    r->running = 0;
+}
+
+void reactorClose(Reactor *r) {
+    if (r->epfd >= 0) {
+        close(r->epfd);
+        r->epfd = -1;
+    }
+    free(r->sources);
+    r->sources = NULL;
+    r->sourceCount = 0;
+}
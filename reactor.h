@@ -0,0 +1,64 @@
+// reactor.h - Small epoll event loop
+// Multiplexes sockets, pipes, stdin and timers on one thread so messages
+// are handled the moment they arrive instead of by sleep-based polling.
+
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <sys/epoll.h>
+
+// Called when fd becomes ready; events is the epoll event mask.
+// For timers the expirations have already been read from the timerfd.
+typedef void (*ReactorCallback)(int fd, unsigned int events, void *ctx);
+
+typedef struct {
+    ReactorCallback cb;
+    void *ctx;
+    int isTimer;
+} ReactorSource;
+
+typedef struct {
+    int epfd;
+    int running;
+
+    // Indexed by file descriptor
+    ReactorSource *sources;
+    int sourceCount;
+} Reactor;
+
+// Create the epoll instance. Returns 0 on success, -1 on failure.
+int reactorInit(Reactor *r);
+
+// Watch fd for the given epoll events (EPOLLIN, EPOLLOUT, ...)
+int reactorAdd(Reactor *r, int fd, unsigned int events, ReactorCallback cb, void *ctx);
+
+// Change the events watched for an fd that was already added
+int reactorModify(Reactor *r, int fd, unsigned int events);
+
+// Stop watching fd. Does not close it.
+void reactorRemove(Reactor *r, int fd);
+
+// Create a timerfd that fires every intervalMs (0 = created disarmed).
+// Returns the timer fd, or -1 on failure.
+int reactorAddTimer(Reactor *r, unsigned int intervalMs, ReactorCallback cb, void *ctx);
+
+// Re-arm a timer: first expiry after initialMs, then every intervalMs.
+// initialMs of 0 disarms the timer.
+int reactorSetTimer(int timerFd, unsigned int initialMs, unsigned int intervalMs);
+
+// Remove and close a timer created with reactorAddTimer()
+void reactorRemoveTimer(Reactor *r, int timerFd);
+
+// Dispatch events until reactorStop() is called. Returns 0, or -1 on error.
+int reactorRun(Reactor *r);
+
+// Run one round of dispatching, waiting at most timeoutMs (-1 = forever)
+int reactorRunOnce(Reactor *r, int timeoutMs);
+
+// Make reactorRun() return after the current round of callbacks
+void reactorStop(Reactor *r);
+
+// Close the epoll instance
+void reactorClose(Reactor *r);
+
+#endif
@@ -0,0 +1,208 @@
+// screen.c - Double-buffered terminal renderer
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "screen.h"
+
+// Up to this many unchanged cells between two changed ones are rewritten
+// rather than jumped over, a cursor move costs about as many bytes
+#define SCREEN_MAX_GAP 4
+
+static const char *colorCodes[] = {
+    "\033[0m",     // SCREEN_DEFAULT
+    "\033[0;31m",  // SCREEN_RED
+    "\033[0;32m",  // SCREEN_GREEN
+    "\033[0;33m",  // SCREEN_YELLOW
+    "\033[0;34m",  // SCREEN_BLUE
+};
+
+void screenInit(Screen *s, int fd) {
+    memset(s, 0, sizeof(*s));
+    s->fd = fd;
+    screenClear(s);
+}
+
+void screenClear(Screen *s) {
+    memset(s->back.ch, ' ', sizeof(s->back.ch));
+    memset(s->back.color, SCREEN_DEFAULT, sizeof(s->back.color));
+}
+
+int screenPrint(Screen *s, int row, int col, int color, const char *fmt, ...) {
+    char text[SCREEN_COLS + 1];
+    va_list args;
+
+    if (row < 0 || row >= SCREEN_ROWS || col < 0) {
+        return col;
+    }
+
+    va_start(args, fmt);
+    vsnprintf(text, sizeof(text), fmt, args);
+    va_end(args);
+
+    for (const char *p = text; *p != '\0' && col < SCREEN_COLS; p++, col++) {
+        s->back.ch[row][col] = (*p >= ' ' && *p <= '~') ? *p : ' ';
+        s->back.color[row][col] = (unsigned char)color;
+    }
+    return col;
+}
+
+void screenSetCursor(Screen *s, int row, int col) {
+    s->cursorRow = row;
+    s->cursorCol = col;
+}
+
+void screenInvalidate(Screen *s) {
+    s->valid = 0;
+}
+
+void screenInvalidateRow(Screen *s, int row) {
+    if (row >= 0 && row < SCREEN_ROWS) {
+        // The back grid never holds NUL, so every cell compares as changed
+        // and the rest of the row gets erased
+        memset(s->front.ch[row], '\0', SCREEN_COLS);
+    }
+}
+
+static size_t appendText(Screen *s, size_t len, const char *text) {
+    size_t n = strlen(text);
+    if (len + n <= sizeof(s->out)) {
+        memcpy(s->out + len, text, n);
+        len += n;
+    }
+    return len;
+}
+
+static size_t appendCursor(Screen *s, size_t len, int row, int col) {
+    int n = snprintf(s->out + len, sizeof(s->out) - len, "\033[%d;%dH", row + 1, col + 1);
+    if (n > 0 && len + (size_t)n < sizeof(s->out)) {
+        len += (size_t)n;
+    }
+    return len;
+}
+
+// Emit one back-grid cell, switching color first if needed
+static size_t appendCell(Screen *s, size_t len, int row, int col, int *curColor) {
+    int color = s->back.color[row][col];
+
+    if (color != *curColor) {
+        len = appendText(s, len, colorCodes[color]);
+        *curColor = color;
+    }
+    if (len < sizeof(s->out)) {
+        s->out[len++] = s->back.ch[row][col];
+    }
+
+    s->front.ch[row][col] = s->back.ch[row][col];
+    s->front.color[row][col] = (unsigned char)color;
+    return len;
+}
+
+// Get the terminal cursor to (row, col): rewrite a short run of unchanged
+// cells, otherwise jump
+static size_t moveTo(Screen *s, size_t len, int row, int col, int *curRow, int *curCol, int *curColor) {
+    if (*curRow == row && *curCol <= col && col - *curCol <= SCREEN_MAX_GAP) {
+        while (*curCol < col) {
+            len = appendCell(s, len, row, (*curCol)++, curColor);
+        }
+    } else {
+        len = appendCursor(s, len, row, col);
+        *curRow = row;
+        *curCol = col;
+    }
+    return len;
+}
+
+// Columns up to the last cell that isn't a plain blank
+static int rowEnd(const ScreenGrid *g, int row) {
+    int end = SCREEN_COLS;
+
+    while (end > 0 && g->ch[row][end - 1] == ' ' && g->color[row][end - 1] == SCREEN_DEFAULT) {
+        end--;
+    }
+    return end;
+}
+
+static ssize_t writeAll(int fd, const char *buf, size_t len) {
+    size_t done = 0;
+
+    while (done < len) {
+        ssize_t n = write(fd, buf + done, len - done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    return (ssize_t)done;
+}
+
+ssize_t screenPresent(Screen *s) {
+    size_t len = 0;
+    int changed = 0;
+    int curRow = -1;    // terminal cursor, -1 when unknown
+    int curCol = -1;
+    int curColor = -1;  // terminal color, -1 when unknown
+
+    // No auto-wrap while drawing, so a line wider than the terminal is cut
+    // off instead of spilling onto the next row
+    len = appendText(s, len, "\033[?7l");
+
+    if (!s->valid) {
+        len = appendText(s, len, "\033[0m\033[H\033[2J");
+        memset(s->front.ch, ' ', sizeof(s->front.ch));
+        memset(s->front.color, SCREEN_DEFAULT, sizeof(s->front.color));
+        curRow = 0;
+        curCol = 0;
+        curColor = SCREEN_DEFAULT;
+        s->valid = 1;
+        changed = 1;
+    }
+
+    for (int row = 0; row < SCREEN_ROWS; row++) {
+        int backEnd = rowEnd(&s->back, row);
+        int frontEnd = rowEnd(&s->front, row);
+
+        for (int col = 0; col < backEnd; col++) {
+            if (s->front.ch[row][col] == s->back.ch[row][col] &&
+                s->front.color[row][col] == s->back.color[row][col]) {
+                continue;
+            }
+
+            len = moveTo(s, len, row, col, &curRow, &curCol, &curColor);
+            len = appendCell(s, len, row, col, &curColor);
+            curCol = col + 1;
+            changed = 1;
+        }
+
+        // The old line was longer: erase its tail in one go
+        if (frontEnd > backEnd) {
+            len = moveTo(s, len, row, backEnd, &curRow, &curCol, &curColor);
+            if (curColor != SCREEN_DEFAULT) {
+                len = appendText(s, len, colorCodes[SCREEN_DEFAULT]);
+                curColor = SCREEN_DEFAULT;
+            }
+            len = appendText(s, len, "\033[K");
+            memset(s->front.ch[row] + backEnd, ' ', (size_t)(SCREEN_COLS - backEnd));
+            memset(s->front.color[row] + backEnd, SCREEN_DEFAULT, (size_t)(SCREEN_COLS - backEnd));
+            changed = 1;
+        }
+    }
+
+    if (!changed) {
+        return 0;
+    }
+
+    if (curColor != SCREEN_DEFAULT) {
+        len = appendText(s, len, colorCodes[SCREEN_DEFAULT]);
+    }
+    len = appendCursor(s, len, s->cursorRow, s->cursorCol);
+    len = appendText(s, len, "\033[?7h");
+
+    return writeAll(s->fd, s->out, len);
+}
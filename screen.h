@@ -0,0 +1,65 @@
+// screen.h - Double-buffered terminal renderer
+// A frame is drawn into an off-screen grid of characters and colors.
+// Presenting it compares the grid with what is already on the terminal and
+// emits cursor moves, color changes and text only for the cells that
+// differ, all in one write(). Redrawing an unchanged board costs nothing,
+// and one moved piece costs a few bytes instead of a full clear-and-reprint.
+
+#ifndef SCREEN_H
+#define SCREEN_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define SCREEN_ROWS 24
+#define SCREEN_COLS 132
+
+// Worst case is every cell with its own color change
+#define SCREEN_OUT_SIZE (SCREEN_ROWS * (SCREEN_COLS * 8 + 16) + 64)
+
+// Cell colors
+#define SCREEN_DEFAULT 0
+#define SCREEN_RED     1
+#define SCREEN_GREEN   2
+#define SCREEN_YELLOW  3
+#define SCREEN_BLUE    4
+
+typedef struct {
+    char ch[SCREEN_ROWS][SCREEN_COLS];
+    unsigned char color[SCREEN_ROWS][SCREEN_COLS];
+} ScreenGrid;
+
+typedef struct {
+    int fd;
+    int valid;        // front matches the terminal; 0 repaints everything
+    ScreenGrid front; // what the terminal shows
+    ScreenGrid back;  // the frame being drawn
+    int cursorRow;    // where the cursor is left once the frame is shown
+    int cursorCol;
+    char out[SCREEN_OUT_SIZE];
+} Screen;
+
+void screenInit(Screen *s, int fd);
+
+// Start a new frame: blank the back grid
+void screenClear(Screen *s);
+
+// Draw formatted text at (row, col), clipped to the row.
+// Returns the column after the text.
+int screenPrint(Screen *s, int row, int col, int color, const char *fmt, ...)
+    __attribute__((format(printf, 5, 6)));
+
+// Where to leave the cursor (e.g. after a prompt)
+void screenSetCursor(Screen *s, int row, int col);
+
+// Something else wrote to the terminal: repaint everything next time
+void screenInvalidate(Screen *s);
+
+// Only this row is out of date (e.g. the user typed on it)
+void screenInvalidateRow(Screen *s, int row);
+
+// Show the back grid. Returns the number of bytes written, 0 if nothing
+// changed, -1 on a write error.
+ssize_t screenPresent(Screen *s);
+
+#endif
@@ -0,0 +1,130 @@
+// ttt.h - Shared Tic-Tac-Toe game core
+// Each player's marks are a 9-bit mask, bit (row * 3 + col), so the rules
+// boil down to a few AND/compare operations:
+//   legal move  - the cell's bit is not set in (x | o)
+//   win         - the mover's mask covers one of the 8 line masks
+//   draw        - (x | o) is the full board
+// Header-only so the ESP32 sketch, the Linux client and the server all
+// use the exact same rules.
+
+#ifndef TTT_H
+#define TTT_H
+
+#include <stdint.h>
+
+#define TTT_FULL_BOARD 0x1FF
+
+// Bit for a 0-indexed cell
+#define TTT_CELL(row, col) ((uint16_t)(1u << ((row) * 3 + (col))))
+
+// Game status
+#define TTT_PLAYING 0
+#define TTT_X_WINS  1
+#define TTT_O_WINS  2
+#define TTT_DRAW    3
+
+// Result of tttPlay()
+#define TTT_ILLEGAL -1
+#define TTT_MOVED    0
+#define TTT_WON      1
+#define TTT_DREW     2
+
+// The 8 winning lines
+static const uint16_t tttWinLines[8] = {
+    0x007, 0x038, 0x1C0,  // rows
+    0x049, 0x092, 0x124,  // columns
+    0x111, 0x054          // diagonals
+};
+
+typedef struct {
+    uint16_t x;       // X's marks
+    uint16_t o;       // O's marks
+    uint8_t player;   // side to move: 0 = X, 1 = O
+    uint8_t status;   // TTT_PLAYING, TTT_X_WINS, TTT_O_WINS or TTT_DRAW
+} TttBoard;
+
+// Does this set of marks complete a line?
+static inline int tttIsWin(uint16_t marks) {
+    int win = 0;
+    for (int i = 0; i < 8; i++) {
+        win |= (marks & tttWinLines[i]) == tttWinLines[i];
+    }
+    return win;
+}
+
+static inline int tttIsDraw(const TttBoard *b) {
+    return (b->x | b->o) == TTT_FULL_BOARD;
+}
+
+// Is cell (0..8) free?
+static inline int tttIsFree(const TttBoard *b, int cell) {
+    return ((b->x | b->o) & (1u << cell)) == 0;
+}
+
+// Mask of the empty cells
+static inline uint16_t tttEmpty(const TttBoard *b) {
+    return (uint16_t)(~(b->x | b->o) & TTT_FULL_BOARD);
+}
+
+static inline char tttPlayerChar(const TttBoard *b) {
+    return b->player ? 'O' : 'X';
+}
+
+// 'X', 'O' or ' ' for cell (0..8)
+static inline char tttCellChar(const TttBoard *b, int cell) {
+    uint16_t bit = (uint16_t)(1u << cell);
+    return (b->x & bit) ? 'X' : (b->o & bit) ? 'O' : ' ';
+}
+
+static inline void tttReset(TttBoard *b) {
+    b->x = 0;
+    b->o = 0;
+    b->player = 0;
+    b->status = TTT_PLAYING;
+}
+
+// Play cell (0..8) for the side to move. On a plain move the turn passes
+// to the other player; after a win or draw the status is set and the
+// winner stays as player, like makeMove() on the ESP32.
+static inline int tttPlay(TttBoard *b, int cell) {
+    if (b->status != TTT_PLAYING || cell < 0 || cell > 8 || !tttIsFree(b, cell)) {
+        return TTT_ILLEGAL;
+    }
+
+    uint16_t *marks = b->player ? &b->o : &b->x;
+    *marks |= (uint16_t)(1u << cell);
+
+    if (tttIsWin(*marks)) {
+        b->status = b->player ? TTT_O_WINS : TTT_X_WINS;
+        return TTT_WON;
+    }
+    if (tttIsDraw(b)) {
+        b->status = TTT_DRAW;
+        return TTT_DREW;
+    }
+
+    b->player ^= 1;
+    return TTT_MOVED;
+}
+
+// Write the 9-char board string used on TTT/board (no terminator)
+static inline void tttToString(const TttBoard *b, char *out) {
+    for (int i = 0; i < 9; i++) {
+        out[i] = tttCellChar(b, i);
+    }
+}
+
+// Read a 9-char board string; anything other than X/O counts as empty
+static inline void tttFromString(TttBoard *b, const char *s) {
+    b->x = 0;
+    b->o = 0;
+    for (int i = 0; i < 9 && s[i] != '\0'; i++) {
+        if (s[i] == 'X') {
+            b->x |= (uint16_t)(1u << i);
+        } else if (s[i] == 'O') {
+            b->o |= (uint16_t)(1u << i);
+        }
+    }
+}
+
+#endif
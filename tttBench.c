@@ -0,0 +1,419 @@
+// tttBench.c - Load generator and throughput benchmark for the MQTT game loop
+// Simulates N autoplay clients, each with its own broker connection and its
+// own game (TTT/<prefix><n>, as hosted by tttServer), using the normal
+// "row,col" / "r" protocol. A client sends its next move as soon as the
+// board echo (TTT/.../state, or TTT/.../board from text-mode hosts) for
+// the previous one arrives, so the run measures what the broker and game
+// host can sustain. Results are printed as one JSON object.
+// A client that loses the broker reconnects with mqttBackoff() and starts
+// a new game; the longest time from losing the connection to the next
+// board echo is reported as outage_ms, see bench/reconnect.sh.
+//
+//   ./tttBench -c 50 -d 10 > result.json
+//   ./tttBench -L -d 10          # one client on the legacy TTT game (ESP32)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "mqtt.h"
+#include "reactor.h"
+#include "ttt.h"
+#include "tttWire.h"
+#include "tttTopics.h"
+
+// MQTT Configuration
+#define MQTT_HOST "" // Add your MQTT broker address here (empty means localhost)
+#define MQTT_PORT 1883
+#define MQTT_TOPIC "TTT"
+
+typedef struct {
+    MqttClient mqtt;
+    char topic[64];        // TTT/<gameId>, states arrive under it
+    char commandTopic[80]; // where moves are sent, the game's partition topic
+    TttBoard board;        // last board seen
+    TttBoard expected;     // board we expect after our pending move
+    int waiting;           // a move is in flight
+    double sentAt;
+    int haveSeq;
+    uint16_t lastSeq;      // sequence number of the last TTT/.../state
+    unsigned int seed;
+    int reconnectTimer;
+    int recovering;        // reconnecting, or waiting for the first echo since
+    double lostAt;
+} BenchClient;
+
+const char *mqttHost = MQTT_HOST;
+int mqttPort = MQTT_PORT;
+const char *gamePrefix = "bench";
+const char *outputPath = NULL;
+int clientCount = 10;
+int legacyGame = 0;
+double duration = 10.0;
+double timeout = 2.0;
+double recoveryRetry = 0.05;  // resend "r" this often until a recovering client hears back
+
+Reactor reactor;
+BenchClient *clients = NULL;
+int measuring = 0;
+
+// Results
+unsigned long long movesSent = 0;
+unsigned long long movesEchoed = 0;
+unsigned long long rejected = 0;
+unsigned long long duplicates = 0;
+unsigned long long timeouts = 0;
+unsigned long long gamesFinished = 0;
+unsigned long long reconnects = 0;
+double maxOutage = 0;
+uint32_t *latencies = NULL;  // microseconds
+size_t latencyCount = 0;
+size_t latencyCapacity = 0;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void recordLatency(double seconds) {
+    if (latencyCount == latencyCapacity) {
+        size_t capacity = latencyCapacity ? latencyCapacity * 2 : 65536;
+        uint32_t *grown = realloc(latencies, capacity * sizeof(uint32_t));
+        if (grown == NULL) {
+            return;
+        }
+        latencies = grown;
+        latencyCapacity = capacity;
+    }
+    latencies[latencyCount++] = (uint32_t)(seconds * 1e6);
+}
+
+static int compareLatency(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t percentile(double p) {
+    if (latencyCount == 0) {
+        return 0;
+    }
+    size_t i = (size_t)(p / 100.0 * (double)(latencyCount - 1) + 0.5);
+    return latencies[i];
+}
+
+static void flushClient(BenchClient *c) {
+    mqttFlush(&c->mqtt);
+    reactorModify(&reactor, c->mqtt.fd, EPOLLIN | (mqttPending(&c->mqtt) > 0 ? EPOLLOUT : 0));
+}
+
+// Send a random legal move for whoever is to move
+static void sendMove(BenchClient *c) {
+    uint16_t empty = tttEmpty(&c->board);
+
+    if (empty == 0) {
+        return;
+    }
+
+    c->seed = c->seed * 1103515245u + 12345u;
+    int skip = (int)((c->seed >> 16) % (unsigned int)__builtin_popcount(empty));
+    while (skip-- > 0) {
+        empty &= (uint16_t)(empty - 1);
+    }
+    int cell = __builtin_ctz(empty);
+
+    char move[4] = {(char)('1' + cell / 3), ',', (char)('1' + cell % 3), '\0'};
+    c->expected = c->board;
+    tttPlay(&c->expected, cell);
+    c->waiting = 1;
+    c->sentAt = now();
+
+    mqttPublish(&c->mqtt, c->commandTopic, move, 3, 0, 0);
+    if (measuring) {
+        movesSent++;
+    }
+}
+
+static void sendReset(BenchClient *c) {
+    c->waiting = 0;
+    mqttPublish(&c->mqtt, c->commandTopic, "r", 1, 0, 0);
+}
+
+static int endsWith(const char *s, size_t len, const char *suffix) {
+    size_t n = strlen(suffix);
+    return len >= n && memcmp(s + len - n, suffix, n) == 0;
+}
+
+void onMessage(const char *topic, size_t topicLen, const char *payload, size_t payloadLen, void *ctx) {
+    BenchClient *c = ctx;
+
+    if (endsWith(topic, topicLen, "/moves")) {
+        // An echo for a cell we already saw taken means a duplicate delivery
+        if (payloadLen >= 3 && measuring) {
+            int cell = (payload[0] - '1') * 3 + (payload[2] - '1');
+            if (cell >= 0 && cell < 9 && !tttIsFree(&c->board, cell)) {
+                duplicates++;
+            }
+        }
+        return;
+    }
+
+    if (endsWith(topic, topicLen, "/state")) {
+        TttState state;
+        if (tttWireDecode((const uint8_t *)payload, payloadLen, &state) < 0) {
+            return;
+        }
+        uint16_t seq = state.seq;
+        c->board = state.board;
+        if (c->recovering) {
+            c->recovering = 0;
+            if (now() - c->lostAt > maxOutage) {
+                maxOutage = now() - c->lostAt;
+            }
+        }
+        // The same state twice means the broker delivered it twice
+        if (c->haveSeq && seq == c->lastSeq) {
+            if (measuring) {
+                duplicates++;
+            }
+            return;
+        }
+        c->haveSeq = 1;
+        c->lastSeq = seq;
+    } else if (endsWith(topic, topicLen, "/board") && payloadLen >= 9 && !c->haveSeq) {
+        // Only hosts without TTT/.../state; in compatibility mode the
+        // board would echo the same move a second time
+        tttFromString(&c->board, payload);
+        c->board.player = __builtin_popcount(c->board.x) > __builtin_popcount(c->board.o);
+        c->board.status = TTT_PLAYING;
+        if (tttIsWin(c->board.x) || tttIsWin(c->board.o) || tttIsDraw(&c->board)) {
+            c->board.status = TTT_DRAW;  // any finished state, the host resets next
+        }
+    } else {
+        return;
+    }
+
+    if (c->waiting) {
+        c->waiting = 0;
+        if (measuring) {
+            movesEchoed++;
+            recordLatency(now() - c->sentAt);
+            if (c->board.x != c->expected.x || c->board.o != c->expected.o) {
+                rejected++;
+            }
+        }
+    }
+
+    // Finished game: the host starts the next one and sends a fresh board
+    if (c->board.status != TTT_PLAYING) {
+        if (measuring) {
+            gamesFinished++;
+        }
+        return;
+    }
+
+    sendMove(c);
+}
+
+void onClientEvent(int fd, unsigned int events, void *ctx);
+
+// Reconnect after the backoff, then start a new game
+void onReconnectTimer(int fd, unsigned int events, void *ctx) {
+    BenchClient *c = ctx;
+    char filter[80];
+
+    if (mqttConnect(&c->mqtt, mqttHost, mqttPort) < 0) {
+        reactorSetTimer(c->reconnectTimer, mqttBackoff(&c->mqtt), 0);
+        return;
+    }
+    snprintf(filter, sizeof(filter), "%s/+", c->topic);
+    mqttSubscribe(&c->mqtt, filter, 0);
+    mqttSetNonBlocking(&c->mqtt);
+    reactorAdd(&reactor, c->mqtt.fd, EPOLLIN, onClientEvent, c);
+    reconnects++;
+
+    // The host may be back later than the broker; onTimeoutTimer repeats it
+    sendReset(c);
+    c->sentAt = now();
+    flushClient(c);
+}
+
+void onClientEvent(int fd, unsigned int events, void *ctx) {
+    BenchClient *c = ctx;
+
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        int n;
+        while ((n = mqttRead(&c->mqtt)) > 0) {
+        }
+        if (n < 0) {
+            reactorRemove(&reactor, fd);
+            c->waiting = 0;
+            c->recovering = 1;
+            c->lostAt = now();
+            reactorSetTimer(c->reconnectTimer, mqttBackoff(&c->mqtt), 0);
+            return;
+        }
+    }
+    flushClient(c);
+}
+
+// Restart clients whose move never got an answer
+void onTimeoutTimer(int fd, unsigned int events, void *ctx) {
+    double t = now();
+
+    for (int i = 0; i < clientCount; i++) {
+        BenchClient *c = &clients[i];
+        if (c->recovering && c->mqtt.connected && t - c->sentAt > recoveryRetry) {
+            sendReset(c);
+            c->sentAt = t;
+            flushClient(c);
+        } else if (c->waiting && t - c->sentAt > timeout) {
+            if (measuring) {
+                timeouts++;
+            }
+            sendReset(c);
+            flushClient(c);
+        }
+    }
+}
+
+void onKeepaliveTimer(int fd, unsigned int events, void *ctx) {
+    for (int i = 0; i < clientCount; i++) {
+        if (clients[i].mqtt.connected) {
+            mqttPing(&clients[i].mqtt);
+        }
+    }
+}
+
+void onDurationTimer(int fd, unsigned int events, void *ctx) {
+    reactorStop(&reactor);
+}
+
+void printResults(FILE *out, double elapsed) {
+    qsort(latencies, latencyCount, sizeof(uint32_t), compareLatency);
+
+    fprintf(out, "{\"clients\":%d,\"duration_s\":%.3f,\"moves_sent\":%llu,\"moves_echoed\":%llu,"
+            "\"moves_per_sec\":%.1f,\"games_finished\":%llu,",
+            clientCount, elapsed, movesSent, movesEchoed, movesEchoed / elapsed, gamesFinished);
+    fprintf(out, "\"latency_us\":{\"p50\":%u,\"p90\":%u,\"p99\":%u,\"p999\":%u,\"max\":%u},",
+            percentile(50), percentile(90), percentile(99), percentile(99.9), percentile(100));
+    fprintf(out, "\"rejected\":%llu,\"duplicates\":%llu,\"timeouts\":%llu,\"reconnects\":%llu,\"outage_ms\":%.1f}\n",
+            rejected, duplicates, timeouts, reconnects, maxOutage * 1000);
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+
+    while ((opt = getopt(argc, argv, "h:p:c:d:g:t:o:L")) != -1) {
+        switch (opt) {
+        case 'h':
+            mqttHost = optarg;
+            break;
+        case 'p':
+            mqttPort = atoi(optarg);
+            break;
+        case 'c':
+            clientCount = atoi(optarg);
+            break;
+        case 'd':
+            duration = atof(optarg);
+            break;
+        case 'g':
+            gamePrefix = optarg;
+            break;
+        case 't':
+            timeout = atof(optarg);
+            break;
+        case 'o':
+            outputPath = optarg;
+            break;
+        case 'L':
+            legacyGame = 1;
+            clientCount = 1;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-h host] [-p port] [-c clients] [-d seconds] [-g gamePrefix] "
+                    "[-t timeoutSeconds] [-o result.json] [-L]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (clientCount < 1 || reactorInit(&reactor) < 0) {
+        return 1;
+    }
+
+    clients = calloc((size_t)clientCount, sizeof(BenchClient));
+    if (clients == NULL) {
+        fprintf(stderr, "Out of memory for %d clients\n", clientCount);
+        return 1;
+    }
+
+    for (int i = 0; i < clientCount; i++) {
+        BenchClient *c = &clients[i];
+        char clientId[48];
+        char filter[80];
+
+        if (legacyGame) {
+            snprintf(c->topic, sizeof(c->topic), "%s", MQTT_TOPIC);
+            snprintf(c->commandTopic, sizeof(c->commandTopic), "%s", MQTT_TOPIC);
+        } else {
+            char id[48];
+            snprintf(id, sizeof(id), "%s%d", gamePrefix, i);
+            snprintf(c->topic, sizeof(c->topic), "%s/%s", MQTT_TOPIC, id);
+            if (tttCommandTopic(c->commandTopic, sizeof(c->commandTopic), MQTT_TOPIC, id) < 0) {
+                fprintf(stderr, "Game id %s is too long\n", id);
+                return 1;
+            }
+        }
+        snprintf(filter, sizeof(filter), "%s/+", c->topic);
+        snprintf(clientId, sizeof(clientId), "TTT_bench_%d_%d", (int)getpid(), i);
+
+        c->seed = (unsigned int)(i * 2654435761u) ^ (unsigned int)getpid();
+        tttReset(&c->board);
+
+        mqttInit(&c->mqtt, clientId, onMessage, c);
+        if (mqttConnect(&c->mqtt, mqttHost, mqttPort) < 0) {
+            return 1;
+        }
+        mqttSubscribe(&c->mqtt, filter, 0);
+        mqttSetNonBlocking(&c->mqtt);
+        reactorAdd(&reactor, c->mqtt.fd, EPOLLIN, onClientEvent, c);
+        c->reconnectTimer = reactorAddTimer(&reactor, 0, onReconnectTimer, c);
+    }
+
+    reactorAddTimer(&reactor, 10, onTimeoutTimer, NULL);
+    reactorAddTimer(&reactor, MQTT_KEEPALIVE * 1000 / 2, onKeepaliveTimer, NULL);
+    reactorAddTimer(&reactor, (unsigned int)(duration * 1000), onDurationTimer, NULL);
+
+    // Every client starts from a fresh game; its board echo starts the loop
+    measuring = 1;
+    double start = now();
+    for (int i = 0; i < clientCount; i++) {
+        sendReset(&clients[i]);
+    }
+
+    reactorRun(&reactor);
+    double elapsed = now() - start;
+    measuring = 0;
+
+    for (int i = 0; i < clientCount; i++) {
+        mqttDisconnect(&clients[i].mqtt);
+    }
+
+    printResults(stdout, elapsed);
+    if (outputPath != NULL) {
+        FILE *out = fopen(outputPath, "w");
+        if (out == NULL) {
+            perror("Cannot write results");
+            return 1;
+        }
+        printResults(out, elapsed);
+        fclose(out);
+    }
+
+    return 0;
+}
@@ -0,0 +1,1100 @@
+// tttBroker.c - Minimal MQTT 3.1.1 broker for local testing and benchmarks
+// Covers what TicTacToe.ino (PubSubClient), mqtt.c and mosquitto_pub/sub
+// use: CONNECT, PUBLISH at QoS 0 and 1, SUBSCRIBE/UNSUBSCRIBE with + and #
+// wildcards, retained messages, wills, PINGREQ and DISCONNECT. Sessions
+// are always clean: QoS 1 messages are acknowledged and delivered with a
+// packet id, but nothing is kept for clients that are gone or sent twice
+// (a client asking for a persistent session gets a CONNACK without
+// "session present").
+// Keepalives are not enforced, so a will goes out when the connection
+// breaks or is replaced, not when a client merely goes quiet.
+//
+// One thread on reactor.c. Subscriptions live in a topic tree, so routing a
+// message costs a hash lookup per topic level, whatever the number of
+// subscribers. Everything queued while handling one read goes out in one
+// write per client.
+//
+//   ./tttBroker                 # 127.0.0.1:1883
+//   ./tttBroker -h 0.0.0.0      # reachable by the ESP32 too
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "reactor.h"
+
+#define DEFAULT_PORT 1883
+#define READ_CHUNK 65536
+#define MAX_PACKET (1 << 20)          // anything larger closes the connection
+#define MAX_TX_BACKLOG (64u << 20)    // a client this far behind is dropped
+#define MAX_FILTERS 100               // per SUBSCRIBE, keeps the SUBACK length in one byte
+
+// Control packet types (upper nibble of the fixed header)
+#define MQTT_CONNECT     0x10
+#define MQTT_CONNACK     0x20
+#define MQTT_PUBLISH     0x30
+#define MQTT_PUBACK      0x40
+#define MQTT_SUBSCRIBE   0x80
+#define MQTT_SUBACK      0x90
+#define MQTT_UNSUBSCRIBE 0xA0
+#define MQTT_UNSUBACK    0xB0
+#define MQTT_PINGREQ     0xC0
+#define MQTT_PINGRESP    0xD0
+#define MQTT_DISCONNECT  0xE0
+
+typedef struct Client Client;
+
+typedef struct {
+    Client *client;
+    uint8_t qos;
+} Subscriber;
+
+// One topic level in the subscription tree. Children are found through
+// childSlots by (parent, name); "+" and "#" are ordinary children.
+typedef struct {
+    uint32_t parent;
+    uint32_t hash;
+    char *name;
+    size_t nameLen;
+    Subscriber *subs;
+    int subCount;
+    int subCap;
+} Node;
+
+struct Client {
+    int fd;
+    int connected;      // CONNECT seen
+    int closing;        // closed by flushDirty()
+    int dirty;          // on the dirty list
+    int watchingOut;    // EPOLLOUT is on
+    uint16_t nextPacketId;
+    uint64_t lastMessage;  // last message delivered, so overlapping subscriptions deliver once
+    char clientId[64];
+
+    unsigned char *rx;
+    size_t rxLen, rxCap;
+    unsigned char *tx;
+    size_t txLen, txCap;
+
+    uint32_t *nodes;    // subscribed to, for cleanup
+    int nodeCount, nodeCap;
+
+    // Will from CONNECT, published by closeClient() unless the client
+    // sent DISCONNECT. One allocation: the topic, then the payload.
+    char *willTopic;
+    size_t willTopicLen, willLen;
+    uint8_t willQos, willRetain;
+};
+
+typedef struct Retained {
+    struct Retained *next;
+    uint32_t hash;
+    uint8_t qos;
+    size_t topicLen;
+    size_t len;
+    char *topic;
+    unsigned char *payload;
+} Retained;
+
+const char *listenHost = "127.0.0.1";
+int listenPort = DEFAULT_PORT;
+int quiet = 0;
+
+Reactor reactor;
+int listenFd = -1;
+
+Client **clients = NULL;   // by file descriptor
+int clientCap = 0;
+int clientCount = 0;
+
+// Node 0 is the root; a 0 in childSlots is an empty slot
+Node *nodes = NULL;
+uint32_t nodeCount = 0, nodeCap = 0;
+uint32_t *childSlots = NULL;
+uint32_t childMask = 0;
+
+Retained **retainedBuckets = NULL;
+uint32_t retainedMask = 0;
+uint32_t retainedCount = 0;
+
+// Clients with queued output, written at the end of each callback
+Client **dirtyClients = NULL;
+int dirtyCount = 0, dirtyCap = 0;
+
+uint64_t messageNumber = 0;
+unsigned long long messagesIn = 0;
+unsigned long long messagesOut = 0;
+
+// FNV-1a over a topic level, seeded with its parent; never 0
+static uint32_t hashLevel(uint32_t parent, const char *name, size_t len) {
+    uint32_t h = 2166136261u ^ (parent * 16777619u);
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return h ? h : 1;
+}
+
+static uint32_t hashTopic(const char *topic, size_t len) {
+    return hashLevel(0xFFFFFFFFu, topic, len);
+}
+
+static void *growArray(void *array, int *cap, size_t elem, int need) {
+    if (need <= *cap) {
+        return array;
+    }
+    int next = *cap ? *cap * 2 : 8;
+    while (next < need) {
+        next *= 2;
+    }
+    void *grown = realloc(array, (size_t)next * elem);
+    if (grown == NULL) {
+        perror("realloc");
+        exit(1);
+    }
+    *cap = next;
+    return grown;
+}
+
+// ---- Subscription tree ----
+
+static void insertChildSlot(uint32_t node) {
+    uint32_t i = nodes[node].hash & childMask;
+    while (childSlots[i] != 0) {
+        i = (i + 1) & childMask;
+    }
+    childSlots[i] = node;
+}
+
+// Child of parent called name, created if create is set. 0 if none.
+static uint32_t findChild(uint32_t parent, const char *name, size_t len, int create) {
+    uint32_t h = hashLevel(parent, name, len);
+
+    if (childMask != 0) {
+        for (uint32_t i = h & childMask; childSlots[i] != 0; i = (i + 1) & childMask) {
+            Node *n = &nodes[childSlots[i]];
+            if (n->hash == h && n->parent == parent && n->nameLen == len && memcmp(n->name, name, len) == 0) {
+                return childSlots[i];
+            }
+        }
+    }
+    if (!create) {
+        return 0;
+    }
+
+    // Keep the table at most half full
+    if ((nodeCount + 1) * 2 > childMask + 1) {
+        uint32_t size = childMask ? (childMask + 1) * 2 : 64;
+        free(childSlots);
+        childSlots = calloc(size, sizeof(uint32_t));
+        if (childSlots == NULL) {
+            perror("calloc");
+            exit(1);
+        }
+        childMask = size - 1;
+        for (uint32_t n = 1; n < nodeCount; n++) {
+            insertChildSlot(n);
+        }
+    }
+
+    int cap = (int)nodeCap;
+    nodes = growArray(nodes, &cap, sizeof(Node), (int)nodeCount + 1);
+    nodeCap = (uint32_t)cap;
+
+    uint32_t index = nodeCount++;
+    Node *n = &nodes[index];
+    memset(n, 0, sizeof(*n));
+    n->parent = parent;
+    n->hash = h;
+    n->name = malloc(len + 1);
+    memcpy(n->name, name, len);
+    n->nameLen = len;
+    insertChildSlot(index);
+    return index;
+}
+
+// Node 0, the root of the subscription tree
+static void initTree() {
+    int cap = 0;
+
+    nodes = growArray(NULL, &cap, sizeof(Node), 1);
+    nodeCap = (uint32_t)cap;
+    memset(&nodes[0], 0, sizeof(Node));
+    nodeCount = 1;
+}
+
+// Walk (or build) the tree along a filter, returns its last node
+static uint32_t filterNode(const char *filter, size_t len, int create) {
+    uint32_t node = 0;
+    size_t pos = 0;
+
+    for (;;) {
+        const char *slash = memchr(filter + pos, '/', len - pos);
+        size_t end = slash ? (size_t)(slash - filter) : len;
+
+        node = findChild(node, filter + pos, end - pos, create);
+        if (node == 0 || slash == NULL) {
+            return node;
+        }
+        pos = end + 1;
+    }
+}
+
+// + and # must fill a whole level, and # must be the last one
+static int validFilter(const char *filter, size_t len) {
+    if (len == 0) {
+        return 0;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (filter[i] != '+' && filter[i] != '#') {
+            continue;
+        }
+        if ((i > 0 && filter[i - 1] != '/') || (i + 1 < len && filter[i + 1] != '/')) {
+            return 0;
+        }
+        if (filter[i] == '#' && i + 1 != len) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void subscribe(Client *c, const char *filter, size_t len, uint8_t qos) {
+    uint32_t index = filterNode(filter, len, 1);
+    Node *n = &nodes[index];
+
+    for (int i = 0; i < n->subCount; i++) {
+        if (n->subs[i].client == c) {
+            n->subs[i].qos = qos;
+            return;
+        }
+    }
+    n->subs = growArray(n->subs, &n->subCap, sizeof(Subscriber), n->subCount + 1);
+    n->subs[n->subCount].client = c;
+    n->subs[n->subCount].qos = qos;
+    n->subCount++;
+
+    c->nodes = growArray(c->nodes, &c->nodeCap, sizeof(uint32_t), c->nodeCount + 1);
+    c->nodes[c->nodeCount++] = index;
+}
+
+static void removeSubscriber(uint32_t index, Client *c) {
+    Node *n = &nodes[index];
+
+    for (int i = 0; i < n->subCount; i++) {
+        if (n->subs[i].client == c) {
+            n->subs[i] = n->subs[--n->subCount];
+            return;
+        }
+    }
+}
+
+static void unsubscribe(Client *c, const char *filter, size_t len) {
+    uint32_t index = filterNode(filter, len, 0);
+
+    if (index == 0) {
+        return;
+    }
+    removeSubscriber(index, c);
+    for (int i = 0; i < c->nodeCount; i++) {
+        if (c->nodes[i] == index) {
+            c->nodes[i] = c->nodes[--c->nodeCount];
+            break;
+        }
+    }
+}
+
+// ---- Retained messages ----
+
+static Retained **retainedSlot(const char *topic, size_t len, uint32_t h) {
+    Retained **slot = &retainedBuckets[h & retainedMask];
+
+    while (*slot != NULL &&
+           ((*slot)->hash != h || (*slot)->topicLen != len || memcmp((*slot)->topic, topic, len) != 0)) {
+        slot = &(*slot)->next;
+    }
+    return slot;
+}
+
+// Store the last retained message of a topic; an empty one deletes it
+static void retain(const char *topic, size_t topicLen, const unsigned char *payload, size_t len, uint8_t qos) {
+    uint32_t h = hashTopic(topic, topicLen);
+
+    if (retainedBuckets == NULL || retainedCount > retainedMask) {
+        uint32_t size = retainedBuckets ? (retainedMask + 1) * 2 : 1024;
+        Retained **buckets = calloc(size, sizeof(Retained *));
+        if (buckets == NULL) {
+            perror("calloc");
+            exit(1);
+        }
+        for (uint32_t b = 0; retainedBuckets != NULL && b <= retainedMask; b++) {
+            Retained *r = retainedBuckets[b];
+            while (r != NULL) {
+                Retained *next = r->next;
+                r->next = buckets[r->hash & (size - 1)];
+                buckets[r->hash & (size - 1)] = r;
+                r = next;
+            }
+        }
+        free(retainedBuckets);
+        retainedBuckets = buckets;
+        retainedMask = size - 1;
+    }
+
+    Retained **slot = retainedSlot(topic, topicLen, h);
+    Retained *r = *slot;
+
+    if (len == 0) {
+        if (r != NULL) {
+            *slot = r->next;
+            free(r->topic);
+            free(r->payload);
+            free(r);
+            retainedCount--;
+        }
+        return;
+    }
+
+    if (r == NULL) {
+        r = calloc(1, sizeof(Retained));
+        r->hash = h;
+        r->topic = malloc(topicLen);
+        memcpy(r->topic, topic, topicLen);
+        r->topicLen = topicLen;
+        *slot = r;
+        retainedCount++;
+    }
+    free(r->payload);
+    r->payload = malloc(len);
+    memcpy(r->payload, payload, len);
+    r->len = len;
+    r->qos = qos;
+}
+
+// Does a topic match a filter? For retained messages; live messages go
+// through the tree instead.
+static int topicMatches(const char *filter, size_t filterLen, const char *topic, size_t topicLen) {
+    size_t f = 0, t = 0;
+
+    // Wildcards at the first level don't match $SYS-style topics
+    if (topicLen > 0 && topic[0] == '$' && filterLen > 0 && (filter[0] == '+' || filter[0] == '#')) {
+        return 0;
+    }
+
+    for (;;) {
+        if (f < filterLen && filter[f] == '#') {
+            return 1;
+        }
+        if (f < filterLen && filter[f] == '+') {
+            f++;
+            while (t < topicLen && topic[t] != '/') {
+                t++;
+            }
+        } else {
+            while (f < filterLen && t < topicLen && filter[f] != '/' && filter[f] == topic[t]) {
+                f++;
+                t++;
+            }
+            if ((f < filterLen && filter[f] != '/') || (t < topicLen && topic[t] != '/')) {
+                return 0;
+            }
+        }
+
+        if (f == filterLen && t == topicLen) {
+            return 1;
+        }
+        // "a/#" matches "a" too
+        if (t == topicLen && filterLen - f == 2 && filter[f] == '/' && filter[f + 1] == '#') {
+            return 1;
+        }
+        if (f == filterLen || t == topicLen) {
+            return 0;
+        }
+        f++;
+        t++;
+    }
+}
+
+// ---- Output ----
+
+static void markDirty(Client *c) {
+    if (c->dirty) {
+        return;
+    }
+    dirtyClients = growArray(dirtyClients, &dirtyCap, sizeof(Client *), dirtyCount + 1);
+    dirtyClients[dirtyCount++] = c;
+    c->dirty = 1;
+}
+
+static void closeLater(Client *c) {
+    c->closing = 1;
+    markDirty(c);
+}
+
+// Room for len more bytes in the client's output, NULL if it fell too far behind
+static unsigned char *reserveTx(Client *c, size_t len) {
+    if (c->closing) {
+        return NULL;
+    }
+    if (c->txLen + len > MAX_TX_BACKLOG) {
+        if (!quiet) {
+            fprintf(stderr, "Dropping %s, %zu bytes behind\n", c->clientId, c->txLen);
+        }
+        closeLater(c);
+        return NULL;
+    }
+    if (c->txLen + len > c->txCap) {
+        size_t cap = c->txCap ? c->txCap : 4096;
+        while (cap < c->txLen + len) {
+            cap *= 2;
+        }
+        unsigned char *tx = realloc(c->tx, cap);
+        if (tx == NULL) {
+            closeLater(c);
+            return NULL;
+        }
+        c->tx = tx;
+        c->txCap = cap;
+    }
+    markDirty(c);
+    unsigned char *out = c->tx + c->txLen;
+    c->txLen += len;
+    return out;
+}
+
+// Encode the "remaining length" field, returns the number of bytes used
+static size_t encodeLength(unsigned char *out, size_t len) {
+    size_t i = 0;
+    do {
+        unsigned char digit = len % 128;
+        len /= 128;
+        if (len > 0) {
+            digit |= 0x80;
+        }
+        out[i++] = digit;
+    } while (len > 0);
+    return i;
+}
+
+static void sendPacket(Client *c, const unsigned char *pkt, size_t len) {
+    unsigned char *out = reserveTx(c, len);
+    if (out != NULL) {
+        memcpy(out, pkt, len);
+    }
+}
+
+static void sendPublish(Client *c, const char *topic, size_t topicLen, const unsigned char *payload, size_t len,
+                        uint8_t qos, int retainFlag) {
+    unsigned char header[5];
+    size_t body = 2 + topicLen + (qos ? 2 : 0) + len;
+    size_t headerLen;
+
+    header[0] = (unsigned char)(MQTT_PUBLISH | (qos << 1) | (retainFlag ? 1 : 0));
+    headerLen = 1 + encodeLength(header + 1, body);
+
+    unsigned char *out = reserveTx(c, headerLen + body);
+    if (out == NULL) {
+        return;
+    }
+    memcpy(out, header, headerLen);
+    out += headerLen;
+    *out++ = (unsigned char)(topicLen >> 8);
+    *out++ = (unsigned char)(topicLen & 0xFF);
+    memcpy(out, topic, topicLen);
+    out += topicLen;
+    if (qos) {
+        if (++c->nextPacketId == 0) {
+            c->nextPacketId = 1;
+        }
+        *out++ = (unsigned char)(c->nextPacketId >> 8);
+        *out++ = (unsigned char)(c->nextPacketId & 0xFF);
+    }
+    memcpy(out, payload, len);
+    messagesOut++;
+}
+
+static void watchOutput(Client *c, int on) {
+    if (c->watchingOut != on) {
+        c->watchingOut = on;
+        reactorModify(&reactor, c->fd, on ? EPOLLIN | EPOLLOUT : EPOLLIN);
+    }
+}
+
+// Write as much queued output as the socket takes. -1 if the connection is gone.
+static int flushClient(Client *c) {
+    size_t sent = 0;
+
+    while (sent < c->txLen) {
+        ssize_t n = send(c->fd, c->tx + sent, c->txLen - sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return -1;
+        }
+        sent += (size_t)n;
+    }
+    memmove(c->tx, c->tx + sent, c->txLen - sent);
+    c->txLen -= sent;
+    watchOutput(c, c->txLen > 0);
+    return 0;
+}
+
+static void publishWill(Client *c);
+
+static void closeClient(Client *c) {
+    for (int i = 0; i < c->nodeCount; i++) {
+        removeSubscriber(c->nodes[i], c);
+    }
+    if (c->willTopic != NULL) {
+        publishWill(c);
+    }
+    reactorRemove(&reactor, c->fd);
+    close(c->fd);
+    clients[c->fd] = NULL;
+    clientCount--;
+
+    free(c->willTopic);
+    free(c->nodes);
+    free(c->rx);
+    free(c->tx);
+    free(c);
+}
+
+// Send everything queued during this callback, and close the clients that
+// asked for it or broke. The only place clients are freed, so a client is
+// never freed while a packet is being routed to it.
+static void flushDirty() {
+    for (int i = 0; i < dirtyCount; i++) {
+        Client *c = dirtyClients[i];
+
+        c->dirty = 0;
+        if (flushClient(c) < 0) {
+            c->closing = 1;
+        }
+        if (c->closing) {
+            closeClient(c);
+        }
+    }
+    dirtyCount = 0;
+}
+
+// ---- Routing ----
+
+typedef struct {
+    const char *topic;
+    size_t topicLen;
+    const unsigned char *payload;
+    size_t len;
+    uint8_t qos;
+} Message;
+
+static void deliverAll(uint32_t index, const Message *m) {
+    Node *n = &nodes[index];
+
+    for (int i = 0; i < n->subCount; i++) {
+        Client *c = n->subs[i].client;
+
+        if (c->lastMessage == messageNumber) {
+            continue;
+        }
+        c->lastMessage = messageNumber;
+        sendPublish(c, m->topic, m->topicLen, m->payload, m->len, m->qos < n->subs[i].qos ? m->qos : n->subs[i].qos, 0);
+    }
+}
+
+// Match the topic from level pos on against the subtree under node;
+// pos is past the end once every level has been matched
+static void matchLevel(uint32_t node, size_t pos, const Message *m) {
+    int dollar = node == 0 && m->topic[0] == '$';
+    uint32_t child;
+
+    if (!dollar && (child = findChild(node, "#", 1, 0)) != 0) {
+        deliverAll(child, m);
+    }
+    if (pos > m->topicLen) {
+        deliverAll(node, m);
+        return;
+    }
+
+    const char *slash = memchr(m->topic + pos, '/', m->topicLen - pos);
+    size_t end = slash ? (size_t)(slash - m->topic) : m->topicLen;
+
+    if ((child = findChild(node, m->topic + pos, end - pos, 0)) != 0) {
+        matchLevel(child, end + 1, m);
+    }
+    if (!dollar && (child = findChild(node, "+", 1, 0)) != 0) {
+        matchLevel(child, end + 1, m);
+    }
+}
+
+static void route(const Message *m) {
+    messageNumber++;
+    if (childMask != 0) {
+        matchLevel(0, 0, m);
+    }
+}
+
+// The connection went away without a DISCONNECT: tell everyone who asked.
+// Called from flushDirty(), so the subscribers it reaches are flushed in
+// the same pass.
+static void publishWill(Client *c) {
+    Message m = {c->willTopic, c->willTopicLen, (const unsigned char *)c->willTopic + c->willTopicLen, c->willLen,
+                 c->willQos};
+
+    messagesIn++;
+    if (c->willRetain) {
+        retain(m.topic, m.topicLen, m.payload, m.len, m.qos);
+    }
+    route(&m);
+}
+
+// ---- Packets from clients ----
+
+// Length-prefixed string at *pos, -1 if it doesn't fit in the body
+static int readString(const unsigned char *body, size_t bodyLen, size_t *pos, const char **s, size_t *len) {
+    if (*pos + 2 > bodyLen) {
+        return -1;
+    }
+    *len = ((size_t)body[*pos] << 8) | body[*pos + 1];
+    if (*pos + 2 + *len > bodyLen) {
+        return -1;
+    }
+    *s = (const char *)body + *pos + 2;
+    *pos += 2 + *len;
+    return 0;
+}
+
+static void handleConnect(Client *c, const unsigned char *body, size_t bodyLen) {
+    const char *protocol, *id;
+    size_t protocolLen, idLen;
+    size_t pos = 0;
+
+    if (readString(body, bodyLen, &pos, &protocol, &protocolLen) < 0 || pos + 4 > bodyLen) {
+        closeLater(c);
+        return;
+    }
+
+    // 3.1.1 ("MQTT", level 4) and 3.1 ("MQIsdp", level 3)
+    uint8_t level = body[pos];
+    if (level != 3 && level != 4) {
+        unsigned char refused[4] = {MQTT_CONNACK, 2, 0, 1};
+        sendPacket(c, refused, sizeof(refused));
+        closeLater(c);
+        return;
+    }
+    uint8_t flags = body[pos + 1];
+    pos += 4;  // level, flags, keepalive
+
+    if (readString(body, bodyLen, &pos, &id, &idLen) < 0) {
+        closeLater(c);
+        return;
+    }
+
+    // Will topic and message follow the client id (user name and password,
+    // if any, come after them and are ignored)
+    if (flags & 0x04) {
+        const char *willTopic, *willPayload;
+        size_t willTopicLen, willLen;
+        uint8_t willQos = (flags >> 3) & 0x03;
+
+        if (readString(body, bodyLen, &pos, &willTopic, &willTopicLen) < 0 ||
+            readString(body, bodyLen, &pos, &willPayload, &willLen) < 0 || willTopicLen == 0 || willQos > 1 ||
+            memchr(willTopic, '+', willTopicLen) != NULL || memchr(willTopic, '#', willTopicLen) != NULL) {
+            closeLater(c);
+            return;
+        }
+        c->willTopic = malloc(willTopicLen + willLen + 1);
+        if (c->willTopic == NULL) {
+            closeLater(c);
+            return;
+        }
+        memcpy(c->willTopic, willTopic, willTopicLen);
+        memcpy(c->willTopic + willTopicLen, willPayload, willLen);
+        c->willTopicLen = willTopicLen;
+        c->willLen = willLen;
+        c->willQos = willQos;
+        c->willRetain = (flags & 0x20) != 0;
+    }
+    if (idLen == 0) {
+        snprintf(c->clientId, sizeof(c->clientId), "anon_%d", c->fd);
+    } else {
+        snprintf(c->clientId, sizeof(c->clientId), "%.*s", (int)(idLen < 63 ? idLen : 63), id);
+    }
+
+    // A client that reconnects under the same id replaces its old connection
+    for (int fd = 0; fd < clientCap; fd++) {
+        Client *other = clients[fd];
+        if (other != NULL && other != c && other->connected && !other->closing &&
+            strcmp(other->clientId, c->clientId) == 0) {
+            closeLater(other);
+        }
+    }
+
+    c->connected = 1;
+    unsigned char accepted[4] = {MQTT_CONNACK, 2, 0, 0};
+    sendPacket(c, accepted, sizeof(accepted));
+}
+
+static void handlePublish(Client *c, unsigned char flags, const unsigned char *body, size_t bodyLen) {
+    Message m;
+    size_t pos = 0;
+    uint16_t packetId = 0;
+
+    m.qos = (flags >> 1) & 0x03;
+    if (m.qos > 1 || readString(body, bodyLen, &pos, &m.topic, &m.topicLen) < 0 || m.topicLen == 0 ||
+        memchr(m.topic, '+', m.topicLen) != NULL || memchr(m.topic, '#', m.topicLen) != NULL) {
+        closeLater(c);
+        return;
+    }
+    if (m.qos > 0) {
+        if (pos + 2 > bodyLen) {
+            closeLater(c);
+            return;
+        }
+        packetId = (uint16_t)((body[pos] << 8) | body[pos + 1]);
+        pos += 2;
+    }
+    m.payload = body + pos;
+    m.len = bodyLen - pos;
+    messagesIn++;
+
+    if (m.qos == 1) {
+        unsigned char ack[4] = {MQTT_PUBACK, 2, (unsigned char)(packetId >> 8), (unsigned char)(packetId & 0xFF)};
+        sendPacket(c, ack, sizeof(ack));
+    }
+    if (flags & 0x01) {
+        retain(m.topic, m.topicLen, m.payload, m.len, m.qos);
+    }
+    route(&m);
+}
+
+static void handleSubscribe(Client *c, const unsigned char *body, size_t bodyLen) {
+    struct {
+        const char *filter;
+        size_t len;
+    } filters[MAX_FILTERS];
+    unsigned char ack[4 + MAX_FILTERS];
+    size_t pos = 2;
+    int count = 0;
+
+    if (bodyLen < 2) {
+        closeLater(c);
+        return;
+    }
+    while (pos < bodyLen) {
+        if (count == MAX_FILTERS || readString(body, bodyLen, &pos, &filters[count].filter, &filters[count].len) < 0 ||
+            pos >= bodyLen) {
+            closeLater(c);
+            return;
+        }
+        uint8_t qos = body[pos++] & 0x03;
+        if (!validFilter(filters[count].filter, filters[count].len)) {
+            ack[4 + count] = 0x80;  // failure
+        } else {
+            ack[4 + count] = qos > 1 ? 1 : qos;
+            subscribe(c, filters[count].filter, filters[count].len, ack[4 + count]);
+        }
+        count++;
+    }
+
+    size_t headerLen = 1 + encodeLength(ack + 1, 2 + (size_t)count);
+    // The length fits in one byte, so the packet id follows directly
+    ack[0] = MQTT_SUBACK;
+    ack[headerLen] = body[0];
+    ack[headerLen + 1] = body[1];
+    sendPacket(c, ack, headerLen + 2 + (size_t)count);
+
+    // Then what is retained under the new filters
+    for (int i = 0; i < count; i++) {
+        uint8_t granted = ack[4 + i];
+        const char *filter = filters[i].filter;
+        size_t len = filters[i].len;
+
+        if (granted == 0x80 || retainedBuckets == NULL) {
+            continue;
+        }
+        if (memchr(filter, '+', len) == NULL && memchr(filter, '#', len) == NULL) {
+            Retained *r = *retainedSlot(filter, len, hashTopic(filter, len));
+            if (r != NULL) {
+                sendPublish(c, r->topic, r->topicLen, r->payload, r->len, r->qos < granted ? r->qos : granted, 1);
+            }
+            continue;
+        }
+        for (uint32_t b = 0; b <= retainedMask; b++) {
+            for (Retained *r = retainedBuckets[b]; r != NULL; r = r->next) {
+                if (topicMatches(filter, len, r->topic, r->topicLen)) {
+                    sendPublish(c, r->topic, r->topicLen, r->payload, r->len, r->qos < granted ? r->qos : granted, 1);
+                }
+            }
+        }
+    }
+}
+
+static void handleUnsubscribe(Client *c, const unsigned char *body, size_t bodyLen) {
+    const char *filter;
+    size_t len;
+    size_t pos = 2;
+
+    if (bodyLen < 2) {
+        closeLater(c);
+        return;
+    }
+    while (pos < bodyLen) {
+        if (readString(body, bodyLen, &pos, &filter, &len) < 0) {
+            closeLater(c);
+            return;
+        }
+        unsubscribe(c, filter, len);
+    }
+
+    unsigned char ack[4] = {MQTT_UNSUBACK, 2, body[0], body[1]};
+    sendPacket(c, ack, sizeof(ack));
+}
+
+static void handlePacket(Client *c, unsigned char type, const unsigned char *body, size_t bodyLen) {
+    if (!c->connected && (type & 0xF0) != MQTT_CONNECT) {
+        closeLater(c);
+        return;
+    }
+
+    switch (type & 0xF0) {
+    case MQTT_CONNECT:
+        if (c->connected) {
+            closeLater(c);  // only one CONNECT per connection
+        } else {
+            handleConnect(c, body, bodyLen);
+        }
+        break;
+    case MQTT_PUBLISH:
+        handlePublish(c, type & 0x0F, body, bodyLen);
+        break;
+    case MQTT_PUBACK:
+        break;  // nothing is resent, so nothing to forget
+    case MQTT_SUBSCRIBE:
+        handleSubscribe(c, body, bodyLen);
+        break;
+    case MQTT_UNSUBSCRIBE:
+        handleUnsubscribe(c, body, bodyLen);
+        break;
+    case MQTT_PINGREQ: {
+        unsigned char pong[2] = {MQTT_PINGRESP, 0};
+        sendPacket(c, pong, sizeof(pong));
+        break;
+    }
+    case MQTT_DISCONNECT:
+        // A clean goodbye: the will is dropped
+        free(c->willTopic);
+        c->willTopic = NULL;
+        closeLater(c);
+        break;
+    default:
+        closeLater(c);
+        break;
+    }
+}
+
+// Handle every complete packet in the receive buffer
+static void parsePackets(Client *c) {
+    size_t pos = 0;
+
+    while (!c->closing && c->rxLen - pos >= 2) {
+        size_t bodyLen = 0;
+        size_t i = 1;
+        int shift = 0;
+
+        // Remaining length: up to 4 bytes, 7 bits each
+        for (;;) {
+            if (pos + i >= c->rxLen) {
+                goto incomplete;
+            }
+            unsigned char digit = c->rx[pos + i++];
+            bodyLen |= (size_t)(digit & 0x7F) << shift;
+            shift += 7;
+            if (!(digit & 0x80)) {
+                break;
+            }
+            if (i > 4) {
+                closeLater(c);
+                return;
+            }
+        }
+        if (bodyLen > MAX_PACKET) {
+            closeLater(c);
+            return;
+        }
+        if (pos + i + bodyLen > c->rxLen) {
+            break;
+        }
+        handlePacket(c, c->rx[pos], c->rx + pos + i, bodyLen);
+        pos += i + bodyLen;
+    }
+
+incomplete:
+    memmove(c->rx, c->rx + pos, c->rxLen - pos);
+    c->rxLen -= pos;
+}
+
+static void onClientEvent(int fd, unsigned int events, void *ctx) {
+    Client *c = ctx;
+
+    if (events & EPOLLOUT) {
+        markDirty(c);
+    }
+
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        if (c->rxCap - c->rxLen < READ_CHUNK) {
+            size_t cap = c->rxCap ? c->rxCap * 2 : READ_CHUNK * 2;
+            unsigned char *rx = realloc(c->rx, cap);
+            if (rx == NULL) {
+                closeLater(c);
+                flushDirty();
+                return;
+            }
+            c->rx = rx;
+            c->rxCap = cap;
+        }
+
+        ssize_t n = recv(fd, c->rx + c->rxLen, c->rxCap - c->rxLen, 0);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            closeLater(c);
+        } else if (n > 0) {
+            c->rxLen += (size_t)n;
+            parsePackets(c);
+        }
+    }
+
+    flushDirty();
+}
+
+static void onAccept(int fd, unsigned int events, void *ctx) {
+    for (;;) {
+        int conn = accept(fd, NULL, NULL);
+        if (conn < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && !quiet) {
+                perror("accept");
+            }
+            return;
+        }
+
+        int one = 1;
+        setsockopt(conn, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        fcntl(conn, F_SETFL, fcntl(conn, F_GETFL, 0) | O_NONBLOCK);
+
+        Client *c = calloc(1, sizeof(Client));
+        if (c == NULL) {
+            close(conn);
+            continue;
+        }
+        c->fd = conn;
+        snprintf(c->clientId, sizeof(c->clientId), "fd%d", conn);
+
+        if (conn >= clientCap) {
+            int oldCap = clientCap;
+            clients = growArray(clients, &clientCap, sizeof(Client *), conn + 1);
+            memset(clients + oldCap, 0, (size_t)(clientCap - oldCap) * sizeof(Client *));
+        }
+        if (reactorAdd(&reactor, conn, EPOLLIN, onClientEvent, c) < 0) {
+            close(conn);
+            free(c);
+            continue;
+        }
+        clients[conn] = c;
+        clientCount++;
+    }
+}
+
+static void onStatsTimer(int fd, unsigned int events, void *ctx) {
+    static unsigned long long lastIn = 0;
+
+    if (!quiet) {
+        printf("clients: %d  messages in: %llu (+%llu/s)  out: %llu  retained: %u\n",
+               clientCount, messagesIn, (messagesIn - lastIn) / 10, messagesOut, retainedCount);
+        fflush(stdout);
+    }
+    lastIn = messagesIn;
+}
+
+void signalHandler(int sig) {
+    reactorStop(&reactor);
+}
+
+static int openListener() {
+    struct sockaddr_in addr;
+    int one = 1;
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)listenPort);
+    if (inet_pton(AF_INET, listenHost, &addr.sin_addr) != 1) {
+        fprintf(stderr, "Bad listen address %s\n", listenHost);
+        close(fd);
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 512) < 0) {
+        perror("bind/listen");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+
+    while ((opt = getopt(argc, argv, "h:p:q")) != -1) {
+        switch (opt) {
+        case 'h':
+            listenHost = optarg;
+            break;
+        case 'p':
+            listenPort = atoi(optarg);
+            break;
+        case 'q':
+            quiet = 1;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-h listenAddress] [-p port] [-q]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    initTree();
+
+    if (reactorInit(&reactor) < 0 || (listenFd = openListener()) < 0) {
+        return 1;
+    }
+    reactorAdd(&reactor, listenFd, EPOLLIN, onAccept, NULL);
+    reactorAddTimer(&reactor, 10000, onStatsTimer, NULL);
+
+    signal(SIGINT, signalHandler);
+    signal(SIGTERM, signalHandler);
+
+    printf("Broker listening on %s:%d\n", listenHost, listenPort);
+    fflush(stdout);
+
+    reactorRun(&reactor);
+
+    printf("Routed %llu messages, %llu deliveries, %u retained\n", messagesIn, messagesOut, retainedCount);
+    close(listenFd);
+    reactorClose(&reactor);
+    return 0;
+}
@@ -0,0 +1,105 @@
+// tttCache.c - Position cache keyed by canonical 3x3 position
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tttCache.h"
+#include "tttSolver.h"
+
+// Canonical keys are 18 bits; Fibonacci hashing spreads them over the slots
+static inline uint32_t slotOf(const TttPositionCache *c, uint32_t key) {
+    return (key * 2654435761u >> 14) & c->mask;
+}
+
+int tttCacheInit(TttPositionCache *c, uint32_t capacity) {
+    uint32_t slots = 1;
+    while (slots < capacity) {
+        slots <<= 1;
+    }
+
+    c->entries = calloc(slots, sizeof(TttCacheEntry));
+    if (c->entries == NULL) {
+        return -1;
+    }
+    c->mask = slots - 1;
+    c->count = 0;
+    return 0;
+}
+
+void tttCacheFree(TttPositionCache *c) {
+    free(c->entries);
+    c->entries = NULL;
+    c->count = 0;
+}
+
+void tttCacheClear(TttPositionCache *c) {
+    memset(c->entries, 0, (size_t)(c->mask + 1) * sizeof(TttCacheEntry));
+    c->count = 0;
+}
+
+TttCacheEntry *tttCacheFind(const TttPositionCache *c, uint32_t key) {
+    uint32_t i = slotOf(c, key);
+
+    while (c->entries[i].key != 0) {
+        if (c->entries[i].key == key + 1) {
+            return &c->entries[i];
+        }
+        i = (i + 1) & c->mask;
+    }
+    return NULL;
+}
+
+TttCacheEntry *tttCacheInsert(TttPositionCache *c, uint32_t key) {
+    uint32_t i = slotOf(c, key);
+
+    while (c->entries[i].key != 0) {
+        if (c->entries[i].key == key + 1) {
+            return &c->entries[i];
+        }
+        i = (i + 1) & c->mask;
+    }
+
+    // Keep one slot empty so lookups of missing keys stop
+    if (c->count == c->mask) {
+        return NULL;
+    }
+    c->entries[i].key = key + 1;
+    c->count++;
+    return &c->entries[i];
+}
+
+// Positions after the side to move (X if xToMove) played, down to the end
+static int addSolved(TttPositionCache *c, uint16_t x, uint16_t o, int xToMove) {
+    TttBoard b = {x, o, (uint8_t)!xToMove, TTT_PLAYING};
+    int sym;
+    uint32_t key = tttCanonicalKey(x, o, &sym);
+
+    if (tttCacheFind(c, key) != NULL) {
+        return 0;
+    }
+    TttCacheEntry *entry = tttCacheInsert(c, key);
+    if (entry == NULL) {
+        return -1;
+    }
+    entry->value = (int16_t)tttValue(&b);
+    entry->moves = tttSymMap(sym, tttBestMoves(&b));
+
+    if (tttIsWin(x) || tttIsWin(o)) {
+        return 0;
+    }
+    for (int cell = 0; cell < 9; cell++) {
+        if ((x | o) & (1u << cell)) {
+            continue;
+        }
+        int result = xToMove ? addSolved(c, (uint16_t)(x | (1u << cell)), o, 0)
+                             : addSolved(c, x, (uint16_t)(o | (1u << cell)), 1);
+        if (result < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int tttCacheAddSolved(TttPositionCache *c) {
+    return addSolved(c, 0, 0, 1);
+}
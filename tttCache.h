@@ -0,0 +1,63 @@
+// tttCache.h - Position cache keyed by canonical 3x3 position
+// A fixed-size open addressing table from tttCanonicalKey() (see
+// tttSymmetry.h) to a small result: a game value and a cell mask kept in
+// the canonical orientation. All 8 images of a position share one entry,
+// so the 765 positions that matter fit in 1024 entries of 8 bytes, 8 KB,
+// against 59 KB for the 3^9 table indexed by the board as it stands.
+// Looking a position up costs the canonical key on top, so the solver
+// keeps its direct table for play; analysis tools that want one entry per
+// position up to symmetry key their data here, and can start from the
+// solver's results with tttCacheAddSolved().
+
+#ifndef TTT_CACHE_H
+#define TTT_CACHE_H
+
+#include <stdint.h>
+
+#include "tttSymmetry.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint32_t key;     // canonical key + 1, 0 = empty
+    int16_t value;
+    uint16_t moves;   // cell mask in the canonical orientation
+} TttCacheEntry;
+
+typedef struct {
+    TttCacheEntry *entries;
+    uint32_t mask;    // slots - 1
+    uint32_t count;
+} TttPositionCache;
+
+// Room for capacity positions (rounded up to a power of two).
+// Returns 0 or -1.
+int tttCacheInit(TttPositionCache *c, uint32_t capacity);
+void tttCacheFree(TttPositionCache *c);
+void tttCacheClear(TttPositionCache *c);
+
+// Entry for a canonical key, NULL if it isn't cached
+TttCacheEntry *tttCacheFind(const TttPositionCache *c, uint32_t key);
+
+// Entry for a canonical key, added (value and moves 0) if new.
+// NULL when the cache is full.
+TttCacheEntry *tttCacheInsert(TttPositionCache *c, uint32_t key);
+
+// Add every position reachable from the empty board with its value and
+// best moves from tttSolver.h (tttSolverInit() first). Needs room for 765
+// positions. Returns 0, or -1 if the cache filled up.
+int tttCacheAddSolved(TttPositionCache *c);
+
+// Cached entry for a position as it stands; *sym is set as by
+// tttCanonicalKey(), for mapping the entry's moves back to the board
+static inline TttCacheEntry *tttCacheLookup(const TttPositionCache *c, uint16_t x, uint16_t o, int *sym) {
+    return tttCacheFind(c, tttCanonicalKey(x, o, sym));
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
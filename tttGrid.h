@@ -0,0 +1,480 @@
+// tttGrid.h - Game core for larger k-in-a-row variants
+// Same idea as ttt.h, for any board up to 16x16 and any line length k:
+// 5x5 four-in-a-row, 15x15 gomoku, or plain 3x3. The geometry is set per
+// board at runtime ("15x15k5"), so one server or client handles them all.
+//
+// Each player's marks are 16 rows of 16 bits, bit c of rows[r] for cell
+// (r, c): 256 bits, one AVX2 register or two SSE2 registers. A line of k
+// in a direction is found on the whole board at once by ANDing the marks
+// with copies of themselves shifted along that direction, doubling the
+// run length each time:
+//   run(1) = marks,  run(2n) = run(n) & shift(run(n), n)
+// so 15x15 gomoku takes 4 directions x 3 steps, whatever the position.
+// Rows shift by moving 16-bit lanes, columns by shifting inside each lane,
+// so nothing wraps from one row into the next.
+//
+// Header-only like ttt.h; the vector code is picked at compile time
+// (-mavx2, SSE2 on any x86-64), with a scalar version for everything else.
+
+#ifndef TTT_GRID_H
+#define TTT_GRID_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ttt.h"
+#include "tttWire.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define TTT_GRID_MAX 16  // rows and columns
+
+typedef struct {
+    uint16_t rows[TTT_GRID_MAX];  // bit c of rows[r] = cell (r, c)
+} __attribute__((aligned(32))) TttGridMarks;
+
+typedef struct {
+    TttGridMarks x;    // X's marks
+    TttGridMarks o;    // O's marks
+    uint8_t width;
+    uint8_t height;
+    uint8_t k;         // marks in a row needed to win
+    uint8_t player;    // side to move: 0 = X, 1 = O
+    uint8_t status;    // TTT_PLAYING, TTT_X_WINS, TTT_O_WINS or TTT_DRAW
+    uint16_t filled;   // cells taken, for the draw check
+} TttGrid;
+
+// The 4 line directions as (row step, column step)
+static const int8_t tttGridDirections[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+
+// ---- Line detection ----
+
+// Marks moved n steps along direction d: bit (r, c) of the result is
+// cell (r + n * dr, c + n * dc) of m
+static inline void tttGridShiftScalar(TttGridMarks *out, const TttGridMarks *m, int d, int n) {
+    int rows = n * tttGridDirections[d][0];
+    int dc = tttGridDirections[d][1];
+
+    for (int r = 0; r < TTT_GRID_MAX; r++) {
+        unsigned int v = r + rows < TTT_GRID_MAX ? m->rows[r + rows] : 0;
+        out->rows[r] = (uint16_t)(dc > 0 ? v >> n : dc < 0 ? v << n : v);
+    }
+}
+
+// Do these marks hold k in a row anywhere? Plain C, for any target.
+static inline int tttGridHasLineScalar(const TttGridMarks *m, int k) {
+    for (int d = 0; d < 4; d++) {
+        TttGridMarks run = *m;
+        TttGridMarks shifted;
+        uint16_t any = 1;
+
+        for (int len = 1; len < k && any; ) {
+            int n = len * 2 <= k ? len : k - len;
+            tttGridShiftScalar(&shifted, &run, d, n);
+            any = 0;
+            for (int r = 0; r < TTT_GRID_MAX; r++) {
+                run.rows[r] &= shifted.rows[r];
+                any |= run.rows[r];
+            }
+            len += n;
+        }
+
+        for (int r = 0; r < TTT_GRID_MAX && any; r++) {
+            if (run.rows[r]) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+#if defined(__AVX2__)
+
+// Row r of the result is row r + n of v (n < 16), zeros shifted in
+static inline __m256i tttGridRowsUp(__m256i v, int n) {
+    if (n & 1) {
+        v = _mm256_alignr_epi8(_mm256_permute2x128_si256(v, v, 0x81), v, 2);
+    }
+    if (n & 2) {
+        v = _mm256_alignr_epi8(_mm256_permute2x128_si256(v, v, 0x81), v, 4);
+    }
+    if (n & 4) {
+        v = _mm256_alignr_epi8(_mm256_permute2x128_si256(v, v, 0x81), v, 8);
+    }
+    if (n & 8) {
+        v = _mm256_permute2x128_si256(v, v, 0x81);
+    }
+    return v;
+}
+
+static inline int tttGridHasLine(const TttGridMarks *m, int k) {
+    __m256i marks = _mm256_load_si256((const __m256i *)m->rows);
+
+    for (int d = 0; d < 4; d++) {
+        __m256i run = marks;
+
+        for (int len = 1; len < k && !_mm256_testz_si256(run, run); ) {
+            int n = len * 2 <= k ? len : k - len;
+            __m256i shifted = tttGridDirections[d][0] ? tttGridRowsUp(run, n) : run;
+            __m128i count = _mm_cvtsi32_si128(n);
+
+            if (tttGridDirections[d][1] > 0) {
+                shifted = _mm256_srl_epi16(shifted, count);
+            } else if (tttGridDirections[d][1] < 0) {
+                shifted = _mm256_sll_epi16(shifted, count);
+            }
+            run = _mm256_and_si256(run, shifted);
+            len += n;
+        }
+
+        if (!_mm256_testz_si256(run, run)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+#elif defined(__SSE2__)
+
+// Rows 0-7 in lo, 8-15 in hi; row r becomes row r + rows (n < 16)
+#define TTT_GRID_ROWS_UP_SSE(lo, hi, rows)                                               \
+    do {                                                                                 \
+        lo = _mm_or_si128(_mm_srli_si128(lo, 2 * (rows)), _mm_slli_si128(hi, 16 - 2 * (rows))); \
+        hi = _mm_srli_si128(hi, 2 * (rows));                                             \
+    } while (0)
+
+static inline int tttGridAnySSE(__m128i lo, __m128i hi) {
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(lo, hi), _mm_setzero_si128())) != 0xFFFF;
+}
+
+static inline int tttGridHasLine(const TttGridMarks *m, int k) {
+    __m128i marksLo = _mm_load_si128((const __m128i *)m->rows);
+    __m128i marksHi = _mm_load_si128((const __m128i *)m->rows + 1);
+
+    for (int d = 0; d < 4; d++) {
+        __m128i lo = marksLo;
+        __m128i hi = marksHi;
+
+        for (int len = 1; len < k && tttGridAnySSE(lo, hi); ) {
+            int n = len * 2 <= k ? len : k - len;
+            __m128i shiftedLo = lo;
+            __m128i shiftedHi = hi;
+            __m128i count = _mm_cvtsi32_si128(n);
+
+            if (tttGridDirections[d][0]) {
+                if (n & 1) {
+                    TTT_GRID_ROWS_UP_SSE(shiftedLo, shiftedHi, 1);
+                }
+                if (n & 2) {
+                    TTT_GRID_ROWS_UP_SSE(shiftedLo, shiftedHi, 2);
+                }
+                if (n & 4) {
+                    TTT_GRID_ROWS_UP_SSE(shiftedLo, shiftedHi, 4);
+                }
+                if (n & 8) {
+                    shiftedLo = shiftedHi;
+                    shiftedHi = _mm_setzero_si128();
+                }
+            }
+            if (tttGridDirections[d][1] > 0) {
+                shiftedLo = _mm_srl_epi16(shiftedLo, count);
+                shiftedHi = _mm_srl_epi16(shiftedHi, count);
+            } else if (tttGridDirections[d][1] < 0) {
+                shiftedLo = _mm_sll_epi16(shiftedLo, count);
+                shiftedHi = _mm_sll_epi16(shiftedHi, count);
+            }
+            lo = _mm_and_si128(lo, shiftedLo);
+            hi = _mm_and_si128(hi, shiftedHi);
+            len += n;
+        }
+
+        if (tttGridAnySSE(lo, hi)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+#else
+
+static inline int tttGridHasLine(const TttGridMarks *m, int k) {
+    return tttGridHasLineScalar(m, k);
+}
+
+#endif
+
+// ---- Board ----
+
+static inline int tttGridIsClassic(const TttGrid *g) {
+    return g->width == 3 && g->height == 3 && g->k == 3;
+}
+
+static inline void tttGridReset(TttGrid *g) {
+    memset(&g->x, 0, sizeof(g->x));
+    memset(&g->o, 0, sizeof(g->o));
+    g->player = 0;
+    g->status = TTT_PLAYING;
+    g->filled = 0;
+}
+
+// Set the geometry and clear the board. Returns -1 if it doesn't fit:
+// up to 16x16, and k between 1 and the longer side.
+static inline int tttGridInit(TttGrid *g, int width, int height, int k) {
+    if (width < 1 || width > TTT_GRID_MAX || height < 1 || height > TTT_GRID_MAX ||
+        k < 1 || (k > width && k > height)) {
+        return -1;
+    }
+    g->width = (uint8_t)width;
+    g->height = (uint8_t)height;
+    g->k = (uint8_t)k;
+    tttGridReset(g);
+    return 0;
+}
+
+// Parse "<width>x<height>k<k>" (e.g. "15x15k5"); without the "k<k>" part
+// k is the shorter side. Returns 0 or -1.
+static inline int tttGridParseVariant(const char *s, size_t len, int *width, int *height, int *k) {
+    int v[3] = {0, 0, 0};
+    int field = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        if (s[i] >= '0' && s[i] <= '9' && v[field] < 100) {
+            v[field] = v[field] * 10 + (s[i] - '0');
+        } else if ((s[i] == 'x' && field == 0) || (s[i] == 'k' && field == 1)) {
+            field++;
+        } else {
+            return -1;
+        }
+    }
+    if (field == 0) {
+        return -1;
+    }
+
+    *width = v[0];
+    *height = v[1];
+    *k = field == 2 ? v[2] : v[0] < v[1] ? v[0] : v[1];
+    return 0;
+}
+
+// "15x15k5", the form tttGridParseVariant() reads
+static inline int tttGridVariantString(const TttGrid *g, char *out, size_t size) {
+    int n = snprintf(out, size, "%dx%dk%d", g->width, g->height, g->k);
+    return n < 0 ? 0 : (size_t)n < size ? n : (int)size - 1;
+}
+
+static inline int tttGridIsFree(const TttGrid *g, int row, int col) {
+    return ((g->x.rows[row] | g->o.rows[row]) & (1u << col)) == 0;
+}
+
+static inline char tttGridPlayerChar(const TttGrid *g) {
+    return g->player ? 'O' : 'X';
+}
+
+// 'X', 'O' or ' ' for cell (row, col)
+static inline char tttGridCellChar(const TttGrid *g, int row, int col) {
+    unsigned int bit = 1u << col;
+    return (g->x.rows[row] & bit) ? 'X' : (g->o.rows[row] & bit) ? 'O' : ' ';
+}
+
+// Play (row, col), 0-indexed, for the side to move. Same results and turn
+// handling as tttPlay().
+static inline int tttGridPlay(TttGrid *g, int row, int col) {
+    if (g->status != TTT_PLAYING || row < 0 || row >= g->height || col < 0 || col >= g->width ||
+        !tttGridIsFree(g, row, col)) {
+        return TTT_ILLEGAL;
+    }
+
+    TttGridMarks *marks = g->player ? &g->o : &g->x;
+    marks->rows[row] |= (uint16_t)(1u << col);
+    g->filled++;
+
+    if (tttGridHasLine(marks, g->k)) {
+        g->status = g->player ? TTT_O_WINS : TTT_X_WINS;
+        return TTT_WON;
+    }
+    if (g->filled == g->width * g->height) {
+        g->status = TTT_DRAW;
+        return TTT_DREW;
+    }
+
+    g->player ^= 1;
+    return TTT_MOVED;
+}
+
+// Work out the status from the marks alone, e.g. after tttGridFromString()
+static inline void tttGridUpdateStatus(TttGrid *g) {
+    if (tttGridHasLine(&g->x, g->k)) {
+        g->status = TTT_X_WINS;
+    } else if (tttGridHasLine(&g->o, g->k)) {
+        g->status = TTT_O_WINS;
+    } else if (g->filled == g->width * g->height) {
+        g->status = TTT_DRAW;
+    } else {
+        g->status = TTT_PLAYING;
+    }
+}
+
+// Write the width * height char board string, row by row (no terminator).
+// For 3x3 this is the 9-char TTT/board string.
+static inline void tttGridToString(const TttGrid *g, char *out) {
+    for (int r = 0; r < g->height; r++) {
+        for (int c = 0; c < g->width; c++) {
+            *out++ = tttGridCellChar(g, r, c);
+        }
+    }
+}
+
+// Read a board string; anything other than X/O counts as empty
+static inline void tttGridFromString(TttGrid *g, const char *s, size_t len) {
+    size_t cells = (size_t)g->width * g->height;
+
+    tttGridReset(g);
+    for (size_t i = 0; i < len && i < cells; i++) {
+        TttGridMarks *marks = s[i] == 'X' ? &g->x : s[i] == 'O' ? &g->o : NULL;
+        if (marks != NULL) {
+            marks->rows[i / g->width] |= (uint16_t)(1u << (i % g->width));
+            g->filled++;
+        }
+    }
+    tttGridUpdateStatus(g);
+}
+
+// A 3x3 ttt.h board as a grid, and back
+static inline void tttGridFromBoard(TttGrid *g, const TttBoard *b) {
+    tttGridInit(g, 3, 3, 3);
+    for (int r = 0; r < 3; r++) {
+        g->x.rows[r] = (uint16_t)((b->x >> (r * 3)) & 7);
+        g->o.rows[r] = (uint16_t)((b->o >> (r * 3)) & 7);
+    }
+    g->filled = (uint16_t)__builtin_popcount(b->x | b->o);
+    g->player = b->player;
+    g->status = b->status;
+}
+
+static inline void tttGridToBoard(const TttGrid *g, TttBoard *b) {
+    b->x = 0;
+    b->o = 0;
+    for (int r = 0; r < 3; r++) {
+        b->x |= (uint16_t)((g->x.rows[r] & 7) << (r * 3));
+        b->o |= (uint16_t)((g->o.rows[r] & 7) << (r * 3));
+    }
+    b->player = g->player;
+    b->status = g->status;
+}
+
+// ---- Grid state message ----
+// Published retained on .../state like the tttWire.h message, for every
+// variant but plain 3x3 (which keeps the 12-byte format the ESP32 and
+// older clients read). Byte 0 is 0, which tttWireDecode() rejects.
+//
+//   byte 0      0 (TTT_GRID_WIRE_TAG)
+//   byte 1      bits 0-1 status, bit 2 side to move, as in tttWire.h
+//   bytes 2-4   width, height, k
+//   bytes 5-6   little-endian sequence number
+//   bytes 7-8   little-endian cell (row * width + col) of the last move,
+//               0xFFFF after a reset
+//   bytes 9-12  little-endian X wins, O wins
+//   then        X's marks, then O's marks: one bit per cell in board
+//               string order, (width * height + 7) / 8 bytes each
+
+#define TTT_GRID_WIRE_TAG 0
+#define TTT_GRID_WIRE_HEADER 13
+#define TTT_GRID_WIRE_MAX (TTT_GRID_WIRE_HEADER + 2 * (TTT_GRID_MAX * TTT_GRID_MAX / 8))
+
+typedef struct {
+    TttGrid board;
+    uint16_t seq;
+    int16_t lastMove;  // row * width + col, TTT_NO_MOVE if none
+    uint16_t xWins;
+    uint16_t oWins;
+} TttGridState;
+
+static inline size_t tttGridWireSize(const TttGrid *g) {
+    return TTT_GRID_WIRE_HEADER + 2 * (((size_t)g->width * g->height + 7) / 8);
+}
+
+static inline void tttGridPackMarks(const TttGrid *g, const TttGridMarks *m, uint8_t *out) {
+    int bit = 0;
+
+    memset(out, 0, ((size_t)g->width * g->height + 7) / 8);
+    for (int r = 0; r < g->height; r++) {
+        for (int c = 0; c < g->width; c++, bit++) {
+            if (m->rows[r] & (1u << c)) {
+                out[bit / 8] |= (uint8_t)(1u << (bit % 8));
+            }
+        }
+    }
+}
+
+static inline void tttGridUnpackMarks(const TttGrid *g, TttGridMarks *m, const uint8_t *in) {
+    int bit = 0;
+
+    memset(m, 0, sizeof(*m));
+    for (int r = 0; r < g->height; r++) {
+        for (int c = 0; c < g->width; c++, bit++) {
+            if (in[bit / 8] & (1u << (bit % 8))) {
+                m->rows[r] |= (uint16_t)(1u << c);
+            }
+        }
+    }
+}
+
+// Returns the message length, at most TTT_GRID_WIRE_MAX
+static inline size_t tttGridWireEncode(const TttGridState *s, uint8_t *out) {
+    const TttGrid *g = &s->board;
+    size_t maskBytes = ((size_t)g->width * g->height + 7) / 8;
+    uint16_t lastMove = s->lastMove < 0 ? 0xFFFF : (uint16_t)s->lastMove;
+
+    out[0] = TTT_GRID_WIRE_TAG;
+    out[1] = (uint8_t)((g->status & 0x03) | ((g->player & 1) << 2));
+    out[2] = g->width;
+    out[3] = g->height;
+    out[4] = g->k;
+    out[5] = (uint8_t)(s->seq & 0xFF);
+    out[6] = (uint8_t)(s->seq >> 8);
+    out[7] = (uint8_t)(lastMove & 0xFF);
+    out[8] = (uint8_t)(lastMove >> 8);
+    out[9] = (uint8_t)(s->xWins & 0xFF);
+    out[10] = (uint8_t)(s->xWins >> 8);
+    out[11] = (uint8_t)(s->oWins & 0xFF);
+    out[12] = (uint8_t)(s->oWins >> 8);
+    tttGridPackMarks(g, &g->x, out + TTT_GRID_WIRE_HEADER);
+    tttGridPackMarks(g, &g->o, out + TTT_GRID_WIRE_HEADER + maskBytes);
+    return TTT_GRID_WIRE_HEADER + 2 * maskBytes;
+}
+
+// Returns 0 on success, -1 if the message is not a valid grid state
+static inline int tttGridWireDecode(const uint8_t *in, size_t len, TttGridState *s) {
+    TttGrid *g = &s->board;
+
+    if (len < TTT_GRID_WIRE_HEADER || in[0] != TTT_GRID_WIRE_TAG || tttGridInit(g, in[2], in[3], in[4]) < 0 ||
+        len < tttGridWireSize(g)) {
+        return -1;
+    }
+
+    size_t maskBytes = ((size_t)g->width * g->height + 7) / 8;
+    uint16_t lastMove = (uint16_t)(in[7] | (in[8] << 8));
+
+    tttGridUnpackMarks(g, &g->x, in + TTT_GRID_WIRE_HEADER);
+    tttGridUnpackMarks(g, &g->o, in + TTT_GRID_WIRE_HEADER + maskBytes);
+    g->filled = 0;
+    for (int r = 0; r < g->height; r++) {
+        g->filled = (uint16_t)(g->filled + __builtin_popcount(g->x.rows[r] | g->o.rows[r]));
+    }
+    g->status = in[1] & 0x03;
+    g->player = (in[1] >> 2) & 1;
+
+    s->seq = (uint16_t)(in[5] | (in[6] << 8));
+    s->lastMove = lastMove < g->width * g->height ? (int16_t)lastMove : TTT_NO_MOVE;
+    s->xWins = (uint16_t)(in[9] | (in[10] << 8));
+    s->oWins = (uint16_t)(in[11] | (in[12] << 8));
+    return 0;
+}
+
+#endif
@@ -0,0 +1,445 @@
+// tttJournal.c - Record, inspect and replay the game journal (journal.c)
+// Recording subscribes to TTT/# and appends every move, reset and host
+// update to the journal file until stopped. The same file can then be
+// listed, any game reconstructed move by move, or the recorded commands
+// re-published at full speed to drive tttServer/controlLinux for
+// regression runs.
+//
+//   ./tttJournal -f games.jnl                 # record until Ctrl+C
+//   ./tttJournal -f games.jnl -L              # list the recorded games
+//   ./tttJournal -f games.jnl -s 42           # reconstruct game 42 (- = legacy game on TTT)
+//   ./tttJournal -f games.jnl -R -P replay_   # re-send every move/reset, into TTT/replay_<id>
+//
+// -t/-T limit -s and -R to a time window (Unix seconds), -g to one game
+// for -R, and -a makes -R re-send the host's own messages too.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+
+#include "mqtt.h"
+#include "reactor.h"
+#include "ttt.h"
+#include "tttWire.h"
+#include "tttTopics.h"
+#include "journal.h"
+
+// MQTT Configuration
+#define MQTT_HOST "" // Add your MQTT broker address here (empty means localhost)
+#define MQTT_PORT 1883
+#define MQTT_TOPIC "TTT"
+
+#define SYNC_INTERVAL_MS 1000
+
+const char *mqttHost = MQTT_HOST;
+int mqttPort = MQTT_PORT;
+const char *journalPath = NULL;
+const char *replayPrefix = "";
+const char *gameFilter = NULL;
+uint64_t fromNs = 0;
+uint64_t toNs = UINT64_MAX;
+int replayHostMessages = 0;
+
+Journal journal;
+MqttClient mqtt;
+Reactor reactor;
+unsigned long long recorded = 0;
+
+static uint64_t wallClockNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static double monotonicNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// "-" stands for the legacy game on TTT, which has an empty id
+static const char *displayId(const JournalRecord *r, char *buf, size_t size) {
+    if (r->idLen == 0) {
+        return "-";
+    }
+    snprintf(buf, size, "%.*s", (int)r->idLen, r->gameId);
+    return buf;
+}
+
+static void formatTime(uint64_t timeNs, char *buf, size_t size) {
+    time_t seconds = (time_t)(timeNs / 1000000000ull);
+    struct tm tm;
+
+    localtime_r(&seconds, &tm);
+    size_t n = strftime(buf, size, "%Y-%m-%d %H:%M:%S", &tm);
+    snprintf(buf + n, size - n, ".%03u", (unsigned int)(timeNs / 1000000ull % 1000));
+}
+
+// ---- Recording ----
+
+void onMqttMessage(const char *topic, size_t topicLen, const char *payload, size_t payloadLen, void *ctx) {
+    JournalRecord r;
+
+    if (journalRecordMessage(&r, wallClockNs(), topic, topicLen, payload, payloadLen) < 0) {
+        return;
+    }
+    if (journalAppend(&journal, &r) < 0) {
+        reactorStop(&reactor);
+        return;
+    }
+    recorded++;
+}
+
+void onMqttReadable(int fd, unsigned int events, void *ctx) {
+    int n;
+
+    while ((n = mqttRead(&mqtt)) > 0) {
+    }
+    if (n < 0) {
+        fprintf(stderr, "Lost connection to MQTT broker\n");
+        reactorStop(&reactor);
+    }
+}
+
+void onKeepaliveTimer(int fd, unsigned int events, void *ctx) {
+    mqttPing(&mqtt);
+    mqttFlush(&mqtt);
+}
+
+void onSyncTimer(int fd, unsigned int events, void *ctx) {
+    journalSync(&journal);
+}
+
+void signalHandler(int sig) {
+    reactorStop(&reactor);
+}
+
+int record() {
+    char clientId[32];
+
+    if (reactorInit(&reactor) < 0) {
+        return 1;
+    }
+
+    snprintf(clientId, sizeof(clientId), "TTT_jnl_%d", (int)getpid());
+    mqttInit(&mqtt, clientId, onMqttMessage, NULL);
+    if (mqttConnect(&mqtt, mqttHost, mqttPort) < 0 || mqttSubscribe(&mqtt, MQTT_TOPIC "/#", 0) < 0) {
+        return 1;
+    }
+    mqttSetNonBlocking(&mqtt);
+
+    reactorAdd(&reactor, mqtt.fd, EPOLLIN, onMqttReadable, NULL);
+    reactorAddTimer(&reactor, MQTT_KEEPALIVE * 1000 / 2, onKeepaliveTimer, NULL);
+    reactorAddTimer(&reactor, SYNC_INTERVAL_MS, onSyncTimer, NULL);
+
+    signal(SIGINT, signalHandler);
+    signal(SIGTERM, signalHandler);
+
+    fprintf(stderr, "Recording %s/# into %s (%llu records already)\n", MQTT_TOPIC, journalPath,
+            (unsigned long long)journalCount(&journal));
+    reactorRun(&reactor);
+
+    mqttDisconnect(&mqtt);
+    reactorClose(&reactor);
+    fprintf(stderr, "Recorded %llu events\n", recorded);
+    return 0;
+}
+
+// ---- Listing ----
+
+typedef struct {
+    uint64_t firstRecord;
+    uint32_t slot;
+} GameEntry;
+
+static int compareFirstRecord(const void *a, const void *b) {
+    const GameEntry *x = a;
+    const GameEntry *y = b;
+    return (x->firstRecord > y->firstRecord) - (x->firstRecord < y->firstRecord);
+}
+
+int listGames() {
+    JournalIndex idx;
+    char id[JOURNAL_ID_LEN + 1];
+    char first[32], last[32];
+    uint64_t n = 0;
+
+    if (journalIndexBuild(&idx, &journal) < 0) {
+        fprintf(stderr, "Out of memory building the index\n");
+        return 1;
+    }
+
+    // Games in order of first appearance
+    GameEntry *games = malloc((size_t)(idx.games ? idx.games : 1) * sizeof(GameEntry));
+    if (games == NULL) {
+        journalIndexFree(&idx);
+        return 1;
+    }
+    for (uint32_t i = 0; i <= idx.slotMask; i++) {
+        if (idx.slots[i].hash != 0) {
+            games[n].firstRecord = idx.positions[idx.slots[i].first];
+            games[n].slot = i;
+            n++;
+        }
+    }
+    qsort(games, n, sizeof(GameEntry), compareFirstRecord);
+
+    printf("%-28s %10s  %-23s  %-23s\n", "game", "events", "first", "last");
+    for (uint64_t g = 0; g < n; g++) {
+        const JournalIndexSlot *slot = &idx.slots[games[g].slot];
+        const JournalRecord *firstRecord = &journal.records[idx.positions[slot->first]];
+        const JournalRecord *lastRecord = &journal.records[idx.positions[slot->first + slot->count - 1]];
+
+        formatTime(firstRecord->timeNs, first, sizeof(first));
+        formatTime(lastRecord->timeNs, last, sizeof(last));
+        printf("%-28s %10llu  %s  %s\n", displayId(firstRecord, id, sizeof(id)),
+               (unsigned long long)slot->count, first, last);
+    }
+    printf("%llu games, %llu events\n", (unsigned long long)idx.games,
+           (unsigned long long)journalCount(&journal));
+
+    free(games);
+    journalIndexFree(&idx);
+    return 0;
+}
+
+// ---- Reconstructing one game ----
+
+static void printBoard(const TttBoard *b) {
+    for (int row = 0; row < 3; row++) {
+        printf("      %c | %c | %c\n", tttCellChar(b, row * 3), tttCellChar(b, row * 3 + 1),
+               tttCellChar(b, row * 3 + 2));
+        if (row < 2) {
+            printf("     ---+---+---\n");
+        }
+    }
+}
+
+int showGame(const char *gameId) {
+    JournalIndex idx;
+    uint64_t count;
+    size_t idLen = strcmp(gameId, "-") == 0 ? 0 : strlen(gameId);
+    const char *id = idLen ? gameId : "";
+    TttBoard board;
+    uint64_t startNs = 0;
+    unsigned long long events = 0, moves = 0, finished = 0;
+    int haveState = 0;
+
+    if (journalIndexBuild(&idx, &journal) < 0) {
+        fprintf(stderr, "Out of memory building the index\n");
+        return 1;
+    }
+
+    const uint64_t *positions = journalIndexFind(&idx, id, idLen, &count);
+    tttReset(&board);
+
+    for (uint64_t i = 0; i < count; i++) {
+        const JournalRecord *r = &journal.records[positions[i]];
+        const char *text = (const char *)r->payload;
+        int len = r->payloadLen;
+        TttState state;
+
+        // Hash collisions and the time window
+        if (r->idLen != idLen || memcmp(r->gameId, id, idLen) != 0 || r->timeNs < fromNs || r->timeNs >= toNs) {
+            continue;
+        }
+        if (events++ == 0) {
+            startNs = r->timeNs;
+        }
+        printf("%+10.3fs  ", (double)(r->timeNs - startNs) / 1e9);
+
+        if (r->flags & JOURNAL_TOO_LONG) {
+            printf("%-7s (too long for the journal)\n", r->type >= JOURNAL_HOST ? tttSubtopicNames[r->type - JOURNAL_HOST] :
+                   r->type == JOURNAL_MOVE ? "move" : "reset");
+            continue;
+        }
+
+        switch (r->type) {
+        case JOURNAL_MOVE:
+            printf("move    %.*s\n", len, text);
+            moves++;
+            break;
+        case JOURNAL_RESET:
+            printf("reset\n");
+            break;
+        case JOURNAL_HOST + TTT_SUB_STATE:
+            if (tttWireDecode(r->payload, r->payloadLen, &state) < 0) {
+                printf("state   (unreadable)\n");
+                break;
+            }
+            board = state.board;
+            haveState = 1;
+            printf("state   #%u  %s  X %u - O %u\n", state.seq,
+                   board.status == TTT_PLAYING ? (board.player ? "O to move" : "X to move") :
+                   board.status == TTT_DRAW ? "draw" : board.status == TTT_X_WINS ? "X wins" : "O wins",
+                   state.xWins, state.oWins);
+            if (board.status != TTT_PLAYING) {
+                finished++;
+            }
+            printBoard(&board);
+            break;
+        case JOURNAL_HOST + TTT_SUB_BOARD:
+            // Only text-mode hosts need this; TTT/state already showed the board
+            printf("board   %.*s\n", len, text);
+            if (!haveState) {
+                tttFromString(&board, text);
+                printBoard(&board);
+            }
+            break;
+        default:
+            printf("%-7s %.*s\n", tttSubtopicNames[r->type - JOURNAL_HOST], len, text);
+            break;
+        }
+    }
+
+    printf("%llu events, %llu moves, %llu finished games\n", events, moves, finished);
+    journalIndexFree(&idx);
+    return events > 0 ? 0 : 1;
+}
+
+// ---- Replay ----
+
+static int shouldReplay(const JournalRecord *r) {
+    return !(r->flags & JOURNAL_TOO_LONG) && (replayHostMessages || r->type < JOURNAL_HOST);
+}
+
+int replay() {
+    char clientId[32];
+    char topic[128];
+    unsigned long long sent = 0;
+    JournalIndex idx;
+    const uint64_t *positions = NULL;
+    uint64_t count;
+    uint64_t first = journalFindTime(&journal, fromNs);
+    size_t filterLen = 0;
+
+    // One game: walk its index entries; otherwise the time range directly
+    if (gameFilter != NULL) {
+        filterLen = strcmp(gameFilter, "-") == 0 ? 0 : strlen(gameFilter);
+        if (journalIndexBuild(&idx, &journal) < 0) {
+            return 1;
+        }
+        positions = journalIndexFind(&idx, filterLen ? gameFilter : "", filterLen, &count);
+    } else {
+        count = journalFindTime(&journal, toNs) - first;
+    }
+
+    snprintf(clientId, sizeof(clientId), "TTT_rpl_%d", (int)getpid());
+    mqttInit(&mqtt, clientId, NULL, NULL);
+    if (mqttConnect(&mqtt, mqttHost, mqttPort) < 0) {
+        return 1;
+    }
+
+    // Everything is queued and goes out in full socket buffers
+    mqttCork(&mqtt, 1);
+    double start = monotonicNow();
+
+    for (uint64_t i = 0; i < count; i++) {
+        const JournalRecord *r = positions ? &journal.records[positions[i]] : &journal.records[first + i];
+
+        if (positions && (r->idLen != filterLen || memcmp(r->gameId, gameFilter, filterLen) != 0 ||
+                          r->timeNs < fromNs || r->timeNs >= toNs)) {
+            continue;
+        }
+        if (!shouldReplay(r)) {
+            continue;
+        }
+
+        journalTopic(r, replayPrefix, topic, sizeof(topic));
+        if (mqttPublish(&mqtt, topic, r->payload, r->payloadLen, 0, r->type == JOURNAL_HOST + TTT_SUB_STATE) < 0) {
+            fprintf(stderr, "Publish failed after %llu events\n", sent);
+            break;
+        }
+        sent++;
+    }
+
+    mqttCork(&mqtt, 0);
+    mqttFlush(&mqtt);
+    double elapsed = monotonicNow() - start;
+    mqttDisconnect(&mqtt);
+
+    printf("Replayed %llu events in %.3f s (%.0f events/s)\n", sent, elapsed, elapsed > 0 ? sent / elapsed : 0.0);
+    if (gameFilter != NULL) {
+        journalIndexFree(&idx);
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+    int listMode = 0, replayMode = 0;
+    const char *showId = NULL;
+
+    while ((opt = getopt(argc, argv, "h:p:f:Ls:RP:g:t:T:a")) != -1) {
+        switch (opt) {
+        case 'h':
+            mqttHost = optarg;
+            break;
+        case 'p':
+            mqttPort = atoi(optarg);
+            break;
+        case 'f':
+            journalPath = optarg;
+            break;
+        case 'L':
+            listMode = 1;
+            break;
+        case 's':
+            showId = optarg;
+            break;
+        case 'R':
+            replayMode = 1;
+            break;
+        case 'P':
+            replayPrefix = optarg;
+            break;
+        case 'g':
+            gameFilter = optarg;
+            break;
+        case 't':
+            fromNs = (uint64_t)(atof(optarg) * 1e9);
+            break;
+        case 'T':
+            toNs = (uint64_t)(atof(optarg) * 1e9);
+            break;
+        case 'a':
+            replayHostMessages = 1;
+            break;
+        default:
+            journalPath = NULL;
+            break;
+        }
+    }
+
+    if (journalPath == NULL) {
+        fprintf(stderr, "Usage: %s -f journal [-h host] [-p port]          record TTT/#\n"
+                "       %s -f journal -L                               list games\n"
+                "       %s -f journal -s gameId [-t from] [-T to]      reconstruct a game\n"
+                "       %s -f journal -R [-g gameId] [-P prefix] [-a] [-t from] [-T to]  replay\n",
+                argv[0], argv[0], argv[0], argv[0]);
+        return 1;
+    }
+
+    int recording = !listMode && !replayMode && showId == NULL;
+    if (journalOpen(&journal, journalPath, recording) < 0) {
+        return 1;
+    }
+
+    int status;
+    if (listMode) {
+        status = listGames();
+    } else if (showId != NULL) {
+        status = showGame(showId);
+    } else if (replayMode) {
+        status = replay();
+    } else {
+        status = record();
+    }
+
+    journalClose(&journal);
+    return status;
+}
@@ -0,0 +1,1322 @@
+// tttServer.c - Host-side Tic-Tac-Toe game server
+// Runs the same rules as TicTacToe.ino, but for thousands of games at once.
+// Each game lives on its own topic: moves/resets arrive on TTT/p<n>/<gameId>
+// (its partition, see tttTopics.h) or plain TTT/<gameId>, and the binary
+// game state (tttWire.h) is published retained on
+// TTT/<gameId>/state, one message per move, so controlLinux -g <gameId> can
+// play against it. With -T the old board/player/board_formatted/moves/
+// status/score text topics are published as well.
+// With -l the server also hosts the single legacy game on TTT itself.
+// With -v (e.g. -v 15x15k5) every game is a larger k-in-a-row variant run
+// on tttGrid.h, published in the grid state format on the same topics.
+// With -i <clientId> the server keeps a persistent session under that id
+// and subscribes to commands at QoS 1, so the broker holds QoS 1 commands
+// while it reconnects.
+// With -W <workerId> several servers share the games: each partition of
+// game ids belongs to one worker by rendezvous hashing over the workers
+// announced on TTTworkers/<workerId>, and partitions move when workers
+// join or leave (see "Worker mode" below).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+
+#include "mqtt.h"
+#include "reactor.h"
+#include "ttt.h"
+#include "tttWire.h"
+#include "tttGrid.h"
+#include "tttTopics.h"
+#include "metrics.h"
+
+// MQTT Configuration
+#define MQTT_HOST "" // Add your MQTT broker address here (empty means localhost)
+#define MQTT_PORT 1883
+#define MQTT_TOPIC "TTT"
+
+#define DEFAULT_MAX_GAMES 65536
+#define GAME_ID_LEN 28
+
+// Worker mode (-W)
+#define WORKER_TOPIC "TTTworkers"
+#define MAX_WORKERS 64
+#define WORKER_ID_LEN 24
+#define QUEUE_SIZE 65536       // commands held while games are handed over
+#define QUEUED_COMMAND_LEN 8   // longer than any move, reset or snapshot request
+
+// Hot per-game state: exactly what goes into TTT/<gameId>/state (board,
+// sequence number, last move, score), 14 bytes per game
+typedef TttState Game;
+
+// Per-game state when running a tttGrid.h variant
+typedef TttGridState GridGame;
+
+// Cold per-game data, only touched when looking a game up by id
+typedef struct {
+    uint32_t hash;    // 0 = empty slot
+    uint32_t game;    // index into games[]
+    char id[GAME_ID_LEN];
+} GameSlot;
+
+const char *mqttHost = MQTT_HOST;
+int mqttPort = MQTT_PORT;
+int hostLegacyGame = 0;
+int textTopics = 0;
+int quiet = 0;
+const char *sessionId = NULL;  // -i: stable client id with a persistent session
+
+// Geometry of every game with -v; gridGames is 0 for plain 3x3
+TttGrid variant;
+int gridGames = 0;
+
+MqttClient mqtt;
+Reactor reactor;
+int reconnectTimer = -1;
+
+Game *games = NULL;
+GridGame *grids = NULL;   // instead of games with -v
+GameSlot *slots = NULL;
+uint32_t maxGames = DEFAULT_MAX_GAMES;
+uint32_t slotMask = 0;
+uint32_t gameCount = 0;
+
+// Exported with -m/-M, see registerMetrics()
+MetricCounter movesProcessed;
+MetricCounter movesRejected;
+MetricCounter commands[3];              // moves, resets, snapshot requests
+MetricCounter parseFailures;            // unreadable commands and bad game ids
+MetricCounter published[TTT_SUB_COUNT];
+MetricCounter gamesGauge;
+MetricHistogram readLatency;            // socket readable -> every answer queued
+
+// Worker mode. The workers subscribed to a partition see its commands and
+// the TTTworkers/ messages in the same order from the broker, so they agree
+// on who owns a game at each command without talking to each other.
+typedef struct {
+    uint32_t hash;
+    int awaitingHandover;   // joined before us and hasn't handed over yet
+    int handoverDue;        // joined after us, gets a handover once we're idle
+    char id[WORKER_ID_LEN];
+} Worker;
+
+typedef struct {
+    char id[GAME_ID_LEN];
+    uint8_t idLen;
+    uint8_t len;
+    char command[QUEUED_COMMAND_LEN];
+} QueuedCommand;
+
+#define WORKER_IDLE 0
+#define WORKER_WAITING 1    // joined, waiting for the older workers' handovers
+#define WORKER_LOADING 2    // reading retained states of games we don't hold
+
+#define HELD_NO 0           // state not ours, or stale
+#define HELD_YES 1
+#define HELD_LOADED 2       // read during the current load
+
+const char *workerId = NULL;
+uint32_t workerHash = 0;
+Worker workers[MAX_WORKERS];
+int workerCount = 0;
+int workerAnnounced = 0;   // the existing workers are known, our announcement is out
+int workerJoined = 0;      // ... and has come back
+int workerState = WORKER_IDLE;
+unsigned int loadGeneration = 0;
+uint8_t *held = NULL;       // per game index
+uint8_t partitionSubscribed[TTT_PARTITIONS];
+QueuedCommand *queue = NULL;
+uint32_t queueHead = 0, queueCount = 0;
+
+MetricCounter workersGauge;
+MetricCounter partitionsGauge;
+MetricCounter rebalances;
+MetricCounter commandsQueued;
+MetricCounter commandsDropped;
+
+#define COMMAND_MOVE 0
+#define COMMAND_RESET 1
+#define COMMAND_SNAPSHOT 2
+
+// Allocate the game table. The slot table is kept at most half full.
+int initGames(uint32_t capacity) {
+    uint32_t slotCount = 1;
+    while (slotCount < capacity * 2) {
+        slotCount <<= 1;
+    }
+
+    if (gridGames) {
+        grids = calloc(capacity, sizeof(GridGame));
+    } else {
+        games = calloc(capacity, sizeof(Game));
+    }
+    slots = calloc(slotCount, sizeof(GameSlot));
+    if ((games == NULL && grids == NULL) || slots == NULL) {
+        fprintf(stderr, "Out of memory for %u games\n", capacity);
+        return -1;
+    }
+
+    if (workerId != NULL) {
+        held = calloc(capacity, 1);
+        queue = calloc(QUEUE_SIZE, sizeof(QueuedCommand));
+        if (held == NULL || queue == NULL) {
+            fprintf(stderr, "Out of memory for %u games\n", capacity);
+            return -1;
+        }
+    }
+
+    maxGames = capacity;
+    slotMask = slotCount - 1;
+    gameCount = 0;
+    return 0;
+}
+
+// A new game: empty board, no score
+static void clearGame(uint32_t index) {
+    if (gridGames) {
+        memset(&grids[index], 0, sizeof(GridGame));
+        grids[index].board = variant;
+        grids[index].lastMove = TTT_NO_MOVE;
+    } else {
+        memset(&games[index], 0, sizeof(Game));
+        games[index].lastMove = TTT_NO_MOVE;
+    }
+}
+
+// Find a game by id, creating it on first use. Returns 0 and the game's
+// index into games[] (or grids[]), or -1 when full.
+int findGame(const char *id, size_t len, uint32_t *index) {
+    uint32_t h = tttGameHash(id, len);
+    uint32_t i = h & slotMask;
+
+    if (len >= GAME_ID_LEN) {
+        return -1;
+    }
+
+    while (slots[i].hash != 0) {
+        if (slots[i].hash == h && strncmp(slots[i].id, id, len) == 0 && slots[i].id[len] == '\0') {
+            *index = slots[i].game;
+            return 0;
+        }
+        i = (i + 1) & slotMask;
+    }
+
+    if (gameCount >= maxGames) {
+        return -1;
+    }
+
+    slots[i].hash = h;
+    slots[i].game = gameCount;
+    memcpy(slots[i].id, id, len);
+    slots[i].id[len] = '\0';
+
+    *index = gameCount;
+    clearGame(gameCount);
+    gameCount++;
+    metricSet(&gamesGauge, gameCount);
+    return 0;
+}
+
+// Publish to "TTT/<id>/<sub>" (or "TTT/<sub>" for the legacy game), with
+// sub one of the TTT_SUB_* subtopics
+static void publishTo(const char *id, int sub, const void *payload, size_t len, int retain) {
+    char topic[96];
+
+    if (id[0] == '\0') {
+        snprintf(topic, sizeof(topic), "%s/%s", MQTT_TOPIC, tttSubtopicNames[sub]);
+    } else {
+        snprintf(topic, sizeof(topic), "%s/%s/%s", MQTT_TOPIC, id, tttSubtopicNames[sub]);
+    }
+    mqttPublish(&mqtt, topic, payload, len, 0, retain);
+    metricInc(&published[sub]);
+}
+
+// Publish the retained binary state, plus board, player and formatted
+// board in text mode, like publishCurrentState() on the ESP32
+void publishCurrentState(const Game *g, const char *id) {
+    uint8_t wire[TTT_WIRE_SIZE];
+
+    tttWireEncode(g, wire);
+    publishTo(id, TTT_SUB_STATE, wire, sizeof(wire), 1);
+
+    if (!textTopics) {
+        return;
+    }
+
+    char state[10];
+    char player[2] = {tttPlayerChar(&g->board), '\0'};
+    char formatted[64];
+    size_t len = 0;
+
+    tttToString(&g->board, state);
+    state[9] = '\0';
+
+    publishTo(id, TTT_SUB_BOARD, state, 9, 0);
+
+    publishTo(id, TTT_SUB_PLAYER, player, 1, 0);
+
+    // Same layout as getFormattedBoardString()
+    formatted[len++] = '\n';
+    for (int i = 0; i < 3; i++) {
+        formatted[len++] = ' ';
+        for (int j = 0; j < 3; j++) {
+            formatted[len++] = state[i * 3 + j];
+            if (j < 2) {
+                memcpy(formatted + len, " | ", 3);
+                len += 3;
+            }
+        }
+        formatted[len++] = '\n';
+        if (i < 2) {
+            memcpy(formatted + len, "-----------\n", 12);
+            len += 12;
+        }
+    }
+    publishTo(id, TTT_SUB_BOARD_FORMATTED, formatted, len, 0);
+}
+
+// A new state: bump the sequence number and publish it
+void publishGameState(Game *g, const char *id) {
+    g->seq++;
+    publishCurrentState(g, id);
+}
+
+// Publish the score, like updateScores() on the ESP32
+void publishScore(const char *id, unsigned int xWins, unsigned int oWins) {
+    char score[32];
+    int len = snprintf(score, sizeof(score), "X:%u,O:%u", xWins, oWins);
+
+    publishTo(id, TTT_SUB_SCORE, score, (size_t)len, 0);
+}
+
+void publishStatus(const char *id, const char *status) {
+
+    publishTo(id, TTT_SUB_STATUS, status, strlen(status), 0);
+}
+
+// Start a new game, keeping the score
+void resetGame(Game *g, const char *id) {
+    tttReset(&g->board);
+    g->lastMove = TTT_NO_MOVE;
+
+    if (id != NULL) {
+        if (textTopics) {
+            publishStatus(id, "reset");
+        }
+        publishGameState(g, id);
+    }
+}
+
+// Apply a move (0-indexed). Returns 0 if it was played, -1 if rejected.
+// id is NULL when running without a broker (benchmark mode).
+int makeMove(Game *g, const char *id, int row, int col) {
+    if (row < 0 || row > 2 || col < 0 || col > 2) {
+        metricInc(&movesRejected);
+        return -1;
+    }
+
+    char symbol = tttPlayerChar(&g->board);
+    int result = tttPlay(&g->board, row * 3 + col);
+
+    if (result == TTT_ILLEGAL) {
+        metricInc(&movesRejected);
+        return -1;
+    }
+
+    g->lastMove = (int8_t)(row * 3 + col);
+    metricInc(&movesProcessed);
+
+    if (id != NULL && textTopics) {
+        char move[8] = {(char)('1' + row), ',', (char)('1' + col), ',', symbol, '\0'};
+        publishTo(id, TTT_SUB_MOVES, move, 5, 0);
+    }
+
+    if (result == TTT_WON) {
+        if (g->board.player) {
+            g->oWins++;
+        } else {
+            g->xWins++;
+        }
+
+        if (id != NULL && textTopics) {
+            char winMessage[8] = {symbol, ' ', 'w', 'i', 'n', 's', '\0'};
+            publishScore(id, g->xWins, g->oWins);
+            publishStatus(id, winMessage);
+        }
+    }
+    else if (result == TTT_DREW && id != NULL && textTopics) {
+        publishStatus(id, "draw");
+    }
+
+    if (id != NULL) {
+        publishGameState(g, id);
+    }
+    return 0;
+}
+
+// ---- tttGrid.h variants (-v) ----
+
+// Publish the retained grid state, plus board, player, variant and
+// formatted board in text mode
+void publishCurrentGridState(const GridGame *g, const char *id) {
+    uint8_t wire[TTT_GRID_WIRE_MAX];
+    size_t len = tttGridWireEncode(g, wire);
+
+    publishTo(id, TTT_SUB_STATE, wire, len, 1);
+
+    if (!textTopics) {
+        return;
+    }
+
+    const TttGrid *b = &g->board;
+    char state[TTT_GRID_MAX * TTT_GRID_MAX];
+    char player[2] = {tttGridPlayerChar(b), '\0'};
+    char name[16];
+    char formatted[TTT_GRID_MAX * (TTT_GRID_MAX * 2 + 1) + 1];
+    int cells = b->width * b->height;
+
+    publishTo(id, TTT_SUB_VARIANT, name, (size_t)tttGridVariantString(b, name, sizeof(name)), 1);
+
+    tttGridToString(b, state);
+    publishTo(id, TTT_SUB_BOARD, state, (size_t)cells, 0);
+
+    publishTo(id, TTT_SUB_PLAYER, player, 1, 0);
+
+    // One line per row, cells separated by spaces, '.' for empty
+    len = 0;
+    formatted[len++] = '\n';
+    for (int i = 0; i < cells; i++) {
+        formatted[len++] = state[i] == ' ' ? '.' : state[i];
+        formatted[len++] = (i + 1) % b->width == 0 ? '\n' : ' ';
+    }
+    publishTo(id, TTT_SUB_BOARD_FORMATTED, formatted, len, 0);
+}
+
+void publishGridState(GridGame *g, const char *id) {
+    g->seq++;
+    publishCurrentGridState(g, id);
+}
+
+void resetGridGame(GridGame *g, const char *id) {
+    tttGridReset(&g->board);
+    g->lastMove = TTT_NO_MOVE;
+
+    if (id != NULL) {
+        if (textTopics) {
+            publishStatus(id, "reset");
+        }
+        publishGridState(g, id);
+    }
+}
+
+// makeMove() for a grid game (0-indexed row and column)
+int makeGridMove(GridGame *g, const char *id, int row, int col) {
+    char symbol = tttGridPlayerChar(&g->board);
+    int result = tttGridPlay(&g->board, row, col);
+
+    if (result == TTT_ILLEGAL) {
+        metricInc(&movesRejected);
+        return -1;
+    }
+
+    g->lastMove = (int16_t)(row * g->board.width + col);
+    metricInc(&movesProcessed);
+
+    if (id != NULL && textTopics) {
+        char move[16];
+        int len = snprintf(move, sizeof(move), "%d,%d,%c", row + 1, col + 1, symbol);
+        publishTo(id, TTT_SUB_MOVES, move, (size_t)len, 0);
+    }
+
+    if (result == TTT_WON) {
+        if (g->board.player) {
+            g->oWins++;
+        } else {
+            g->xWins++;
+        }
+
+        if (id != NULL && textTopics) {
+            char winMessage[8] = {symbol, ' ', 'w', 'i', 'n', 's', '\0'};
+            publishScore(id, g->xWins, g->oWins);
+            publishStatus(id, winMessage);
+        }
+    }
+    else if (result == TTT_DREW && id != NULL && textTopics) {
+        publishStatus(id, "draw");
+    }
+
+    if (id != NULL) {
+        publishGridState(g, id);
+    }
+    return 0;
+}
+
+// Parse "row,col" (1-indexed, up to two digits each) into 0-indexed
+// row and column. Returns 0 or -1.
+static int parseMove(const char *message, size_t len, int *row, int *col) {
+    int v[2] = {0, 0};
+    int field = 0;
+    int digits = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        if (message[i] >= '0' && message[i] <= '9' && digits < 2) {
+            v[field] = v[field] * 10 + (message[i] - '0');
+            digits++;
+        } else if (message[i] == ',' && field == 0 && digits > 0) {
+            field = 1;
+            digits = 0;
+        } else {
+            break;
+        }
+    }
+    if (field == 0 || digits == 0) {
+        return -1;
+    }
+
+    *row = v[0] - 1;
+    *col = v[1] - 1;
+    return 0;
+}
+
+// Handle a command for a grid game
+void handleGridCommand(GridGame *g, const char *gameId, const char *message, size_t len) {
+    int row, col;
+
+    if (len >= 1 && (message[0] == 'r' || message[0] == 'R')) {
+        metricInc(&commands[COMMAND_RESET]);
+        resetGridGame(g, gameId);
+    }
+    else if (len >= 1 && (message[0] == 's' || message[0] == 'S')) {
+        metricInc(&commands[COMMAND_SNAPSHOT]);
+        publishCurrentGridState(g, gameId);
+    }
+    else if (parseMove(message, len, &row, &col) == 0) {
+        metricInc(&commands[COMMAND_MOVE]);
+        makeGridMove(g, gameId, row, col);
+
+        if (g->board.status != TTT_PLAYING) {
+            resetGridGame(g, gameId);
+        }
+    }
+    else {
+        metricInc(&parseFailures);
+    }
+}
+
+// Handle a command ("row,col" or "r") for one game
+void handleCommand(const char *id, size_t idLen, const char *message, size_t len) {
+    uint32_t index;
+
+    if (findGame(id, idLen, &index) < 0) {
+        metricInc(&parseFailures);
+        if (!quiet) {
+            fprintf(stderr, "Game table full or bad id, ignoring %.*s\n", (int)idLen, id);
+        }
+        return;
+    }
+
+    // A worker's first command for a game it didn't have the state of:
+    // nobody had it, so it starts fresh (an old copy from before it was
+    // handed away would be stale)
+    if (held != NULL && held[index] == HELD_NO) {
+        clearGame(index);
+        held[index] = HELD_YES;
+    }
+
+    char gameId[GAME_ID_LEN];
+    memcpy(gameId, id, idLen);
+    gameId[idLen] = '\0';
+
+    if (gridGames) {
+        handleGridCommand(&grids[index], gameId, message, len);
+        return;
+    }
+
+    Game *g = &games[index];
+    int row, col;
+
+    if (len >= 1 && (message[0] == 'r' || message[0] == 'R')) {
+        metricInc(&commands[COMMAND_RESET]);
+        resetGame(g, gameId);
+        return;
+    }
+
+    // Snapshot request from a client that just connected: send the
+    // current state again, same sequence number
+    if (len >= 1 && (message[0] == 's' || message[0] == 'S')) {
+        metricInc(&commands[COMMAND_SNAPSHOT]);
+        publishCurrentState(g, gameId);
+        return;
+    }
+
+    // "row,col", 1-indexed like the ESP32 protocol
+    if (parseMove(message, len, &row, &col) == 0) {
+        metricInc(&commands[COMMAND_MOVE]);
+        makeMove(g, gameId, row, col);
+
+        // The ESP32 starts a new game straight after a win or draw
+        if (g->board.status != TTT_PLAYING) {
+            resetGame(g, gameId);
+        }
+    } else {
+        metricInc(&parseFailures);
+    }
+}
+
+// ---- Worker mode (-W) ----
+//
+// Each worker announces itself with a retained, non-empty message on
+// TTTworkers/<workerId>, with an empty retained will on the same topic, so
+// a worker that exits or dies is announced gone. Games are grouped into
+// the TTT_PARTITIONS partitions of tttTopics.h by game id, and clients
+// send commands to TTT/p<n>/<gameId>. A partition belongs to the worker
+// with the highest mix(hash(workerId) ^ hash(partition)) (rendezvous
+// hashing): a join moves only the partitions the new worker wins, a leave
+// only the ones the leaver held, each spread evenly over the others. A
+// worker subscribes to the partitions it owns and no others, so the
+// broker hands each command to one worker.
+//
+// Before announcing itself, a worker reads the announcements already
+// retained, up to its own marker on TTTworkers/<workerId>/sync, and
+// subscribes to the partitions it is about to win. The old owner of such a
+// partition sees the announcement in line with the partition's commands
+// and stops at the same command the new one starts at. After a leave the
+// remaining workers subscribe to their share of the leaver's partitions;
+// commands sent to them before that arrives are lost, as are those sent
+// to a dead worker before its will goes out.
+//
+// Game state travels through the broker. A worker about to own games it
+// doesn't hold queues their commands, subscribes to the retained
+// TTT/+/state until its own sync marker comes back, and then plays the
+// queue. On a join it first waits for a message on
+// TTTworkers/<olderWorker>/handover from every older worker, which each
+// sends once the state of every game it processed is on its way. A worker
+// that left has already published all of its states.
+
+// Bit mixer (murmur3's finaliser): a worker's score for a partition
+static inline uint32_t mixHash(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+// Does this worker own partition p, among the workers known and itself?
+// Before it has announced itself that is what it will own once it has.
+static int ownsPartition(unsigned int p) {
+    uint32_t partitionHash = (p + 1) * 0x9e3779b9u;
+    uint32_t bestScore = mixHash(workerHash ^ partitionHash), bestHash = workerHash;
+
+    for (int i = 0; i < workerCount; i++) {
+        uint32_t score = mixHash(workers[i].hash ^ partitionHash);
+        if (score > bestScore || (score == bestScore && workers[i].hash > bestHash)) {
+            bestScore = score;
+            bestHash = workers[i].hash;
+        }
+    }
+    return bestHash == workerHash;
+}
+
+static int ownsGame(uint32_t gameHash) {
+    return ownsPartition(tttPartitionOf(gameHash));
+}
+
+// Subscribe to the partitions we own now and drop the others
+static void updatePartitions() {
+    char filter[32];
+    int owned = 0;
+
+    for (unsigned int p = 0; p < TTT_PARTITIONS; p++) {
+        int own = ownsPartition(p);
+
+        owned += own;
+        if (own == partitionSubscribed[p]) {
+            continue;
+        }
+        snprintf(filter, sizeof(filter), "%s/p%u/+", MQTT_TOPIC, p);
+        if (own) {
+            mqttSubscribe(&mqtt, filter, 0);
+        } else {
+            mqttUnsubscribe(&mqtt, filter);
+        }
+        partitionSubscribed[p] = (uint8_t)own;
+    }
+    metricSet(&partitionsGauge, (uint64_t)owned);
+}
+
+static Worker *findWorker(const char *id, size_t len) {
+    for (int i = 0; i < workerCount; i++) {
+        if (strlen(workers[i].id) == len && memcmp(workers[i].id, id, len) == 0) {
+            return &workers[i];
+        }
+    }
+    return NULL;
+}
+
+static void publishWorker(const char *sub, const void *payload, size_t len, int retain) {
+    char topic[64];
+
+    if (sub == NULL) {
+        snprintf(topic, sizeof(topic), "%s/%s", WORKER_TOPIC, workerId);
+    } else {
+        snprintf(topic, sizeof(topic), "%s/%s/%s", WORKER_TOPIC, workerId, sub);
+    }
+    mqttPublish(&mqtt, topic, payload, len, 0, retain);
+}
+
+static void queueCommand(const char *id, size_t idLen, const char *message, size_t len) {
+    if (queueCount == QUEUE_SIZE) {
+        metricInc(&commandsDropped);
+        return;
+    }
+
+    QueuedCommand *q = &queue[(queueHead + queueCount) & (QUEUE_SIZE - 1)];
+    memcpy(q->id, id, idLen);
+    q->idLen = (uint8_t)idLen;
+    q->len = (uint8_t)(len < QUEUED_COMMAND_LEN ? len : QUEUED_COMMAND_LEN);
+    memcpy(q->command, message, q->len);
+    queueCount++;
+    metricInc(&commandsQueued);
+}
+
+// Read the retained states of every game we don't hold (also of games
+// that aren't ours now but have queued commands; rebalance() drops them).
+// Starting again throws away what an earlier load read, since a worker
+// that has left since may have moved those games on.
+static void startLoading() {
+    char generation[16];
+    int len;
+
+    for (uint32_t i = 0; i < gameCount; i++) {
+        if (held[i] == HELD_LOADED) {
+            held[i] = HELD_NO;
+        }
+    }
+
+    workerState = WORKER_LOADING;
+    loadGeneration++;
+    mqttSubscribe(&mqtt, MQTT_TOPIC "/+/state", 0);
+    if (hostLegacyGame) {
+        mqttSubscribe(&mqtt, MQTT_TOPIC "/state", 0);
+    }
+    len = snprintf(generation, sizeof(generation), "%u", loadGeneration);
+    publishWorker("sync", generation, (size_t)len, 0);
+}
+
+static void loadState(const char *id, size_t idLen, const uint8_t *payload, size_t len) {
+    uint32_t index;
+
+    if (findGame(id, idLen, &index) < 0 || held[index] != HELD_NO) {
+        return;
+    }
+    if (gridGames) {
+        TttGridState s;
+        if (tttGridWireDecode(payload, len, &s) < 0 || s.board.width != variant.width ||
+            s.board.height != variant.height || s.board.k != variant.k) {
+            return;
+        }
+        grids[index] = s;
+    } else if (tttWireDecode(payload, len, &games[index]) < 0) {
+        return;
+    }
+    held[index] = HELD_LOADED;
+}
+
+// Forget the games that belong to someone else now. Returns the number
+// of games held.
+static uint32_t rebalance() {
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i <= slotMask; i++) {
+        if (slots[i].hash == 0) {
+            continue;
+        }
+        uint32_t index = slots[i].game;
+        if (!ownsGame(slots[i].hash)) {
+            held[index] = HELD_NO;
+        } else if (held[index] == HELD_LOADED) {
+            held[index] = HELD_YES;
+        }
+        count += held[index] == HELD_YES;
+    }
+    metricInc(&rebalances);
+    return count;
+}
+
+// Idle again: everything we processed is published, so the workers that
+// joined meanwhile can take their games
+static uint32_t sendHandovers() {
+    uint32_t count = rebalance();
+
+    for (int i = 0; i < workerCount; i++) {
+        if (workers[i].handoverDue) {
+            workers[i].handoverDue = 0;
+            publishWorker("handover", workers[i].id, strlen(workers[i].id), 0);
+        }
+    }
+    return count;
+}
+
+static void finishLoading() {
+    mqttUnsubscribe(&mqtt, MQTT_TOPIC "/+/state");
+    if (hostLegacyGame) {
+        mqttUnsubscribe(&mqtt, MQTT_TOPIC "/state");
+    }
+    workerState = WORKER_IDLE;
+
+    // Commands were queued by the owner at the time they came in, so they
+    // are all played, even for games that have moved on since
+    while (queueCount > 0) {
+        QueuedCommand *q = &queue[queueHead];
+        queueHead = (queueHead + 1) & (QUEUE_SIZE - 1);
+        queueCount--;
+        handleCommand(q->id, q->idLen, q->command, q->len);
+    }
+    uint32_t count = sendHandovers();
+
+    if (!quiet) {
+        printf("Worker %s holds %u of %u known games, %d workers\n", workerId, count, gameCount, workerCount);
+        fflush(stdout);
+    }
+}
+
+static void checkHandovers() {
+    for (int i = 0; i < workerCount; i++) {
+        if (workers[i].awaitingHandover) {
+            return;
+        }
+    }
+    startLoading();
+}
+
+static void onWorkerJoin(const char *id, size_t len) {
+    if (len >= WORKER_ID_LEN || findWorker(id, len) != NULL) {
+        return;
+    }
+    if (workerCount == MAX_WORKERS) {
+        fprintf(stderr, "Too many workers, ignoring %.*s\n", (int)len, id);
+        return;
+    }
+
+    Worker *w = &workers[workerCount++];
+    memset(w, 0, sizeof(*w));
+    w->hash = tttGameHash(id, len);
+    memcpy(w->id, id, len);
+    metricSet(&workersGauge, (uint64_t)workerCount);
+    if (workerAnnounced) {
+        updatePartitions();
+    }
+
+    if (w->hash == workerHash && strcmp(w->id, workerId) == 0) {
+        // Our own announcement: everyone seen so far is older
+        workerJoined = 1;
+        for (int i = 0; i < workerCount - 1; i++) {
+            workers[i].awaitingHandover = 1;
+        }
+        workerState = WORKER_WAITING;
+        checkHandovers();
+    } else if (workerJoined) {
+        w->handoverDue = 1;
+        if (workerState == WORKER_IDLE) {
+            sendHandovers();
+        }
+    }
+}
+
+static void onWorkerLeave(const char *id, size_t len) {
+    Worker *w = findWorker(id, len);
+
+    if (w == NULL || (w->hash == workerHash && strcmp(w->id, workerId) == 0)) {
+        return;
+    }
+    *w = workers[--workerCount];
+    metricSet(&workersGauge, (uint64_t)workerCount);
+    if (workerAnnounced) {
+        updatePartitions();
+    }
+
+    if (!workerJoined) {
+        return;
+    }
+    if (workerState == WORKER_WAITING) {
+        checkHandovers();
+    } else {
+        startLoading();
+    }
+}
+
+// Every worker there before us is known: take our partitions, then
+// announce ourselves
+static void announceWorker() {
+    char pid[16];
+    int len = snprintf(pid, sizeof(pid), "%d", (int)getpid());
+
+    updatePartitions();
+    publishWorker(NULL, pid, (size_t)len, 1);
+    workerAnnounced = 1;
+}
+
+// A message on TTTworkers/#
+static void onWorkerMessage(const char *topic, size_t topicLen, const char *payload, size_t payloadLen) {
+    size_t baseLen = sizeof(WORKER_TOPIC);  // including the '/'
+    const char *id = topic + baseLen;
+    const char *slash = memchr(id, '/', topicLen - baseLen);
+    size_t idLen = slash != NULL ? (size_t)(slash - id) : topicLen - baseLen;
+
+    if (slash == NULL) {
+        // A stale announcement of our own from an earlier run
+        if (mqtt.retained && idLen == strlen(workerId) && memcmp(id, workerId, idLen) == 0) {
+            return;
+        }
+        if (payloadLen > 0) {
+            onWorkerJoin(id, idLen);
+        } else {
+            onWorkerLeave(id, idLen);
+        }
+        return;
+    }
+
+    const char *sub = slash + 1;
+    size_t subLen = topicLen - (size_t)(sub - topic);
+    Worker *from = findWorker(id, idLen);
+
+    if (subLen == 8 && memcmp(sub, "handover", 8) == 0) {
+        if (from != NULL && workerState == WORKER_WAITING && payloadLen == strlen(workerId) &&
+            memcmp(payload, workerId, payloadLen) == 0) {
+            from->awaitingHandover = 0;
+            checkHandovers();
+        }
+    } else if (subLen == 4 && memcmp(sub, "sync", 4) == 0) {
+        if (idLen != strlen(workerId) || memcmp(id, workerId, idLen) != 0) {
+            return;
+        }
+        if (!workerAnnounced) {
+            announceWorker();
+        } else if (workerState == WORKER_LOADING && strtoul(payload, NULL, 10) == loadGeneration) {
+            finishLoading();
+        }
+    }
+}
+
+// A command in worker mode: played, queued or someone else's
+static void workerCommand(const char *id, size_t idLen, const char *message, size_t len) {
+    if (!workerJoined || idLen >= GAME_ID_LEN || !ownsGame(tttGameHash(id, idLen))) {
+        return;
+    }
+    if (workerState != WORKER_IDLE) {
+        queueCommand(id, idLen, message, len);
+        return;
+    }
+    handleCommand(id, idLen, message, len);
+}
+
+// Called for every message on TTT, TTT/+ and TTT/p<n>/+ (and TTTworkers/#
+// and, while loading, the retained states in worker mode)
+void onMqttMessage(const char *topic, size_t topicLen, const char *payload, size_t payloadLen, void *ctx) {
+    size_t baseLen = sizeof(MQTT_TOPIC) - 1;
+    size_t stateLen = sizeof("/state") - 1;
+
+    if (workerId != NULL && topicLen > sizeof(WORKER_TOPIC) &&
+        memcmp(topic, WORKER_TOPIC "/", sizeof(WORKER_TOPIC)) == 0) {
+        onWorkerMessage(topic, topicLen, payload, payloadLen);
+        return;
+    }
+
+    if (topicLen < baseLen || memcmp(topic, MQTT_TOPIC, baseLen) != 0) {
+        return;
+    }
+
+    // Legacy single game on TTT
+    if (topicLen == baseLen) {
+        if (hostLegacyGame && workerId != NULL) {
+            workerCommand("", 0, payload, payloadLen);
+        } else if (hostLegacyGame) {
+            handleCommand("", 0, payload, payloadLen);
+        }
+        return;
+    }
+
+    if (topic[baseLen] != '/') {
+        return;
+    }
+
+    const char *id = topic + baseLen + 1;
+    size_t idLen = topicLen - baseLen - 1;
+
+    // Retained TTT/<id>/state (TTT/state for the legacy game) while a
+    // worker loads the games it is taking over
+    if (workerId != NULL && workerState == WORKER_LOADING && mqtt.retained && topicLen >= baseLen + stateLen &&
+        memcmp(topic + topicLen - stateLen, "/state", stateLen) == 0) {
+        if (topicLen == baseLen + stateLen) {
+            if (hostLegacyGame) {
+                loadState("", 0, (const uint8_t *)payload, payloadLen);
+            }
+        } else {
+            loadState(id, idLen - stateLen, (const uint8_t *)payload, payloadLen);
+        }
+        return;
+    }
+
+    // TTT/p<n>/<gameId>, a command sent to the game's partition
+    size_t partition = tttPartitionLevel(id, idLen);
+    if (partition > 0 && memchr(id + partition, '/', idLen - partition) == NULL) {
+        id += partition;
+        idLen -= partition;
+    }
+
+    // Only commands from here on; deeper topics are states
+    if (memchr(id, '/', idLen) != NULL) {
+        return;
+    }
+
+    // Our own state publishes for the legacy game come back on TTT/+, and
+    // those of a game called p<n> on TTT/p<n>/+; they can't be used as
+    // game ids
+    for (int i = 0; i < TTT_SUB_COUNT; i++) {
+        if (strlen(tttSubtopicNames[i]) == idLen && memcmp(id, tttSubtopicNames[i], idLen) == 0) {
+            return;
+        }
+    }
+
+    if (workerId != NULL) {
+        workerCommand(id, idLen, payload, payloadLen);
+    } else {
+        handleCommand(id, idLen, payload, payloadLen);
+    }
+}
+
+// Subscribe to the command topics, unless the broker kept our session.
+// TTT/<gameId> is still taken for clients that don't use partitions. A
+// worker subscribes to its partitions once it knows the other workers.
+// QoS 1 only with a persistent session, where the broker keeps them.
+void subscribeCommands() {
+    char filter[32];
+    int qos = mqtt.persistent ? 1 : 0;
+
+    if (mqtt.sessionPresent) {
+        return;
+    }
+    mqttSubscribe(&mqtt, MQTT_TOPIC "/+", qos);
+    if (hostLegacyGame) {
+        mqttSubscribe(&mqtt, MQTT_TOPIC, qos);
+    }
+    if (workerId == NULL) {
+        for (unsigned int p = 0; p < TTT_PARTITIONS; p++) {
+            snprintf(filter, sizeof(filter), "%s/p%u/+", MQTT_TOPIC, p);
+            mqttSubscribe(&mqtt, filter, qos);
+        }
+    }
+}
+
+// Lost the broker: keep the games and reconnect after a backoff. A worker
+// exits instead (its will tells the others who takes its games over).
+void connectionLost() {
+    fprintf(stderr, "Lost connection to MQTT broker\n");
+    if (workerId != NULL) {
+        reactorStop(&reactor);
+        return;
+    }
+    reactorRemove(&reactor, mqtt.fd);
+    reactorSetTimer(reconnectTimer, mqttBackoff(&mqtt), 0);
+}
+
+void onMqttReadable(int fd, unsigned int events, void *ctx);
+
+void onReconnectTimer(int fd, unsigned int events, void *ctx) {
+    if (mqttConnect(&mqtt, mqttHost, mqttPort) < 0) {
+        reactorSetTimer(reconnectTimer, mqttBackoff(&mqtt), 0);
+        return;
+    }
+    subscribeCommands();
+    mqttSetNonBlocking(&mqtt);
+    mqttFlush(&mqtt);  // corked
+    reactorAdd(&reactor, mqtt.fd, EPOLLIN | (mqttPending(&mqtt) > 0 ? EPOLLOUT : 0), onMqttReadable, NULL);
+    printf("Reconnected to MQTT broker%s\n", mqtt.sessionPresent ? ", session kept" : "");
+    fflush(stdout);
+}
+
+// Socket readable: handle every queued command, then send all the
+// resulting publishes in one write
+void onMqttReadable(int fd, unsigned int events, void *ctx) {
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        int n;
+        while ((n = mqttRead(&mqtt)) > 0) {
+        }
+
+        if (n < 0) {
+            connectionLost();
+            return;
+        }
+    }
+
+    if (mqttFlush(&mqtt) < 0) {
+        connectionLost();
+        return;
+    }
+
+    reactorModify(&reactor, fd, EPOLLIN | (mqttPending(&mqtt) > 0 ? EPOLLOUT : 0));
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    metricObserveNs(&readLatency, (uint64_t)(end.tv_sec - start.tv_sec) * 1000000000ull +
+                                      (uint64_t)end.tv_nsec - (uint64_t)start.tv_nsec);
+}
+
+void onKeepaliveTimer(int fd, unsigned int events, void *ctx) {
+    if (mqtt.connected) {
+        mqttPing(&mqtt);
+        mqttFlush(&mqtt);
+    }
+}
+
+void onStatsTimer(int fd, unsigned int events, void *ctx) {
+    static unsigned long long lastMoves = 0;
+
+    if (!quiet) {
+        printf("games: %u  moves: %llu (+%llu/s)  rejected: %llu\n",
+               gameCount, (unsigned long long)movesProcessed.value, (movesProcessed.value - lastMoves) / 10,
+               (unsigned long long)movesRejected.value);
+        fflush(stdout);
+    }
+    lastMoves = movesProcessed.value;
+}
+
+void registerMetrics() {
+    static const char *commandNames[] = {"move", "reset", "snapshot"};
+    char labels[64];
+
+    metricCounter(&movesProcessed, "ttt_server_moves_total", "result=\"played\"", "Moves handled, by result");
+    metricCounter(&movesRejected, "ttt_server_moves_total", "result=\"rejected\"", "Moves handled, by result");
+    for (int i = 0; i < 3; i++) {
+        snprintf(labels, sizeof(labels), "kind=\"%s\"", commandNames[i]);
+        metricCounter(&commands[i], "ttt_server_commands_total", labels, "Commands received, by kind");
+    }
+    metricCounter(&parseFailures, "ttt_server_parse_failures_total", NULL,
+                  "Commands that were not a move, reset or snapshot request, or had a bad game id");
+    for (int i = 0; i < TTT_SUB_COUNT; i++) {
+        snprintf(labels, sizeof(labels), "topic=\"%s\"", tttSubtopicNames[i]);
+        metricCounter(&published[i], "ttt_server_messages_out_total", labels, "Messages published, by subtopic");
+    }
+    metricGauge(&gamesGauge, "ttt_server_games", NULL, "Games in the game table");
+    metricHistogram(&readLatency, "ttt_server_read_seconds", NULL,
+                    "Time from the broker socket turning readable to every answer being written");
+    if (workerId != NULL) {
+        metricGauge(&workersGauge, "ttt_server_workers", NULL, "Workers sharing the games, this one included");
+        metricGauge(&partitionsGauge, "ttt_server_partitions", NULL, "Game partitions this worker owns");
+        metricCounter(&rebalances, "ttt_server_rebalances_total", NULL, "Times games were handed to other workers");
+        metricCounter(&commandsQueued, "ttt_server_commands_queued_total", NULL,
+                      "Commands held back while games were being handed over");
+        metricCounter(&commandsDropped, "ttt_server_commands_dropped_total", NULL,
+                      "Commands lost because the handover queue was full");
+    }
+}
+
+void signalHandler(int sig) {
+    reactorStop(&reactor);
+}
+
+// Play random games in-process to measure raw engine throughput
+void runBenchmark(unsigned long long moveCount) {
+    struct timespec start, end;
+    uint32_t seed = 12345;
+    uint32_t index;
+    char id[16];
+
+    for (uint32_t i = 0; i < maxGames; i++) {
+        snprintf(id, sizeof(id), "%u", i);
+        findGame(id, strlen(id), &index);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (gridGames) {
+        int cells = variant.width * variant.height;
+
+        for (unsigned long long n = 0; n < moveCount; n++) {
+            seed = seed * 1664525u + 1013904223u;
+            GridGame *g = &grids[(seed >> 8) % gameCount];
+            // A second step for the cell: the low bits left over from the
+            // game pick would keep hitting the same few cells
+            seed = seed * 1664525u + 1013904223u;
+            int cell = (int)((seed >> 8) % (uint32_t)cells);
+
+            makeGridMove(g, NULL, cell / variant.width, cell % variant.width);
+            if (g->board.status != TTT_PLAYING) {
+                resetGridGame(g, NULL);
+            }
+        }
+    } else {
+        for (unsigned long long n = 0; n < moveCount; n++) {
+            seed = seed * 1664525u + 1013904223u;
+            Game *g = &games[(seed >> 8) % gameCount];
+            int cell = (int)((seed >> 4) % 9);
+
+            makeMove(g, NULL, cell / 3, cell % 3);
+            if (g->board.status != TTT_PLAYING) {
+                resetGame(g, NULL);
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%llu move attempts over %u games in %.3f s: %.0f attempts/s (%llu played, %llu rejected)\n",
+           moveCount, gameCount, seconds, moveCount / seconds, (unsigned long long)movesProcessed.value,
+           (unsigned long long)movesRejected.value);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned long long benchMoves = 0;
+    int width, height, k;
+    int opt;
+
+    const char *metricsFile = NULL;
+    int metricsPort = 0;
+
+    while ((opt = getopt(argc, argv, "h:p:n:B:v:lqTm:M:W:i:")) != -1) {
+        switch (opt) {
+        case 'h':
+            mqttHost = optarg;
+            break;
+        case 'p':
+            mqttPort = atoi(optarg);
+            break;
+        case 'n':
+            maxGames = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 'B':
+            benchMoves = strtoull(optarg, NULL, 10);
+            break;
+        case 'l':
+            hostLegacyGame = 1;
+            break;
+        case 'q':
+            quiet = 1;
+            break;
+        case 'T':
+            textTopics = 1;
+            break;
+        case 'm':
+            metricsPort = atoi(optarg);
+            break;
+        case 'M':
+            metricsFile = optarg;
+            break;
+        case 'W':
+            workerId = optarg;
+            if (workerId[0] == '\0' || strlen(workerId) >= WORKER_ID_LEN || strchr(workerId, '/') != NULL ||
+                strchr(workerId, '+') != NULL || strchr(workerId, '#') != NULL) {
+                fprintf(stderr, "Bad worker id %s\n", workerId);
+                return 1;
+            }
+            workerHash = tttGameHash(workerId, strlen(workerId));
+            break;
+        case 'i':
+            sessionId = optarg;
+            break;
+        case 'v':
+            if (tttGridParseVariant(optarg, strlen(optarg), &width, &height, &k) < 0 ||
+                tttGridInit(&variant, width, height, k) < 0) {
+                fprintf(stderr, "Bad variant %s, expected e.g. 15x15k5 (up to 16x16)\n", optarg);
+                return 1;
+            }
+            // Plain 3x3 stays on ttt.h and the format the ESP32 speaks
+            gridGames = !tttGridIsClassic(&variant);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-h host] [-p port] [-n maxGames] [-v variant] [-l] [-T] [-q] [-B benchMoves] "
+                    "[-m metricsPort] [-M metricsFile] [-W workerId] [-i clientId]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (maxGames == 0 || initGames(maxGames) < 0) {
+        return 1;
+    }
+
+    if (benchMoves > 0) {
+        runBenchmark(benchMoves);
+        return 0;
+    }
+
+    if (reactorInit(&reactor) < 0) {
+        return 1;
+    }
+
+    char clientId[32];
+    snprintf(clientId, sizeof(clientId), "TTT_srv_%d", (int)getpid());
+    mqttInit(&mqtt, sessionId != NULL ? sessionId : clientId, onMqttMessage, NULL);
+
+    // If we vanish, the broker announces it for us. A worker's session
+    // must start clean. The others keep theirs across reconnects when -i
+    // names it; one per pid would be left behind on the broker by every run.
+    char workerTopic[64];
+    if (workerId != NULL) {
+        snprintf(workerTopic, sizeof(workerTopic), "%s/%s", WORKER_TOPIC, workerId);
+        mqttSetWill(&mqtt, workerTopic, "", 0, 1);
+    } else {
+        mqttSetPersistent(&mqtt, sessionId != NULL);
+    }
+
+    if (mqttConnect(&mqtt, mqttHost, mqttPort) < 0) {
+        return 1;
+    }
+    subscribeCommands();
+
+    // The workers already there arrive retained, then our sync marker, and
+    // announceWorker() takes it from there
+    if (workerId != NULL) {
+        mqttSubscribe(&mqtt, WORKER_TOPIC "/#", 0);
+        publishWorker("sync", "0", 1, 0);
+    }
+
+    // Publishes are batched per read and flushed together
+    mqttSetNonBlocking(&mqtt);
+    mqttCork(&mqtt, 1);
+
+    reactorAdd(&reactor, mqtt.fd, EPOLLIN, onMqttReadable, NULL);
+    reactorAddTimer(&reactor, MQTT_KEEPALIVE * 1000 / 2, onKeepaliveTimer, NULL);
+    reactorAddTimer(&reactor, 10000, onStatsTimer, NULL);
+    reconnectTimer = reactorAddTimer(&reactor, 0, onReconnectTimer, NULL);
+
+    registerMetrics();
+    if ((metricsPort > 0 && metricsServe(&reactor, metricsPort) < 0) ||
+        (metricsFile != NULL && metricsDumpTo(&reactor, metricsFile) < 0)) {
+        return 1;
+    }
+
+    signal(SIGINT, signalHandler);
+    signal(SIGTERM, signalHandler);
+
+    if (gridGames) {
+        char name[16];
+        tttGridVariantString(&variant, name, sizeof(name));
+        printf("Game server running, up to %u games of %s\n", maxGames, name);
+    } else {
+        printf("Game server running, up to %u games\n", maxGames);
+    }
+    if (workerId != NULL) {
+        printf("Worker %s, sharing games with the others on %s/#\n", workerId, WORKER_TOPIC);
+    }
+    fflush(stdout);
+
+    reactorRun(&reactor);
+
+    // Leaving: every state we published goes out before the announcement
+    if (workerId != NULL) {
+        mqttPublish(&mqtt, workerTopic, "", 0, 0, 1);
+    }
+    mqttCork(&mqtt, 0);
+    mqttDisconnect(&mqtt);
+    reactorClose(&reactor);
+    metricsDump();
+    printf("Served %u games, %llu moves (%llu rejected)\n", gameCount, (unsigned long long)movesProcessed.value,
+           (unsigned long long)movesRejected.value);
+    return 0;
+}
@@ -0,0 +1,113 @@
+// tttSolver.c - Perfect play for 3x3 Tic-Tac-Toe by table lookup
+
+#include <string.h>
+
+#include "tttSolver.h"
+
+#define TABLE_SIZE 19683  // 3^9
+#define UNSOLVED   127
+
+// pow3Sum[mask] = sum of 3^i over the set bits, so a board's index is
+// pow3Sum[x] + 2 * pow3Sum[o]
+static uint16_t pow3Sum[512];
+
+static int8_t values[TABLE_SIZE];
+static uint16_t bestMoves[TABLE_SIZE];
+static int reachable = 0;
+static int initialised = 0;
+
+static inline int boardIndex(uint16_t x, uint16_t o) {
+    return pow3Sum[x] + 2 * pow3Sum[o];
+}
+
+// Negamax over the position with the side to move owning `me`, memoised
+// in the table. Only runs from tttSolverInit().
+static int solve(uint16_t me, uint16_t them, int xToMove) {
+    uint16_t x = xToMove ? me : them;
+    uint16_t o = xToMove ? them : me;
+    int index = boardIndex(x, o);
+
+    if (values[index] != UNSOLVED) {
+        return values[index];
+    }
+    reachable++;
+
+    uint16_t empty = (uint16_t)(~(me | them) & TTT_FULL_BOARD);
+    int best = -100;
+    uint16_t bestMask = 0;
+
+    if (tttIsWin(them)) {
+        // The previous move won, nothing left to play
+        best = -(1 + __builtin_popcount(empty));
+    } else if (empty == 0) {
+        best = 0;
+    } else {
+        for (int cell = 0; cell < 9; cell++) {
+            if (!(empty & (1u << cell))) {
+                continue;
+            }
+            int value = -solve(them, (uint16_t)(me | (1u << cell)), !xToMove);
+            if (value > best) {
+                best = value;
+                bestMask = (uint16_t)(1u << cell);
+            } else if (value == best) {
+                bestMask |= (uint16_t)(1u << cell);
+            }
+        }
+    }
+
+    values[index] = (int8_t)best;
+    bestMoves[index] = bestMask;
+    return best;
+}
+
+void tttSolverInit(void) {
+    if (initialised) {
+        return;
+    }
+
+    for (int mask = 0; mask < 512; mask++) {
+        int sum = 0;
+        int power = 1;
+        for (int i = 0; i < 9; i++) {
+            if (mask & (1 << i)) {
+                sum += power;
+            }
+            power *= 3;
+        }
+        pow3Sum[mask] = (uint16_t)sum;
+    }
+
+    memset(values, UNSOLVED, sizeof(values));
+    memset(bestMoves, 0, sizeof(bestMoves));
+    reachable = 0;
+    solve(0, 0, 1);
+    initialised = 1;
+}
+
+uint16_t tttBestMoves(const TttBoard *b) {
+    return bestMoves[boardIndex(b->x, b->o)];
+}
+
+int tttBestMove(const TttBoard *b, unsigned int rnd) {
+    uint16_t moves = tttBestMoves(b);
+
+    if (moves == 0) {
+        return -1;
+    }
+
+    // Pick the (rnd mod count)-th set bit
+    int skip = (int)(rnd % (unsigned int)__builtin_popcount(moves));
+    while (skip-- > 0) {
+        moves &= (uint16_t)(moves - 1);
+    }
+    return __builtin_ctz(moves);
+}
+
+int tttValue(const TttBoard *b) {
+    return values[boardIndex(b->x, b->o)];
+}
+
+int tttReachablePositions(void) {
+    return reachable;
+}
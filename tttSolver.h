@@ -0,0 +1,38 @@
+// tttSolver.h - Perfect play for 3x3 Tic-Tac-Toe by table lookup
+// tttSolverInit() solves every reachable position once (about 5,478 of
+// them) into a table indexed by the base-3 encoding of the board, so
+// picking a move during play is a single array read, no search.
+
+#ifndef TTT_SOLVER_H
+#define TTT_SOLVER_H
+
+#include <stdint.h>
+
+#include "ttt.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Build the table. Cheap (well under a millisecond) and idempotent.
+void tttSolverInit(void);
+
+// Mask of all optimal cells for the side to move, 0 if the game is over
+uint16_t tttBestMoves(const TttBoard *b);
+
+// One optimal cell (0..8) for the side to move, -1 if the game is over.
+// When several moves are equally good, rnd picks between them.
+int tttBestMove(const TttBoard *b, unsigned int rnd);
+
+// Game value for the side to move: >0 win, 0 draw, <0 loss.
+// The magnitude grows the sooner the result is reached.
+int tttValue(const TttBoard *b);
+
+// Number of positions reachable from the empty board
+int tttReachablePositions(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,526 @@
+// tttStats.c - Long-running game statistics from the state stream
+// Follows every TTT/state and TTT/<gameId>/state message (live on TTT/#,
+// or from a tttJournal file) and counts finished games as they happen:
+// X wins, O wins, draws, games reset before the end, and moves played.
+// Nothing is ever rescanned: each finished game is added once to its
+// game's totals and to hourly buckets, and every query reads a running
+// sum or one bucket.
+//
+//   ./tttStats                                   # live, queries on TTTstats/query
+//   ./tttStats -f games.jnl total day "game 42"  # from a journal
+//
+// Queries: "total", "day" (last 24 hours), "week" (last 168 hours),
+// "hour <n>" (n hours ago, 0 = this hour), "game <gameId>" (all time and
+// last 24 hours, - for the legacy game on TTT). Answers are one JSON line,
+// published on TTTstats/reply live.
+//
+// The counts come from the host's own states, not from xWins/oWins, so
+// they keep going when the ESP32 wipes its score. A game whose end we
+// didn't see start (the first state of every game, e.g. the retained one)
+// only primes the tracking.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+
+#include "mqtt.h"
+#include "reactor.h"
+#include "ttt.h"
+#include "tttWire.h"
+#include "tttGrid.h"
+#include "tttTopics.h"
+#include "journal.h"
+
+// MQTT Configuration
+#define MQTT_HOST "" // Add your MQTT broker address here (empty means localhost)
+#define MQTT_PORT 1883
+#define MQTT_TOPIC "TTT"
+#define QUERY_TOPIC "TTTstats/query"
+#define REPLY_TOPIC "TTTstats/reply"
+
+#define DEFAULT_MAX_GAMES 65536
+#define GAME_ID_LEN 28
+#define GAME_WINDOW_HOURS 24
+#define DAY_HOURS 24
+#define WEEK_HOURS 168
+#define NS_PER_HOUR 3600000000000ull
+
+typedef struct {
+    uint32_t games;      // finished games
+    uint32_t xWins;
+    uint32_t oWins;
+    uint32_t draws;
+    uint32_t abandoned;  // reset with moves on the board
+    uint32_t moves;      // in finished games
+} StatsCounts;
+
+// The last size hours in hourly buckets, plus their sum. Moving to a new
+// hour clears the buckets that fell out, at most size of them.
+typedef struct {
+    uint64_t hour;        // hour of the newest bucket
+    StatsCounts sum;
+    StatsCounts *buckets; // bucket for hour h is buckets[h % size]
+    int size;
+} StatsWindow;
+
+typedef struct {
+    StatsCounts total;
+    StatsWindow day;
+    uint16_t seq;        // last state seen
+    uint16_t filled;
+    uint8_t status;
+    uint8_t seen;        // seq/filled/status are valid
+} GameStats;
+
+typedef struct {
+    uint32_t hash;    // 0 = empty slot
+    uint32_t game;    // index into games[]
+    char id[GAME_ID_LEN];
+} GameSlot;
+
+const char *mqttHost = MQTT_HOST;
+int mqttPort = MQTT_PORT;
+
+MqttClient mqtt;
+Reactor reactor;
+
+GameStats *games = NULL;
+StatsCounts *gameBuckets = NULL;
+GameSlot *slots = NULL;
+uint32_t maxGames = DEFAULT_MAX_GAMES;
+uint32_t slotMask = 0;
+uint32_t gameCount = 0;
+
+StatsCounts total;
+StatsCounts dayBuckets[DAY_HOURS];
+StatsCounts weekBuckets[WEEK_HOURS];
+StatsWindow day = {0, {0}, dayBuckets, DAY_HOURS};
+StatsWindow week = {0, {0}, weekBuckets, WEEK_HOURS};
+
+uint64_t latestHour = 0;         // newest event, the clock for journal queries
+unsigned long long events = 0;
+unsigned long long droppedGames = 0;  // game table full
+
+static uint64_t wallClockNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// FNV-1a, never returns 0 so 0 can mark an empty slot
+static uint32_t hashId(const char *id, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)id[i]) * 16777619u;
+    }
+    return h ? h : 1;
+}
+
+// ---- Windows ----
+
+static void countsAdd(StatsCounts *a, const StatsCounts *b) {
+    a->games += b->games;
+    a->xWins += b->xWins;
+    a->oWins += b->oWins;
+    a->draws += b->draws;
+    a->abandoned += b->abandoned;
+    a->moves += b->moves;
+}
+
+static void countsSub(StatsCounts *a, const StatsCounts *b) {
+    a->games -= b->games;
+    a->xWins -= b->xWins;
+    a->oWins -= b->oWins;
+    a->draws -= b->draws;
+    a->abandoned -= b->abandoned;
+    a->moves -= b->moves;
+}
+
+// Make hour the newest bucket, dropping the ones that are now too old
+static void windowAdvance(StatsWindow *w, uint64_t hour) {
+    if (hour <= w->hour) {
+        return;
+    }
+    if (hour - w->hour >= (uint64_t)w->size) {
+        memset(w->buckets, 0, (size_t)w->size * sizeof(StatsCounts));
+        memset(&w->sum, 0, sizeof(w->sum));
+    } else {
+        for (uint64_t h = w->hour + 1; h <= hour; h++) {
+            StatsCounts *b = &w->buckets[h % (uint64_t)w->size];
+            countsSub(&w->sum, b);
+            memset(b, 0, sizeof(*b));
+        }
+    }
+    w->hour = hour;
+}
+
+static void windowAdd(StatsWindow *w, uint64_t hour, const StatsCounts *c) {
+    windowAdvance(w, hour);
+    // A little late (clock steps, out of order journal): still in range?
+    if (w->hour - hour < (uint64_t)w->size) {
+        countsAdd(&w->buckets[hour % (uint64_t)w->size], c);
+        countsAdd(&w->sum, c);
+    }
+}
+
+// The bucket for ago hours before the newest one, NULL if out of range
+static const StatsCounts *windowBucket(const StatsWindow *w, uint64_t ago) {
+    if (ago >= (uint64_t)w->size || ago > w->hour) {
+        return NULL;
+    }
+    return &w->buckets[(w->hour - ago) % (uint64_t)w->size];
+}
+
+// ---- Games ----
+
+// Allocate the game table. The slot table is kept at most half full.
+int initGames(uint32_t capacity) {
+    uint32_t slotCount = 1;
+    while (slotCount < capacity * 2) {
+        slotCount <<= 1;
+    }
+
+    games = calloc(capacity, sizeof(GameStats));
+    gameBuckets = calloc((size_t)capacity * GAME_WINDOW_HOURS, sizeof(StatsCounts));
+    slots = calloc(slotCount, sizeof(GameSlot));
+    if (games == NULL || gameBuckets == NULL || slots == NULL) {
+        fprintf(stderr, "Out of memory for %u games\n", capacity);
+        return -1;
+    }
+
+    maxGames = capacity;
+    slotMask = slotCount - 1;
+    gameCount = 0;
+    return 0;
+}
+
+// Find a game by id. With create, add it on first use. Returns NULL if
+// it isn't there or the table is full.
+GameStats *findGame(const char *id, size_t len, int create) {
+    uint32_t h = hashId(id, len);
+    uint32_t i = h & slotMask;
+
+    if (len >= GAME_ID_LEN) {
+        return NULL;
+    }
+
+    while (slots[i].hash != 0) {
+        if (slots[i].hash == h && strncmp(slots[i].id, id, len) == 0 && slots[i].id[len] == '\0') {
+            return &games[slots[i].game];
+        }
+        i = (i + 1) & slotMask;
+    }
+
+    if (!create || gameCount >= maxGames) {
+        return NULL;
+    }
+
+    GameStats *g = &games[gameCount];
+    g->day.buckets = &gameBuckets[(size_t)gameCount * GAME_WINDOW_HOURS];
+    g->day.size = GAME_WINDOW_HOURS;
+
+    slots[i].hash = h;
+    slots[i].game = gameCount++;
+    memcpy(slots[i].id, id, len);
+    slots[i].id[len] = '\0';
+    return g;
+}
+
+// Decode a binary state: tttWire.h from a 3x3 host, tttGrid.h for the
+// variants. Returns 0 or -1.
+static int decodeState(const unsigned char *payload, size_t len, TttGridState *out) {
+    TttState classic;
+
+    if (len > 0 && payload[0] == TTT_GRID_WIRE_TAG) {
+        return tttGridWireDecode(payload, len, out);
+    }
+    if (tttWireDecode(payload, len, &classic) < 0) {
+        return -1;
+    }
+    tttGridFromBoard(&out->board, &classic.board);
+    out->seq = classic.seq;
+    out->lastMove = classic.lastMove;
+    return 0;
+}
+
+// One state published for game id at timeNs
+void statsState(uint64_t timeNs, const char *id, size_t idLen, const unsigned char *payload, size_t len) {
+    TttGridState next;
+    StatsCounts c;
+    uint64_t hour = timeNs / NS_PER_HOUR;
+
+    if (decodeState(payload, len, &next) < 0) {
+        return;
+    }
+    GameStats *g = findGame(id, idLen, 1);
+    if (g == NULL) {
+        droppedGames++;
+        return;
+    }
+    events++;
+    if (hour > latestHour) {
+        latestHour = hour;
+    }
+
+    // An "s" answer or a repeat of the retained state
+    if (g->seen && next.seq == g->seq) {
+        return;
+    }
+
+    memset(&c, 0, sizeof(c));
+    if (g->seen && next.board.status != TTT_PLAYING && g->status == TTT_PLAYING) {
+        c.games = 1;
+        c.xWins = next.board.status == TTT_X_WINS;
+        c.oWins = next.board.status == TTT_O_WINS;
+        c.draws = next.board.status == TTT_DRAW;
+        c.moves = next.board.filled;
+    } else if (g->seen && next.board.filled == 0 && g->status == TTT_PLAYING && g->filled > 0) {
+        c.abandoned = 1;
+    }
+
+    g->seq = next.seq;
+    g->filled = next.board.filled;
+    g->status = next.board.status;
+    g->seen = 1;
+
+    if (c.games || c.abandoned) {
+        countsAdd(&g->total, &c);
+        windowAdd(&g->day, hour, &c);
+        countsAdd(&total, &c);
+        windowAdd(&day, hour, &c);
+        windowAdd(&week, hour, &c);
+    }
+}
+
+// ---- Queries ----
+
+static int formatCounts(char *out, size_t size, const StatsCounts *c) {
+    double games = c->games ? (double)c->games : 1.0;
+
+    return snprintf(out, size,
+                    "\"games\":%u,\"x_wins\":%u,\"o_wins\":%u,\"draws\":%u,\"abandoned\":%u,"
+                    "\"x_win_rate\":%.4f,\"o_win_rate\":%.4f,\"draw_rate\":%.4f,\"avg_moves\":%.2f",
+                    c->games, c->xWins, c->oWins, c->draws, c->abandoned, c->xWins / games,
+                    c->oWins / games, c->draws / games, c->moves / games);
+}
+
+// Answer one query into out as a JSON line, at hour now
+void statsQuery(const char *query, size_t len, uint64_t now, char *out, size_t size) {
+    char q[64];
+    char id[GAME_ID_LEN + 1];
+    char counts[320], dayCounts[320];
+    unsigned long ago;
+
+    snprintf(q, sizeof(q), "%.*s", (int)len, query);
+    windowAdvance(&day, now);
+    windowAdvance(&week, now);
+
+    if (strcmp(q, "total") == 0) {
+        formatCounts(counts, sizeof(counts), &total);
+        snprintf(out, size, "{\"query\":\"total\",%s,\"tracked_games\":%u,\"events\":%llu}", counts, gameCount,
+                 events);
+    } else if (strcmp(q, "day") == 0 || strcmp(q, "week") == 0) {
+        formatCounts(counts, sizeof(counts), q[0] == 'd' ? &day.sum : &week.sum);
+        snprintf(out, size, "{\"query\":\"%s\",%s}", q, counts);
+    } else if (sscanf(q, "hour %lu", &ago) == 1 || strcmp(q, "hour") == 0) {
+        if (strcmp(q, "hour") == 0) {
+            ago = 0;
+        }
+        const StatsCounts *b = windowBucket(&week, ago);
+        if (b == NULL) {
+            snprintf(out, size, "{\"query\":\"hour\",\"error\":\"only the last %d hours are kept\"}", WEEK_HOURS);
+            return;
+        }
+        formatCounts(counts, sizeof(counts), b);
+        snprintf(out, size, "{\"query\":\"hour\",\"start\":%llu,%s}", (unsigned long long)(now - ago) * 3600,
+                 counts);
+    } else if (sscanf(q, "game %28s", id) == 1) {
+        size_t idLen = strcmp(id, "-") == 0 ? 0 : strlen(id);
+        GameStats *g = findGame(id, idLen, 0);
+        if (g == NULL) {
+            snprintf(out, size, "{\"query\":\"game\",\"game\":\"%s\",\"error\":\"no such game\"}", id);
+            return;
+        }
+        windowAdvance(&g->day, now);
+        formatCounts(counts, sizeof(counts), &g->total);
+        formatCounts(dayCounts, sizeof(dayCounts), &g->day.sum);
+        snprintf(out, size, "{\"query\":\"game\",\"game\":\"%s\",%s,\"day\":{%s}}", id, counts, dayCounts);
+    } else {
+        snprintf(out, size, "{\"query\":\"%s\",\"error\":\"use total, day, week, hour <n> or game <id>\"}", q);
+    }
+}
+
+// ---- Live ----
+
+void onMqttMessage(const char *topic, size_t topicLen, const char *payload, size_t payloadLen, void *ctx) {
+    static const char prefix[] = MQTT_TOPIC "/";
+    static const char suffix[] = "state";
+    size_t prefixLen = sizeof(prefix) - 1, suffixLen = sizeof(suffix) - 1;
+    char reply[1024];
+
+    if (topicLen == sizeof(QUERY_TOPIC) - 1 && memcmp(topic, QUERY_TOPIC, topicLen) == 0) {
+        statsQuery(payload, payloadLen, wallClockNs() / NS_PER_HOUR, reply, sizeof(reply));
+        mqttPublishString(&mqtt, REPLY_TOPIC, reply);
+        return;
+    }
+
+    // TTT/state or TTT/<gameId>/state
+    if (topicLen < prefixLen + suffixLen || memcmp(topic, prefix, prefixLen) != 0 ||
+        memcmp(topic + topicLen - suffixLen, suffix, suffixLen) != 0) {
+        return;
+    }
+    const char *id = topic + prefixLen;
+    size_t idLen = topicLen - prefixLen - suffixLen;
+    if (idLen > 0) {
+        if (id[idLen - 1] != '/' || memchr(id, '/', idLen - 1) != NULL) {
+            return;
+        }
+        idLen--;
+    }
+    statsState(wallClockNs(), id, idLen, (const unsigned char *)payload, payloadLen);
+}
+
+void onMqttReadable(int fd, unsigned int events, void *ctx) {
+    int n;
+
+    if (events & EPOLLOUT) {
+        mqttFlush(&mqtt);
+    }
+    while ((n = mqttRead(&mqtt)) > 0) {
+    }
+    if (n < 0) {
+        fprintf(stderr, "Lost connection to MQTT broker\n");
+        reactorStop(&reactor);
+        return;
+    }
+    reactorModify(&reactor, fd, EPOLLIN | (mqttPending(&mqtt) > 0 ? EPOLLOUT : 0));
+}
+
+void onKeepaliveTimer(int fd, unsigned int events, void *ctx) {
+    mqttPing(&mqtt);
+    mqttFlush(&mqtt);
+}
+
+void signalHandler(int sig) {
+    reactorStop(&reactor);
+}
+
+int follow() {
+    char clientId[32];
+    char reply[1024];
+
+    if (reactorInit(&reactor) < 0) {
+        return 1;
+    }
+
+    snprintf(clientId, sizeof(clientId), "TTT_stats_%d", (int)getpid());
+    mqttInit(&mqtt, clientId, onMqttMessage, NULL);
+    if (mqttConnect(&mqtt, mqttHost, mqttPort) < 0 || mqttSubscribe(&mqtt, MQTT_TOPIC "/#", 0) < 0 ||
+        mqttSubscribe(&mqtt, QUERY_TOPIC, 0) < 0) {
+        return 1;
+    }
+    mqttSetNonBlocking(&mqtt);
+
+    reactorAdd(&reactor, mqtt.fd, EPOLLIN, onMqttReadable, NULL);
+    reactorAddTimer(&reactor, MQTT_KEEPALIVE * 1000 / 2, onKeepaliveTimer, NULL);
+
+    signal(SIGINT, signalHandler);
+    signal(SIGTERM, signalHandler);
+
+    fprintf(stderr, "Following %s/#, queries on %s\n", MQTT_TOPIC, QUERY_TOPIC);
+    reactorRun(&reactor);
+
+    mqttDisconnect(&mqtt);
+    reactorClose(&reactor);
+
+    statsQuery("total", 5, wallClockNs() / NS_PER_HOUR, reply, sizeof(reply));
+    printf("%s\n", reply);
+    return 0;
+}
+
+// ---- Journal ----
+
+int readJournal(const char *path, char **queries, int queryCount) {
+    Journal journal;
+    char reply[1024];
+    struct timespec start, end;
+
+    if (journalOpen(&journal, path, 0) < 0) {
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t count = journalCount(&journal);
+    unsigned long long tooLong = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        const JournalRecord *r = &journal.records[i];
+        if (r->type != JOURNAL_HOST + TTT_SUB_STATE) {
+            continue;
+        }
+        if (r->flags & JOURNAL_TOO_LONG) {
+            tooLong++;
+        } else {
+            statsState(r->timeNs, r->gameId, r->idLen, r->payload, r->payloadLen);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    fprintf(stderr, "%llu records in %.3f s (%.0f/s), %llu states, %u games\n", (unsigned long long)count,
+            seconds, seconds > 0 ? count / seconds : 0.0, events, gameCount);
+    if (tooLong > 0) {
+        fprintf(stderr, "%llu variant states weren't kept by the journal and aren't counted\n", tooLong);
+    }
+    journalClose(&journal);
+
+    if (queryCount == 0) {
+        static char *defaults[] = {"total", "day"};
+        queries = defaults;
+        queryCount = 2;
+    }
+    for (int i = 0; i < queryCount; i++) {
+        statsQuery(queries[i], strlen(queries[i]), latestHour, reply, sizeof(reply));
+        printf("%s\n", reply);
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+    const char *journalPath = NULL;
+
+    while ((opt = getopt(argc, argv, "h:p:n:f:")) != -1) {
+        switch (opt) {
+        case 'h':
+            mqttHost = optarg;
+            break;
+        case 'p':
+            mqttPort = atoi(optarg);
+            break;
+        case 'n':
+            maxGames = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 'f':
+            journalPath = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-h host] [-p port] [-n maxGames]      follow TTT/# live\n"
+                    "       %s -f journal [-n maxGames] [query ...]     aggregate a journal\n",
+                    argv[0], argv[0]);
+            return 1;
+        }
+    }
+
+    if (maxGames == 0 || initGames(maxGames) < 0) {
+        return 1;
+    }
+
+    int status = journalPath != NULL ? readJournal(journalPath, argv + optind, argc - optind) : follow();
+    if (droppedGames > 0) {
+        fprintf(stderr, "%llu states dropped, the game table is full (-n)\n", droppedGames);
+    }
+    return status;
+}
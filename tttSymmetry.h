@@ -0,0 +1,96 @@
+// tttSymmetry.h - The 8 symmetries of the 3x3 board on ttt.h bitboards
+// Rotating or mirroring a position doesn't change its game value, so the
+// 5,478 positions reachable in a game are only 765 different ones. Each
+// position maps to a canonical key, the smallest of its 8 images, and
+// anything indexed by the key (see tttCache.h) is stored once.
+//
+// A symmetry moves each 3-cell row of a mask somewhere else as a whole
+// pattern, so a mask is mapped with three table reads, one per row, out
+// of tables precomputed from tttSymCells below.
+
+#ifndef TTT_SYMMETRY_H
+#define TTT_SYMMETRY_H
+
+#include <stdint.h>
+
+#include "ttt.h"
+
+#define TTT_SYMMETRIES 8
+
+// Cell c (row * 3 + col) goes to tttSymCells[s][c]: identity, rotations
+// by 90, 180 and 270 degrees clockwise, mirror left-right, mirror
+// top-bottom, and the two diagonal flips
+static const uint8_t tttSymCells[TTT_SYMMETRIES][9] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8},
+    {2, 5, 8, 1, 4, 7, 0, 3, 6},
+    {8, 7, 6, 5, 4, 3, 2, 1, 0},
+    {6, 3, 0, 7, 4, 1, 8, 5, 2},
+    {2, 1, 0, 5, 4, 3, 8, 7, 6},
+    {6, 7, 8, 3, 4, 5, 0, 1, 2},
+    {0, 3, 6, 1, 4, 7, 2, 5, 8},
+    {8, 5, 2, 7, 4, 1, 6, 3, 0},
+};
+
+// Symmetry that undoes s
+static const uint8_t tttSymInverse[TTT_SYMMETRIES] = {0, 3, 2, 1, 4, 5, 6, 7};
+
+// tttSymRows[s][r][p]: where the row r pattern p (bit 0 = column 0) ends
+// up under symmetry s
+static const uint16_t tttSymRows[TTT_SYMMETRIES][3][8] = {
+    {{0x000, 0x001, 0x002, 0x003, 0x004, 0x005, 0x006, 0x007},
+     {0x000, 0x008, 0x010, 0x018, 0x020, 0x028, 0x030, 0x038},
+     {0x000, 0x040, 0x080, 0x0C0, 0x100, 0x140, 0x180, 0x1C0}},
+    {{0x000, 0x004, 0x020, 0x024, 0x100, 0x104, 0x120, 0x124},
+     {0x000, 0x002, 0x010, 0x012, 0x080, 0x082, 0x090, 0x092},
+     {0x000, 0x001, 0x008, 0x009, 0x040, 0x041, 0x048, 0x049}},
+    {{0x000, 0x100, 0x080, 0x180, 0x040, 0x140, 0x0C0, 0x1C0},
+     {0x000, 0x020, 0x010, 0x030, 0x008, 0x028, 0x018, 0x038},
+     {0x000, 0x004, 0x002, 0x006, 0x001, 0x005, 0x003, 0x007}},
+    {{0x000, 0x040, 0x008, 0x048, 0x001, 0x041, 0x009, 0x049},
+     {0x000, 0x080, 0x010, 0x090, 0x002, 0x082, 0x012, 0x092},
+     {0x000, 0x100, 0x020, 0x120, 0x004, 0x104, 0x024, 0x124}},
+    {{0x000, 0x004, 0x002, 0x006, 0x001, 0x005, 0x003, 0x007},
+     {0x000, 0x020, 0x010, 0x030, 0x008, 0x028, 0x018, 0x038},
+     {0x000, 0x100, 0x080, 0x180, 0x040, 0x140, 0x0C0, 0x1C0}},
+    {{0x000, 0x040, 0x080, 0x0C0, 0x100, 0x140, 0x180, 0x1C0},
+     {0x000, 0x008, 0x010, 0x018, 0x020, 0x028, 0x030, 0x038},
+     {0x000, 0x001, 0x002, 0x003, 0x004, 0x005, 0x006, 0x007}},
+    {{0x000, 0x001, 0x008, 0x009, 0x040, 0x041, 0x048, 0x049},
+     {0x000, 0x002, 0x010, 0x012, 0x080, 0x082, 0x090, 0x092},
+     {0x000, 0x004, 0x020, 0x024, 0x100, 0x104, 0x120, 0x124}},
+    {{0x000, 0x100, 0x020, 0x120, 0x004, 0x104, 0x024, 0x124},
+     {0x000, 0x080, 0x010, 0x090, 0x002, 0x082, 0x012, 0x092},
+     {0x000, 0x040, 0x008, 0x048, 0x001, 0x041, 0x009, 0x049}},
+};
+
+// Apply symmetry s to a 9-bit mask
+static inline uint16_t tttSymMap(int s, uint16_t mask) {
+    return (uint16_t)(tttSymRows[s][0][mask & 7] | tttSymRows[s][1][(mask >> 3) & 7] |
+                      tttSymRows[s][2][(mask >> 6) & 7]);
+}
+
+// Key of a position as it stands: X's marks, then O's above them
+static inline uint32_t tttPositionKey(uint16_t x, uint16_t o) {
+    return (uint32_t)x | (uint32_t)o << 9;
+}
+
+// Canonical key of the position, the smallest key among its 8 images.
+// *sym gets a symmetry that maps the position onto it, so a cell mask
+// stored for the canonical position comes back with
+// tttSymMap(tttSymInverse[*sym], mask).
+static inline uint32_t tttCanonicalKey(uint16_t x, uint16_t o, int *sym) {
+    uint32_t best = tttPositionKey(x, o);
+    int bestSym = 0;
+
+    for (int s = 1; s < TTT_SYMMETRIES; s++) {
+        uint32_t key = tttPositionKey(tttSymMap(s, x), tttSymMap(s, o));
+        if (key < best) {
+            best = key;
+            bestSym = s;
+        }
+    }
+    *sym = bestSym;
+    return best;
+}
+
+#endif
@@ -0,0 +1,138 @@
+// tttTopics.h - Topic dispatch for the TTT/<game>/<subtopic> messages
+// The "<gameTopic>/" prefix is worked out once, and the known subtopics
+// sit in a 16-slot table indexed by a perfect hash of their first and
+// third characters and length. Classifying an incoming topic is one memcmp
+// on the prefix, a hash, and one memcmp to confirm, straight on the
+// receive buffer: no snprintf, no strcmp chains, no copies.
+
+#ifndef TTT_TOPICS_H
+#define TTT_TOPICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Subtopics under the game topic
+#define TTT_SUB_NONE           -1  // not ours, or not a known subtopic
+#define TTT_SUB_STATE           0
+#define TTT_SUB_BOARD           1
+#define TTT_SUB_PLAYER          2
+#define TTT_SUB_STATUS          3
+#define TTT_SUB_MOVES           4
+#define TTT_SUB_SCORE           5
+#define TTT_SUB_BOARD_FORMATTED 6
+#define TTT_SUB_VARIANT         7  // "15x15k5" for tttGrid.h games
+#define TTT_SUB_COUNT           8
+
+#define TTT_TOPIC_SLOTS 16   // power of two
+#define TTT_TOPIC_PREFIX_MAX 96
+
+static const char *const tttSubtopicNames[TTT_SUB_COUNT] = {
+    "state", "board", "player", "status", "moves", "score", "board_formatted", "variant"
+};
+
+typedef struct {
+    const char *name;  // NULL for an empty slot
+    uint8_t len;
+    int8_t kind;
+} TttTopicSlot;
+
+typedef struct {
+    char prefix[TTT_TOPIC_PREFIX_MAX];  // "<gameTopic>/"
+    size_t prefixLen;
+    TttTopicSlot slots[TTT_TOPIC_SLOTS];
+} TttTopicTable;
+
+// Collision-free for the names above; every name is at least 3 chars
+static inline unsigned int tttSubtopicHash(const char *sub, size_t len) {
+    return ((unsigned char)sub[0] + 2u * (unsigned char)sub[2] + (unsigned int)len) & (TTT_TOPIC_SLOTS - 1);
+}
+
+// Build the table for messages under gameTopic (e.g. "TTT" or "TTT/42").
+// Returns -1 if the topic is too long or a subtopic collides in the hash.
+static inline int tttTopicTableInit(TttTopicTable *t, const char *gameTopic) {
+    size_t len = strlen(gameTopic);
+
+    memset(t, 0, sizeof(*t));
+    if (len + 1 >= sizeof(t->prefix)) {
+        return -1;
+    }
+    memcpy(t->prefix, gameTopic, len);
+    t->prefix[len] = '/';
+    t->prefixLen = len + 1;
+
+    for (int kind = 0; kind < TTT_SUB_COUNT; kind++) {
+        const char *name = tttSubtopicNames[kind];
+        size_t nameLen = strlen(name);
+        TttTopicSlot *slot = &t->slots[tttSubtopicHash(name, nameLen)];
+
+        if (slot->name != NULL) {
+            return -1;
+        }
+        slot->name = name;
+        slot->len = (uint8_t)nameLen;
+        slot->kind = (int8_t)kind;
+    }
+    return 0;
+}
+
+// Commands for a game on tttServer go to "<base>/p<n>/<gameId>", with n
+// the game's partition out of TTT_PARTITIONS. A tttServer -W worker only
+// subscribes to the partitions it owns, so the broker delivers each
+// command to one worker instead of all of them.
+#define TTT_PARTITION_BITS 8
+#define TTT_PARTITIONS (1u << TTT_PARTITION_BITS)
+
+// FNV-1a over a game id, never 0
+static inline uint32_t tttGameHash(const char *id, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)id[i]) * 16777619u;
+    }
+    return h ? h : 1;
+}
+
+// Partition of a game, from its tttGameHash(). FNV's low bits are weak on
+// short ids, so the top bits of a multiplicative hash are used.
+static inline unsigned int tttPartitionOf(uint32_t gameHash) {
+    return (gameHash * 2654435761u) >> (32 - TTT_PARTITION_BITS);
+}
+
+// "<base>/p<n>/<gameId>". Returns the length, or -1 if it doesn't fit.
+static inline int tttCommandTopic(char *out, size_t size, const char *base, const char *id) {
+    int n = snprintf(out, size, "%s/p%u/%s", base, tttPartitionOf(tttGameHash(id, strlen(id))), id);
+    return n < 0 || (size_t)n >= size ? -1 : n;
+}
+
+// Length of a leading "p<n>/" partition level in a topic (after the base
+// and its '/'), 0 if it doesn't start with one
+static inline size_t tttPartitionLevel(const char *topic, size_t len) {
+    size_t i = 1;
+
+    if (len < 3 || topic[0] != 'p') {
+        return 0;
+    }
+    while (i < len && topic[i] >= '0' && topic[i] <= '9') {
+        i++;
+    }
+    return i > 1 && i < len && topic[i] == '/' ? i + 1 : 0;
+}
+
+// Which of our subtopics is this topic? TTT_SUB_NONE if it isn't one.
+static inline int tttTopicLookup(const TttTopicTable *t, const char *topic, size_t len) {
+    if (len < t->prefixLen + 3 || memcmp(topic, t->prefix, t->prefixLen) != 0) {
+        return TTT_SUB_NONE;
+    }
+
+    const char *sub = topic + t->prefixLen;
+    size_t subLen = len - t->prefixLen;
+    const TttTopicSlot *slot = &t->slots[tttSubtopicHash(sub, subLen)];
+
+    if (slot->name == NULL || slot->len != subLen || memcmp(sub, slot->name, subLen) != 0) {
+        return TTT_SUB_NONE;
+    }
+    return slot->kind;
+}
+
+#endif
@@ -0,0 +1,373 @@
+// tttTournament.c - In-process self-play tournament between autoplay strategies
+// Plays every pairing of
+//   shuffled - a shuffled list of all 9 positions, tried in order with the
+//              taken ones rejected (the controlLinux.sh random mode)
+//   random   - any empty cell (controlLinux 'a')
+//   perfect  - an optimal move from the solved game table (controlLinux 'p')
+// with the ttt.h rules the ESP32 plays by, and reports win/draw rates and
+// games/sec.
+//
+// Games are cut into chunks spread over per-thread deques; a thread works
+// through its own deque from the back and, once it runs dry, steals from
+// the front of the others'. Each thread counts into its own stats, which
+// are merged at the end. Every chunk seeds its own RNG, so the results are
+// identical whatever the thread count.
+//
+//   ./tttTournament -n 1000000           # all cores
+//   ./tttTournament -n 1000000 -S        # scaling from 1 to N threads
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "ttt.h"
+#include "tttSolver.h"
+
+#define STRATEGY_SHUFFLED 0
+#define STRATEGY_RANDOM   1
+#define STRATEGY_PERFECT  2
+#define STRATEGY_COUNT    3
+#define MATCHUPS (STRATEGY_COUNT * STRATEGY_COUNT)
+
+#define CHUNK_GAMES 4096
+
+static const char *strategyNames[STRATEGY_COUNT] = {"shuffled", "random", "perfect"};
+
+typedef struct {
+    unsigned long long games;
+    unsigned long long xWins;
+    unsigned long long oWins;
+    unsigned long long draws;
+    unsigned long long moves;
+    unsigned long long rejected;  // shuffled positions that were already taken
+} Stats;
+
+// A run of games of one pairing
+typedef struct {
+    int matchup;          // xStrategy * STRATEGY_COUNT + oStrategy
+    uint64_t seed;
+    unsigned int games;
+} Chunk;
+
+// Chunk numbers [head, tail) a thread still has to play. The owner takes
+// from the tail, thieves from the head.
+typedef struct {
+    pthread_mutex_t lock;
+    unsigned int head;
+    unsigned int tail;
+    unsigned int *chunks;
+    Stats stats[MATCHUPS];
+    unsigned long long stolen;
+} Worker __attribute__((aligned(64)));
+
+unsigned long long gamesPerMatchup = 100000;
+int maxThreads = 0;
+
+Chunk *chunks = NULL;
+unsigned int chunkCount = 0;
+Worker *workers = NULL;
+int workerCount = 0;
+
+static uint64_t nextRandom(uint64_t *state) {
+    // xorshift64*
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 2685821657736338717ull;
+}
+
+// The n-th set bit of mask
+static int nthCell(uint16_t mask, int n) {
+    while (n-- > 0) {
+        mask &= (uint16_t)(mask - 1);
+    }
+    return __builtin_ctz(mask);
+}
+
+static void shuffle(uint8_t *order, uint64_t *rng) {
+    for (int i = 0; i < 9; i++) {
+        order[i] = (uint8_t)i;
+    }
+    for (int i = 8; i > 0; i--) {
+        int j = (int)(nextRandom(rng) % (uint64_t)(i + 1));
+        uint8_t t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+}
+
+static void playGame(int xStrategy, int oStrategy, uint64_t *rng, Stats *s) {
+    TttBoard b;
+    uint8_t order[2][9];
+    int next[2] = {0, 0};
+
+    tttReset(&b);
+    if (xStrategy == STRATEGY_SHUFFLED) {
+        shuffle(order[0], rng);
+    }
+    if (oStrategy == STRATEGY_SHUFFLED) {
+        shuffle(order[1], rng);
+    }
+
+    while (b.status == TTT_PLAYING) {
+        int side = b.player;
+        int strategy = side ? oStrategy : xStrategy;
+        int cell;
+
+        if (strategy == STRATEGY_PERFECT) {
+            cell = tttBestMove(&b, (unsigned int)nextRandom(rng));
+        } else if (strategy == STRATEGY_RANDOM) {
+            uint16_t empty = tttEmpty(&b);
+            cell = nthCell(empty, (int)(nextRandom(rng) % (uint64_t)__builtin_popcount(empty)));
+        } else {
+            // Every taken position is a move the ESP32 rejects
+            while (!tttIsFree(&b, order[side][next[side]])) {
+                next[side]++;
+                s->rejected++;
+            }
+            cell = order[side][next[side]++];
+        }
+
+        tttPlay(&b, cell);
+        s->moves++;
+    }
+
+    s->games++;
+    if (b.status == TTT_X_WINS) {
+        s->xWins++;
+    } else if (b.status == TTT_O_WINS) {
+        s->oWins++;
+    } else {
+        s->draws++;
+    }
+}
+
+static void playChunk(const Chunk *c, Worker *w) {
+    uint64_t rng = c->seed;
+    int xStrategy = c->matchup / STRATEGY_COUNT;
+    int oStrategy = c->matchup % STRATEGY_COUNT;
+
+    for (unsigned int i = 0; i < c->games; i++) {
+        playGame(xStrategy, oStrategy, &rng, &w->stats[c->matchup]);
+    }
+}
+
+// Next chunk from our own deque, or -1 once it is empty
+static int popOwn(Worker *w) {
+    int chunk = -1;
+
+    pthread_mutex_lock(&w->lock);
+    if (w->head < w->tail) {
+        chunk = (int)w->chunks[--w->tail];
+    }
+    pthread_mutex_unlock(&w->lock);
+    return chunk;
+}
+
+// Take a chunk from the front of another thread's deque
+static int steal(int self) {
+    for (int n = 1; n < workerCount; n++) {
+        Worker *victim = &workers[(self + n) % workerCount];
+        int chunk = -1;
+
+        pthread_mutex_lock(&victim->lock);
+        if (victim->head < victim->tail) {
+            chunk = (int)victim->chunks[victim->head++];
+        }
+        pthread_mutex_unlock(&victim->lock);
+
+        if (chunk >= 0) {
+            return chunk;
+        }
+    }
+    return -1;
+}
+
+static void *workerMain(void *arg) {
+    int self = (int)(intptr_t)arg;
+    Worker *w = &workers[self];
+    int chunk;
+
+    for (;;) {
+        if ((chunk = popOwn(w)) < 0) {
+            if ((chunk = steal(self)) < 0) {
+                break;  // nothing left anywhere
+            }
+            w->stolen++;
+        }
+        playChunk(&chunks[chunk], w);
+    }
+    return NULL;
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void mergeStats(Stats *dst, const Stats *src) {
+    dst->games += src->games;
+    dst->xWins += src->xWins;
+    dst->oWins += src->oWins;
+    dst->draws += src->draws;
+    dst->moves += src->moves;
+    dst->rejected += src->rejected;
+}
+
+// Play the whole tournament on threadCount threads. Returns the elapsed
+// seconds; totals gets the merged stats per pairing.
+static double runTournament(int threadCount, Stats *totals, unsigned long long *stolen) {
+    pthread_t threads[threadCount];
+    unsigned int *order = malloc(chunkCount * sizeof(unsigned int));
+
+    workerCount = threadCount;
+    workers = aligned_alloc(64, (size_t)threadCount * sizeof(Worker));
+    if (order == NULL || workers == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+
+    // Deal the chunks out round robin; pairings differ in cost, so the
+    // deques run out unevenly and stealing evens it up
+    unsigned int filled = 0;
+    for (int t = 0; t < threadCount; t++) {
+        Worker *w = &workers[t];
+        memset(w, 0, sizeof(*w));
+        pthread_mutex_init(&w->lock, NULL);
+        w->chunks = order + filled;
+        for (unsigned int c = (unsigned int)t; c < chunkCount; c += (unsigned int)threadCount) {
+            order[filled++] = c;
+            w->tail++;
+        }
+    }
+
+    double start = now();
+    for (int t = 0; t < threadCount; t++) {
+        pthread_create(&threads[t], NULL, workerMain, (void *)(intptr_t)t);
+    }
+    for (int t = 0; t < threadCount; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    double elapsed = now() - start;
+
+    memset(totals, 0, MATCHUPS * sizeof(Stats));
+    *stolen = 0;
+    for (int t = 0; t < threadCount; t++) {
+        for (int m = 0; m < MATCHUPS; m++) {
+            mergeStats(&totals[m], &workers[t].stats[m]);
+        }
+        *stolen += workers[t].stolen;
+        pthread_mutex_destroy(&workers[t].lock);
+    }
+
+    free(workers);
+    free(order);
+    workers = NULL;
+    return elapsed;
+}
+
+static void printResults(const Stats *totals) {
+    printf("%-8s %-8s %10s %8s %8s %8s %10s %10s\n",
+           "X", "O", "games", "X wins", "O wins", "draws", "moves/game", "rejected");
+    for (int m = 0; m < MATCHUPS; m++) {
+        const Stats *s = &totals[m];
+        double games = s->games ? (double)s->games : 1.0;
+
+        printf("%-8s %-8s %10llu %7.2f%% %7.2f%% %7.2f%% %10.2f %10.2f\n",
+               strategyNames[m / STRATEGY_COUNT], strategyNames[m % STRATEGY_COUNT], s->games,
+               100.0 * s->xWins / games, 100.0 * s->oWins / games, 100.0 * s->draws / games,
+               s->moves / games, s->rejected / games);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int scaling = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:j:S")) != -1) {
+        switch (opt) {
+        case 'n':
+            gamesPerMatchup = strtoull(optarg, NULL, 10);
+            break;
+        case 'j':
+            maxThreads = atoi(optarg);
+            break;
+        case 'S':
+            scaling = 1;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n gamesPerPairing] [-j threads] [-S]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (maxThreads <= 0) {
+        maxThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (maxThreads < 1 || gamesPerMatchup == 0) {
+        return 1;
+    }
+
+    // Solve once up front; the table is read-only while the threads play
+    tttSolverInit();
+
+    unsigned long long perMatchup = (gamesPerMatchup + CHUNK_GAMES - 1) / CHUNK_GAMES;
+    chunkCount = (unsigned int)(perMatchup * MATCHUPS);
+    chunks = malloc(chunkCount * sizeof(Chunk));
+    if (chunks == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    for (unsigned int c = 0; c < chunkCount; c++) {
+        unsigned long long first = (c % perMatchup) * CHUNK_GAMES;
+        unsigned long long left = gamesPerMatchup - first;
+
+        chunks[c].matchup = (int)(c / perMatchup);
+        chunks[c].games = (unsigned int)(left < CHUNK_GAMES ? left : CHUNK_GAMES);
+        chunks[c].seed = 0x9E3779B97F4A7C15ull * (c + 1);
+    }
+
+    Stats totals[MATCHUPS];
+    Stats reference[MATCHUPS];
+    unsigned long long stolen;
+    double baseRate = 0;
+    int first = scaling ? 1 : maxThreads;
+
+    if (scaling) {
+        printf("%7s %10s %12s %8s %8s\n", "threads", "seconds", "games/s", "speedup", "stolen");
+    }
+
+    // 1, 2, 4, ... and then maxThreads itself
+    for (int threads = first; threads <= maxThreads;
+         threads = threads < maxThreads && threads * 2 > maxThreads ? maxThreads : threads * 2) {
+        double elapsed = runTournament(threads, totals, &stolen);
+        double rate = gamesPerMatchup * MATCHUPS / elapsed;
+
+        if (threads == first) {
+            baseRate = rate;
+            memcpy(reference, totals, sizeof(totals));
+        } else if (memcmp(reference, totals, sizeof(totals)) != 0) {
+            fprintf(stderr, "Results differ with %d threads!\n", threads);
+            return 1;
+        }
+
+        if (scaling) {
+            printf("%7d %10.3f %12.0f %7.2fx %8llu\n", threads, elapsed, rate, rate / baseRate, stolen);
+        } else {
+            printf("%llu games on %d threads in %.3f s: %.0f games/s (%llu chunks stolen)\n",
+                   gamesPerMatchup * MATCHUPS, threads, elapsed, rate, stolen);
+        }
+    }
+
+    printf("\n");
+    printResults(reference);
+    free(chunks);
+    return 0;
+}
@@ -0,0 +1,86 @@
+// tttWire.h - Compact binary game-state message
+// The whole game state in 12 bytes, published retained on TTT/state (or
+// TTT/<gameId>/state) once per move, instead of the board/player/
+// board_formatted/moves/status/score text topics:
+//
+//   byte 0      format version (TTT_WIRE_VERSION)
+//   byte 1      bits 0-1 status (TTT_PLAYING, TTT_X_WINS, ...),
+//               bit 2 side to move (0 = X, 1 = O)
+//   bytes 2-4   little-endian: bits 0-8 X's mask, bits 9-17 O's mask
+//   bytes 5-6   little-endian sequence number, +1 per published state
+//   version 2 adds:
+//   byte 7      cell (0..8) of the move that produced this state,
+//               0xFF after a reset
+//   bytes 8-9   little-endian X wins
+//   bytes 10-11 little-endian O wins
+//
+// Later versions only append fields, so a decoder accepts any message at
+// least TTT_WIRE_MIN_SIZE bytes long and fills in what it carries.
+// Byte 0 is never 0 here: that marks the larger-board state of tttGrid.h.
+
+#ifndef TTT_WIRE_H
+#define TTT_WIRE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ttt.h"
+
+#define TTT_WIRE_VERSION 2
+#define TTT_WIRE_SIZE 12
+#define TTT_WIRE_MIN_SIZE 7   // version 1
+#define TTT_NO_MOVE -1
+
+typedef struct {
+    TttBoard board;
+    uint16_t seq;
+    int8_t lastMove;   // cell of the move that led here, TTT_NO_MOVE if none
+    uint16_t xWins;
+    uint16_t oWins;
+} TttState;
+
+static inline void tttWireEncode(const TttState *s, uint8_t *out) {
+    const TttBoard *b = &s->board;
+    uint32_t masks = (uint32_t)(b->x & TTT_FULL_BOARD) | ((uint32_t)(b->o & TTT_FULL_BOARD) << 9);
+
+    out[0] = TTT_WIRE_VERSION;
+    out[1] = (uint8_t)((b->status & 0x03) | ((b->player & 1) << 2));
+    out[2] = (uint8_t)(masks & 0xFF);
+    out[3] = (uint8_t)((masks >> 8) & 0xFF);
+    out[4] = (uint8_t)((masks >> 16) & 0xFF);
+    out[5] = (uint8_t)(s->seq & 0xFF);
+    out[6] = (uint8_t)(s->seq >> 8);
+    out[7] = s->lastMove < 0 ? 0xFF : (uint8_t)s->lastMove;
+    out[8] = (uint8_t)(s->xWins & 0xFF);
+    out[9] = (uint8_t)(s->xWins >> 8);
+    out[10] = (uint8_t)(s->oWins & 0xFF);
+    out[11] = (uint8_t)(s->oWins >> 8);
+}
+
+// Returns 0 on success, -1 if the message is too short or not ours.
+// Fields a version-1 message doesn't carry come back as no move / 0 wins.
+static inline int tttWireDecode(const uint8_t *in, size_t len, TttState *s) {
+    if (len < TTT_WIRE_MIN_SIZE || in[0] < 1) {
+        return -1;
+    }
+
+    uint32_t masks = (uint32_t)in[2] | ((uint32_t)in[3] << 8) | ((uint32_t)in[4] << 16);
+
+    s->board.status = in[1] & 0x03;
+    s->board.player = (in[1] >> 2) & 1;
+    s->board.x = (uint16_t)(masks & TTT_FULL_BOARD);
+    s->board.o = (uint16_t)((masks >> 9) & TTT_FULL_BOARD);
+    s->seq = (uint16_t)(in[5] | (in[6] << 8));
+    s->lastMove = TTT_NO_MOVE;
+    s->xWins = 0;
+    s->oWins = 0;
+
+    if (in[0] >= 2 && len >= TTT_WIRE_SIZE) {
+        s->lastMove = in[7] < 9 ? (int8_t)in[7] : TTT_NO_MOVE;
+        s->xWins = (uint16_t)(in[8] | (in[9] << 8));
+        s->oWins = (uint16_t)(in[10] | (in[11] << 8));
+    }
+    return 0;
+}
+
+#endif